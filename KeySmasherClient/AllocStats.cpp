@@ -0,0 +1,35 @@
+#include "AllocStats.h"
+
+#if KS_ALLOC_STATS
+
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> g_totalAllocations{ 0 };
+static thread_local AllocCounter* t_allocCounter = nullptr;
+
+static void* CountedAlloc(size_t size) {
+    g_totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (t_allocCounter) t_allocCounter->count.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void TrackThreadAllocations(AllocCounter* counter) {
+    t_allocCounter = counter;
+}
+
+uint64_t TotalAllocations() {
+    return g_totalAllocations.load(std::memory_order_relaxed);
+}
+
+// the nothrow forms default to calling these; aligned forms are left to the runtime
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+// Heap allocation counters for debug builds. AllocStats.cpp replaces the global operator new and
+// counts every allocation, in total and per tracked thread. Once connected, the capture -> send
+// path (input thread and WSWorker) is not expected to allocate at all; the counters are shown in
+// the latency report so a regression is visible. Release builds compile all of this away.
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(_DEBUG) && !defined(KS_ALLOC_STATS)
+#define KS_ALLOC_STATS 1
+#endif
+
+struct AllocCounter {
+    std::atomic<uint64_t> count{ 0 };
+};
+
+#if KS_ALLOC_STATS
+// Counts the calling thread's allocations into counter from now on (null stops counting)
+void TrackThreadAllocations(AllocCounter* counter);
+uint64_t TotalAllocations();
+#else
+inline void TrackThreadAllocations(AllocCounter*) {}
+inline uint64_t TotalAllocations() { return 0; }
+#endif
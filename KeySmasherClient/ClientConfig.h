@@ -0,0 +1,138 @@
+#pragma once
+
+// Settings that can change while the client runs, and the store that publishes them.
+// Portable (no windows.h); the INI parsing lives in main.cpp.
+//
+// A ClientConfig is built and validated completely before it is published and never changes
+// afterwards. ConfigStore::Publish() swaps the current pointer atomically, so the hook and the
+// worker read settings without locks and never see a half-applied reload. Each reading thread
+// owns a reader slot naming the snapshot it holds (a hazard pointer); Publish() frees every
+// replaced snapshot that no slot names, so at most one old snapshot per reader outlives a reload.
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "KeyRemap.h"
+#include "WindowMatcher.h"
+
+enum class EndpointTransport : uint8_t {
+    WebSocket,
+    Udp,        // sequenced datagrams, see DatagramFormat.h; path is not used
+};
+
+// An endpoint: the primary ([Network], empty name) or a mirror ([Endpoints])
+struct EndpointConfig {
+    std::wstring name;
+    std::wstring host;
+    uint16_t port = 80;
+    std::wstring path = L"/ws";
+    EndpointTransport transport = EndpointTransport::WebSocket;
+
+    bool operator==(const EndpointConfig& o) const {
+        return name == o.name && host == o.host && port == o.port && path == o.path && transport == o.transport;
+    }
+    bool operator!=(const EndpointConfig& o) const { return !(*this == o); }
+};
+
+struct ClientConfig {
+    uint64_t version = 0; // 1 for the configuration read at startup, +1 per reload
+
+    // [Network] / [Endpoints]
+    EndpointConfig primary;
+    std::vector<EndpointConfig> mirrors;
+    bool batch = false;
+    int batchMaxEvents = 64;
+    int flushBudgetUs = 0;        // see FlushPolicy
+    bool adaptiveFlush = true;
+    bool binaryProtocol = true;   // applies from the next connection
+    bool compactProtocol = false; // applies from the next connection
+    int pingIntervalMs = 0;
+    int udpRedundancy = 16;        // applies from the next connection
+    int udpKeyStateIntervalMs = 250; // applies from the next connection
+    int maxKeyAgeMs = 500;         // stale event policy, see StalePolicy
+    int maxMotionAgeMs = 100;
+    int maxQueuedEvents = 256;
+
+    // [Input]
+    bool suppressRepeats = true;
+    bool coalesceTaps = false;
+
+    // [Remap] Profile and its section [Remap.<profile>]
+    std::wstring remapProfile;
+    KeyRemapTable remap;
+
+    // [Targets]
+    WindowRuleMatcher targets;
+
+    // entries that were ignored, one per line
+    std::wstring warnings;
+};
+
+template <typename T>
+class ConfigStore {
+public:
+    static const size_t MAX_READERS = 4;
+
+    ConfigStore() = default;
+    ConfigStore(const ConfigStore&) = delete;
+    ConfigStore& operator=(const ConfigStore&) = delete;
+
+    // The current snapshot for the thread owning slot reader (< MAX_READERS, one thread per slot),
+    // lock-free. It stays valid until the same reader calls Acquire() or Release() again, so a
+    // reader re-acquires once per pass (hook call, worker iteration) and drops older pointers.
+    // Null until the first Publish().
+    const T* Acquire(size_t reader) {
+        const T* cfg = current_.load();
+        for (;;) {
+            // announce first, then check the snapshot is still current: a Publish() that replaced
+            // it in between may not have seen the slot, so try again with the new one
+            readers_[reader].store(cfg);
+            const T* now = current_.load();
+            if (now == cfg) return cfg;
+            cfg = now;
+        }
+    }
+    void Release(size_t reader) { readers_[reader].store(nullptr); }
+
+    // Without a reader slot: only for the publishing thread, which is the only one freeing snapshots
+    const T* Current() const { return current_.load(std::memory_order_acquire); }
+
+    // Makes next the current snapshot and frees the replaced ones no reader holds any more.
+    // Publishers are serialized; readers never wait.
+    void Publish(std::unique_ptr<T> next) {
+        std::lock_guard<std::mutex> lock(publishMutex_);
+        if (current_.load(std::memory_order_relaxed)) retired_.push_back(std::move(latest_));
+        latest_ = std::move(next);
+        current_.store(latest_.get());
+        for (auto it = retired_.begin(); it != retired_.end();) {
+            if (Held(it->get())) ++it;
+            else it = retired_.erase(it);
+        }
+    }
+
+    // Replaced snapshots still held by a reader (at most MAX_READERS)
+    size_t Retired() {
+        std::lock_guard<std::mutex> lock(publishMutex_);
+        return retired_.size();
+    }
+
+private:
+    bool Held(const T* cfg) const {
+        for (const std::atomic<const T*>& r : readers_) {
+            if (r.load() == cfg) return true;
+        }
+        return false;
+    }
+
+    // sequentially consistent: a reader's announcement and the publisher's swap must be seen in
+    // the same order by both, or each could miss the other
+    std::atomic<const T*> current_{ nullptr };
+    std::atomic<const T*> readers_[MAX_READERS] = {};
+    std::mutex publishMutex_;
+    std::unique_ptr<T> latest_;                 // owns current_
+    std::vector<std::unique_ptr<T>> retired_;   // replaced, but named by a reader slot
+};
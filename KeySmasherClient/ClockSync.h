@@ -0,0 +1,125 @@
+#pragma once
+
+// Optional ping/ack channel on the /ws connection and NTP-style RTT / clock-offset estimation.
+// Portable (no windows.h). All times are microseconds; the client uses MonotonicNs() / 1000,
+// the server any monotonic microsecond clock of its own.
+//
+// Messages are always UTF-8 text, independent of the key event encoding:
+//   client -> server   "p<seq> <t1>"                 t1 = client send time
+//   server -> client   "a<seq> <t1> <t2> <t3>"       t1 echoed, t2 = server receive time,
+//                                                    t3 = server send time
+// The client takes t4 when the ack arrives and computes
+//   rtt    = (t4 - t1) - (t3 - t2)
+//   offset = ((t2 - t1) + (t3 - t4)) / 2            (server clock - client clock)
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+struct PingAck {
+    uint32_t seq = 0;
+    int64_t t1 = 0;
+    int64_t t2 = 0;
+    int64_t t3 = 0;
+};
+
+// Returns the message length, or 0 if the buffer is too small.
+inline size_t FormatPing(char* out, size_t cap, uint32_t seq, int64_t t1) {
+    int n = snprintf(out, cap, "p%u %lld", seq, (long long)t1);
+    return (n > 0 && (size_t)n < cap) ? (size_t)n : 0;
+}
+
+// Parses a signed decimal at p (not past end), advancing p. Returns false if no digits.
+inline bool ParseInt64(const char*& p, const char* end, int64_t* out) {
+    bool neg = false;
+    if (p < end && *p == '-') { neg = true; p++; }
+    if (p >= end || *p < '0' || *p > '9') return false;
+    int64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    *out = neg ? -v : v;
+    return true;
+}
+
+// Parses "a<seq> <t1> <t2> <t3>". Returns false for anything else.
+inline bool ParseAck(const char* msg, size_t len, PingAck* ack) {
+    const char* p = msg;
+    const char* end = msg + len;
+    if (p >= end || *p++ != 'a') return false;
+
+    int64_t v[4];
+    for (int i = 0; i < 4; ++i) {
+        if (i > 0) {
+            if (p >= end || *p != ' ') return false;
+            p++;
+        }
+        if (!ParseInt64(p, end, &v[i])) return false;
+    }
+    if (p != end || v[0] < 0 || v[0] > 0xFFFFFFFFLL) return false;
+
+    ack->seq = (uint32_t)v[0];
+    ack->t1 = v[1];
+    ack->t2 = v[2];
+    ack->t3 = v[3];
+    return true;
+}
+
+// Rolling estimator fed with completed ping exchanges. Single-threaded.
+// RTT is smoothed like TCP's SRTT (1/8 gain), jitter follows RFC 3550 (1/16 gain of the
+// RTT change), and the offset is taken from the lowest-RTT sample in the recent window,
+// which is the one least distorted by queuing (NTP clock filter).
+class ClockSyncEstimator {
+public:
+    static const size_t WINDOW = 16;
+
+    void AddSample(const PingAck& ack, int64_t t4) {
+        int64_t rtt = (t4 - ack.t1) - (ack.t3 - ack.t2);
+        if (rtt < 0) rtt = 0;
+        int64_t offset = ((ack.t2 - ack.t1) + (ack.t3 - t4)) / 2;
+
+        if (samples_ == 0) {
+            srtt_ = rtt;
+            jitter_ = 0;
+        } else {
+            int64_t d = rtt - lastRtt_;
+            if (d < 0) d = -d;
+            jitter_ += (d - jitter_) / 16;
+            srtt_ += (rtt - srtt_) / 8;
+        }
+        lastRtt_ = rtt;
+
+        window_[samples_ % WINDOW] = Sample{ rtt, offset };
+        samples_++;
+    }
+
+    uint64_t Samples() const { return samples_; }
+    int64_t SmoothedRttUs() const { return srtt_; }
+    int64_t LastRttUs() const { return lastRtt_; }
+    int64_t JitterUs() const { return jitter_; }
+
+    int64_t OffsetUs() const {
+        size_t n = samples_ < WINDOW ? (size_t)samples_ : WINDOW;
+        if (n == 0) return 0;
+        size_t best = 0;
+        for (size_t i = 1; i < n; ++i) {
+            if (window_[i].rtt < window_[best].rtt) best = i;
+        }
+        return window_[best].offset;
+    }
+
+    void Reset() { *this = ClockSyncEstimator(); }
+
+private:
+    struct Sample {
+        int64_t rtt;
+        int64_t offset;
+    };
+
+    Sample window_[WINDOW] = {};
+    uint64_t samples_ = 0;
+    int64_t srtt_ = 0;
+    int64_t lastRtt_ = 0;
+    int64_t jitter_ = 0;
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+// Datagram protocol for the UDP transport ("keysmasher.udp.1") and the sender-side state that
+// makes it loss tolerant without retransmission. Portable (no windows.h); UdpSession (UdpEngine,
+// PosixUdpEngine) sends it.
+//
+// Every event gets a sequence number (u32, consecutive, wraps). Instead of waiting for a lost
+// datagram to be resent, each datagram repeats the most recent events the server hasn't
+// acknowledged yet, so a single lost datagram is repaired by the next one. A separate key state
+// datagram is sent periodically with every key held after the events sent so far; a server that
+// lost more than the repeated window resyncs from it.
+//
+// Layout (little-endian):
+//   header   u8 version (=1) | u8 type | u32 datagram sequence (per connection, from 0)
+//   events   (type 0) u32 sequence of the first event | binary v1 frame (see WireFormat.h)
+//   text     (type 1) UTF-8 message, e.g. a ping; the server answers in the same form
+//   ack      (type 2, server -> client) u32 next event sequence expected (all before it arrived)
+//   keys     (type 3) u32 next event sequence | 32-byte bitmap of the held keys (bit vk of byte vk / 8)
+// A server applies the events whose sequence it hasn't applied yet, in order, and skips the
+// rest. If an events datagram starts past its next expected sequence, events were lost for good:
+// it applies them anyway and makes its key state match the next keys datagram. Datagrams older
+// than the newest one seen may be dropped. Acks are optional; without them the window is still
+// repeated (bounded by the redundancy), it just never shrinks early.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "KeyEvent.h"
+#include "KeyState.h"
+#include "WireFormat.h"
+
+const char* const DATAGRAM_PROTOCOL = "keysmasher.udp.1";
+const uint8_t DATAGRAM_VERSION = 1;
+const size_t DATAGRAM_HEADER_LEN = 6;
+const size_t DATAGRAM_KEYS_LEN = DATAGRAM_HEADER_LEN + 4 + 32;
+// events are only repeated while the datagram stays below this (no IP fragmentation on
+// typical links); fresh events always go out, even if that makes the datagram larger
+const size_t DATAGRAM_TARGET_SIZE = 1200;
+
+enum class DatagramType : uint8_t {
+    Events = 0,
+    Text = 1,
+    Ack = 2,
+    Keys = 3,
+};
+
+inline size_t EncodeDatagramHeader(DatagramType type, uint32_t seq, uint8_t* out) {
+    out[0] = DATAGRAM_VERSION;
+    out[1] = (uint8_t)type;
+    PutU32(out + 2, seq);
+    return DATAGRAM_HEADER_LEN;
+}
+
+// Parses the header of a received datagram. Returns false if it isn't one of ours.
+inline bool DecodeDatagramHeader(const uint8_t* data, size_t len, DatagramType* type, uint32_t* seq) {
+    if (len < DATAGRAM_HEADER_LEN || data[0] != DATAGRAM_VERSION || data[1] > (uint8_t)DatagramType::Keys) return false;
+    *type = (DatagramType)data[1];
+    *seq = GetU32(data + 2);
+    return true;
+}
+
+// Sender state of one connection: sequence numbers, the window of recent events that are repeated
+// until acknowledged, and the key state the server should hold after everything sent so far.
+// Not thread-safe; the UDP engines serialize access.
+class DatagramSender {
+public:
+    static const size_t MAX_REDUNDANCY = 64;
+
+    // A new connection: sequences restart and nothing is outstanding
+    void Reset(size_t redundancy) {
+        redundancy_ = redundancy < MAX_REDUNDANCY ? redundancy : MAX_REDUNDANCY;
+        datagramSeq_ = 0;
+        nextEventSeq_ = 0;
+        ackedSeq_ = 0;
+        windowStart_ = 0;
+        windowCount_ = 0;
+        keys_ = KeySnapshot();
+    }
+
+    // Encodes fresh events (already sent to no one) after the unacknowledged ones among the last
+    // `redundancy` events, then adds the fresh ones to the window. count may be 0 to repeat the
+    // window alone. Returns the datagram length, or 0 if there is nothing to send or it doesn't fit.
+    size_t EncodeEvents(const KeyEvent* fresh, size_t count, uint8_t* out, size_t cap) {
+        size_t repeat = Unacked();
+        if (repeat > redundancy_) repeat = redundancy_;
+        while (repeat > 0 && DATAGRAM_HEADER_LEN + 4 + BinaryFrameSize(repeat + count) > DATAGRAM_TARGET_SIZE) repeat--;
+        if (repeat + count > BINARY_MAX_EVENTS) repeat = count < BINARY_MAX_EVENTS ? BINARY_MAX_EVENTS - count : 0;
+        if (repeat + count == 0 || count > BINARY_MAX_EVENTS) return 0;
+        if (cap < DATAGRAM_HEADER_LEN + 4 + BinaryFrameSize(repeat + count)) return 0;
+
+        // the window ends with the newest event sent; repeated events precede the fresh ones
+        KeyEvent* events = scratch_;
+        for (size_t i = 0; i < repeat; ++i) events[i] = window_[(windowStart_ + windowCount_ - repeat + i) % MAX_REDUNDANCY];
+        for (size_t i = 0; i < count; ++i) events[repeat + i] = fresh[i];
+
+        size_t len = EncodeDatagramHeader(DatagramType::Events, datagramSeq_++, out);
+        PutU32(out + len, nextEventSeq_ - (uint32_t)repeat);
+        len += 4;
+        len += EncodeBinaryBatch(events, repeat + count, out + len, cap - len);
+
+        for (size_t i = 0; i < count; ++i) Remember(fresh[i]);
+        return len;
+    }
+
+    // Encodes the key state after every event sent so far
+    size_t EncodeKeys(uint8_t* out, size_t cap) {
+        if (cap < DATAGRAM_KEYS_LEN) return 0;
+        size_t len = EncodeDatagramHeader(DatagramType::Keys, datagramSeq_++, out);
+        PutU32(out + len, nextEventSeq_);
+        len += 4;
+        for (size_t i = 0; i < 32; ++i) out[len + i] = (uint8_t)(keys_.words[i / 8] >> ((i % 8) * 8));
+        return len + 32;
+    }
+
+    // Encodes an empty key state, which from now on is the state the server should hold: sent
+    // when the connection closes, so the server releases whatever it still holds
+    size_t EncodeReleaseAll(uint8_t* out, size_t cap) {
+        keys_ = KeySnapshot();
+        return EncodeKeys(out, cap);
+    }
+
+    // Wraps a text message (ping). Returns 0 if it doesn't fit.
+    size_t EncodeText(const uint8_t* text, size_t textLen, uint8_t* out, size_t cap) {
+        if (cap < DATAGRAM_HEADER_LEN + textLen) return 0;
+        size_t len = EncodeDatagramHeader(DatagramType::Text, datagramSeq_++, out);
+        for (size_t i = 0; i < textLen; ++i) out[len + i] = text[i];
+        return len + textLen;
+    }
+
+    // The server has everything before nextExpected; stale or bogus acks are ignored
+    void OnAck(uint32_t nextExpected) {
+        uint32_t advance = nextExpected - ackedSeq_;
+        if (advance == 0 || advance > nextEventSeq_ - ackedSeq_) return;
+        ackedSeq_ = nextExpected;
+    }
+
+    // events sent but not acknowledged that are still in the window
+    size_t Unacked() const {
+        uint32_t outstanding = nextEventSeq_ - ackedSeq_;
+        return outstanding < windowCount_ ? (size_t)outstanding : windowCount_;
+    }
+
+    size_t Redundancy() const { return redundancy_; }
+    uint32_t NextEventSeq() const { return nextEventSeq_; }
+    const KeySnapshot& Keys() const { return keys_; }
+
+private:
+    void Remember(const KeyEvent& ev) {
+        if (windowCount_ == MAX_REDUNDANCY) {
+            windowStart_ = (windowStart_ + 1) % MAX_REDUNDANCY;
+            windowCount_--;
+        }
+        window_[(windowStart_ + windowCount_) % MAX_REDUNDANCY] = ev;
+        windowCount_++;
+        nextEventSeq_++;
+
+        if (!IsKeyTransition(ev)) return;
+        uint64_t bit = 1ull << (ev.vkCode & 63);
+        if (ev.type == KeyEventType::Down) keys_.words[ev.vkCode >> 6] |= bit;
+        else keys_.words[ev.vkCode >> 6] &= ~bit;
+    }
+
+    size_t redundancy_ = 0;
+    uint32_t datagramSeq_ = 0;
+    uint32_t nextEventSeq_ = 0;
+    uint32_t ackedSeq_ = 0;
+    KeyEvent window_[MAX_REDUNDANCY];
+    size_t windowStart_ = 0;
+    size_t windowCount_ = 0;
+    KeySnapshot keys_;
+    KeyEvent scratch_[BINARY_MAX_EVENTS];
+};
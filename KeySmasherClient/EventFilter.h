@@ -0,0 +1,84 @@
+#pragma once
+
+// Filtering / coalescing stage between capture and the send queue. Portable (no windows.h).
+//
+// - Auto-repeat suppression: Windows repeats WM_KEYDOWN while a key is held. The server only
+//   needs the transition, so a key-down for a key that is already down is dropped at capture.
+// - Motion accumulation: mouse motion and wheel deltas that are still waiting to be sent are
+//   summed into one event, so a 1 kHz mouse costs at most one event per frame.
+// - Tap coalescing (optional): a key-down and its key-up that are both still waiting to be sent
+//   cancel out. This trades the short tap for less backlog on slow links, so it is only useful
+//   for servers that care about key state rather than individual presses.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "KeyEvent.h"
+#include "KeyState.h"
+
+struct FilterStats {
+    std::atomic<uint64_t> repeatsDropped{ 0 };
+    std::atomic<uint64_t> tapsCoalesced{ 0 };  // down/up pairs removed
+    std::atomic<uint64_t> motionMerged{ 0 };   // motion/wheel events folded into a queued one
+};
+
+// True if ev is a key-down for a key whose last enqueued event was already a key-down
+inline bool IsAutoRepeat(const KeyStateBitset& pressed, const KeyEvent& ev) {
+    return ev.type == KeyEventType::Down && pressed.Test(ev.vkCode);
+}
+
+// Adds src's delta to dst if both are the same motion / wheel type and the sum fits in 16 bits.
+// dst keeps its timestamps, so latency is measured from the oldest motion it contains.
+inline bool AccumulateMotion(KeyEvent& dst, const KeyEvent& src) {
+    if (!IsAccumulating(src) || dst.type != src.type) return false;
+    int32_t dx = (int32_t)dst.dx + src.dx;
+    int32_t dy = (int32_t)dst.dy + src.dy;
+    if (dx < INT16_MIN || dx > INT16_MAX || dy < INT16_MIN || dy > INT16_MAX) return false;
+    dst.dx = (int16_t)dx;
+    dst.dy = (int16_t)dy;
+    return true;
+}
+
+// Removes every key-down that is followed, in the same array, by the key-up of the same key,
+// together with that key-up. A key that gets several downs before its up is left alone, so a
+// partially removed sequence can never leave the key held. Macro events (KeyEvent::macro) are the
+// output the user asked for, so they are kept, and no pair is formed across one of the same key.
+// Order of the remaining events is kept. Returns the new count; removed pairs are added to stats
+// if given.
+inline size_t CoalesceTaps(KeyEvent* events, size_t count, FilterStats* stats) {
+    const int32_t NONE = -1;
+    const int32_t BLOCKED = -2; // repeated down seen, don't coalesce until the next up
+    int32_t pendingDown[256];
+    for (int32_t& p : pendingDown) p = NONE;
+
+    // pass 1: mark removed key events with vkCode 0 (never a real virtual-key code)
+    size_t pairs = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t vk = events[i].vkCode;
+        if (vk == 0 || !IsKeyTransition(events[i])) continue;
+        if (events[i].macro) {
+            pendingDown[vk] = NONE;
+            continue;
+        }
+        if (events[i].type == KeyEventType::Down) {
+            pendingDown[vk] = (pendingDown[vk] == NONE) ? (int32_t)i : BLOCKED;
+        } else {
+            if (pendingDown[vk] >= 0) {
+                events[pendingDown[vk]].vkCode = 0;
+                events[i].vkCode = 0;
+                pairs++;
+            }
+            pendingDown[vk] = NONE;
+        }
+    }
+    if (pairs == 0) return count;
+
+    // pass 2: compact
+    size_t out = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (events[i].vkCode != 0 || !IsKeyTransition(events[i])) events[out++] = events[i];
+    }
+    if (stats) stats->tapsCoalesced.fetch_add(pairs, std::memory_order_relaxed);
+    return out;
+}
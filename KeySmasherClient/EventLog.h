@@ -0,0 +1,133 @@
+#pragma once
+
+// Fixed-capacity, allocation-free event log for notices from any thread (hook, worker, UI).
+// Portable (no windows.h).
+//
+// Post() never blocks: it is a rate-limit check plus a slot claim in a bounded multi-producer
+// ring (lock-free; a producer only retries when another one claimed the same slot first). Each
+// code is limited to one entry per interval, so a condition that repeats on every key press
+// costs one entry per interval. When the ring is full the new entry is dropped and counted.
+// A single consumer (the log writer thread) drains it with Take(), writes the file and turns
+// Alert entries into tray notifications.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum class LogLevel : uint8_t {
+    Info,
+    Warning,
+    Alert,  // also shown to the user as a tray notification
+};
+
+enum class LogCode : uint8_t {
+    NoConnection,    // a key was captured while no connection is open
+    Connected,
+    ConnectionLost,
+    ConnectFailed,
+    QueueOverflow,   // the capture queue dropped events
+    ConfigReloaded,
+    ConfigWarning,   // a reloaded entry was ignored or needs a restart
+    Count,
+};
+
+const size_t LOG_TEXT_LEN = 120;
+
+struct LogEntry {
+    int64_t timeNs = 0;
+    LogLevel level = LogLevel::Info;
+    LogCode code = LogCode::Count;
+    char text[LOG_TEXT_LEN] = {};
+};
+
+inline const char* LogLevelName(LogLevel level) {
+    return level == LogLevel::Alert ? "ALERT" : level == LogLevel::Warning ? "WARN" : "INFO";
+}
+
+template <size_t Capacity>
+class EventLog {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    EventLog() {
+        for (size_t i = 0; i < Capacity; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+        for (auto& t : lastPostNs_) t.store(INT64_MIN, std::memory_order_relaxed);
+        for (auto& i : minIntervalNs_) i = 0;
+    }
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    // Not thread-safe; configure before any producer starts. Codes without a limit (0) are never
+    // suppressed, whatever the order their posts' timestamps arrive in.
+    void SetRateLimit(LogCode code, int64_t minIntervalNs) { minIntervalNs_[(size_t)code] = minIntervalNs; }
+
+    // Any thread. Returns false if the entry was rate-limited or the ring is full.
+    // text is truncated to LOG_TEXT_LEN - 1 characters.
+    bool Post(int64_t nowNs, LogLevel level, LogCode code, const char* text) {
+        size_t c = (size_t)code;
+        if (minIntervalNs_[c] > 0) {
+            int64_t last = lastPostNs_[c].load(std::memory_order_relaxed);
+            if ((last != INT64_MIN && nowNs - last < minIntervalNs_[c])
+                || !lastPostNs_[c].compare_exchange_strong(last, nowNs, std::memory_order_relaxed)) {
+                suppressed_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots_[pos & kMask];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+
+        LogEntry& e = slot->entry;
+        e.timeNs = nowNs;
+        e.level = level;
+        e.code = code;
+        size_t n = 0;
+        for (; text[n] && n < LOG_TEXT_LEN - 1; ++n) e.text[n] = text[n];
+        e.text[n] = '\0';
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if no complete entry is waiting.
+    bool Take(LogEntry* out) {
+        Slot& slot = slots_[tail_ & kMask];
+        if (slot.seq.load(std::memory_order_acquire) != tail_ + 1) return false;
+        *out = slot.entry;
+        slot.seq.store(tail_ + Capacity, std::memory_order_release);
+        tail_++;
+        return true;
+    }
+
+    uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t Suppressed() const { return suppressed_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kMask = Capacity - 1;
+
+    struct Slot {
+        std::atomic<size_t> seq{ 0 };
+        LogEntry entry;
+    };
+
+    Slot slots_[Capacity];
+    std::atomic<size_t> head_{ 0 };
+    size_t tail_ = 0; // consumer-owned
+    std::atomic<int64_t> lastPostNs_[(size_t)LogCode::Count];
+    int64_t minIntervalNs_[(size_t)LogCode::Count];
+    std::atomic<uint64_t> dropped_{ 0 };
+    std::atomic<uint64_t> suppressed_{ 0 };
+};
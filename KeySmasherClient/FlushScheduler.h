@@ -0,0 +1,61 @@
+#pragma once
+
+// Decides when the send pipeline flushes its queued events into a frame. Portable (no windows.h).
+//
+// Nagle-style micro-batching bounded by a latency budget:
+// - an event that arrives while nothing is in flight goes out immediately, so a key press on an
+//   idle connection never waits for company;
+// - a transport only takes one frame at a time, so while a send is in flight events queue up.
+//   When it completes they go out together, unless the oldest has waited for less than the
+//   budget: then the partial frame is held until it has (or a full frame has built up), so a
+//   burst on a fast link still fills frames instead of sending one per completion.
+// The budget is fixed, or adapts to half the smoothed send latency (capped by the configured
+// budget): on a fast link frames are cheap and batching buys little, on a slow link a frame
+// occupies it long enough that waiting a fraction of that for more events pays off.
+
+#include <cstddef>
+#include <cstdint>
+
+struct FlushPolicy {
+    uint32_t budgetUs = 0;   // max delay added for batching; 0 = always flush immediately
+    bool adaptive = true;    // scale the budget with the measured send latency
+};
+
+class FlushScheduler {
+public:
+    // Feeds the latency of a completed send (send started -> write complete)
+    void OnSendComplete(int64_t sendNs) {
+        int64_t us = sendNs / 1000;
+        if (us < 0) us = 0;
+        if (samples_ == 0) srttUs_ = us;
+        else srttUs_ += (us - srttUs_) / 8;
+        samples_++;
+    }
+
+    int64_t SmoothedSendUs() const { return srttUs_; }
+
+    uint32_t BudgetUs(const FlushPolicy& policy) const {
+        if (!policy.adaptive || samples_ == 0) return policy.budgetUs;
+        int64_t adaptive = srttUs_ / 2;
+        return adaptive < (int64_t)policy.budgetUs ? (uint32_t)adaptive : policy.budgetUs;
+    }
+
+    // Called when the transport can take a frame and `pending` events are queued, the oldest of
+    // which entered the pipeline at oldestNs (0 for synthesized events, which are always urgent);
+    // the previous send completed at lastCompleteNs. Returns true to flush now; otherwise
+    // *flushAtNs is when the held frame is due.
+    bool ShouldFlush(const FlushPolicy& policy, int64_t nowNs, int64_t oldestNs, size_t pending, size_t frameEvents,
+        int64_t lastCompleteNs, int64_t* flushAtNs) const {
+        int64_t budgetNs = (int64_t)BudgetUs(policy) * 1000;
+        if (budgetNs == 0 || pending >= frameEvents || oldestNs == 0) return true;
+        if (oldestNs >= lastCompleteNs) return true; // arrived while nothing was in flight
+        int64_t deadline = oldestNs + budgetNs;
+        if (nowNs >= deadline) return true;
+        if (flushAtNs) *flushAtNs = deadline;
+        return false;
+    }
+
+private:
+    int64_t srttUs_ = 0;
+    uint64_t samples_ = 0;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+// Event-driven tracking of whether the target (e.g. Parsec) window has the focus.
+//
+// The platform layer (SetWinEventHook on Windows, a test driver elsewhere) reports every
+// foreground change through OnForegroundChanged(); the matcher is evaluated there, once per
+// change, and the result is published atomically. The keyboard hook then only needs
+// TargetActive(), a single atomic load. Portable (no windows.h).
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+typedef void* WindowHandle;
+
+// What the platform layer knows about a window when it becomes the foreground.
+// className and processName may be left empty when the matcher doesn't use them.
+struct WindowInfo {
+    std::wstring title;
+    std::wstring className;
+    std::wstring processName; // executable file name, e.g. "parsecd.exe"
+};
+
+class IWindowMatcher {
+public:
+    virtual ~IWindowMatcher() {}
+    virtual bool Matches(const WindowInfo& info) const = 0;
+};
+
+// Matches windows whose title starts with a fixed prefix (the original TARGET_TITLE rule).
+class TitlePrefixMatcher : public IWindowMatcher {
+public:
+    explicit TitlePrefixMatcher(const std::wstring& prefix) : prefix_(prefix) {}
+
+    bool Matches(const WindowInfo& info) const override {
+        return info.title.size() >= prefix_.size() && info.title.compare(0, prefix_.size(), prefix_) == 0;
+    }
+
+private:
+    std::wstring prefix_;
+};
+
+class FocusTracker {
+public:
+    explicit FocusTracker(const IWindowMatcher* matcher) : matcher_(matcher) {}
+
+    FocusTracker(const FocusTracker&) = delete;
+    FocusTracker& operator=(const FocusTracker&) = delete;
+
+    // Called by the platform layer whenever the foreground window changes (hwnd may be null),
+    // or the current foreground window's title changes. Returns true if TargetActive() flipped.
+    // Must be called from one thread at a time.
+    bool OnForegroundChanged(WindowHandle hwnd, const WindowInfo& info) {
+        return SetForeground(hwnd, hwnd != nullptr && matcher_ != nullptr && matcher_->Matches(info));
+    }
+
+    // Same as OnForegroundChanged() for callers that already know the match result (e.g. from a cache).
+    bool SetForeground(WindowHandle hwnd, bool active) {
+        foreground_.store(hwnd, std::memory_order_relaxed);
+        target_.store(active ? hwnd : nullptr, std::memory_order_relaxed);
+        bool prev = active_.exchange(active, std::memory_order_acq_rel);
+        if (prev != active) transitions_.fetch_add(1, std::memory_order_relaxed);
+        return prev != active;
+    }
+
+    // Hot path: is the target window currently in the foreground?
+    bool TargetActive() const { return active_.load(std::memory_order_acquire); }
+
+    // The matched foreground window, or null if the target is not active
+    WindowHandle TargetWindow() const { return target_.load(std::memory_order_relaxed); }
+    WindowHandle ForegroundWindow() const { return foreground_.load(std::memory_order_relaxed); }
+
+    uint64_t Transitions() const { return transitions_.load(std::memory_order_relaxed); }
+
+private:
+    const IWindowMatcher* matcher_;
+    std::atomic<bool> active_{ false };
+    std::atomic<WindowHandle> target_{ nullptr };
+    std::atomic<WindowHandle> foreground_{ nullptr };
+    std::atomic<uint64_t> transitions_{ 0 };
+};
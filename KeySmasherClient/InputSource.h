@@ -0,0 +1,80 @@
+#pragma once
+
+// Synthetic key and mouse input for load-testing the capture -> queue -> send pipeline without a keyboard.
+// Portable (no windows.h): the caller supplies the clock and pushes the events wherever the real
+// hook would, so the same generator can drive the pipeline on Windows or in a standalone harness.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "KeyEvent.h"
+
+// Produces a steady stream of alternating key-down / key-up pairs at a fixed rate.
+// Keys rotate through 'A'..'Z', so the generator never holds more than one key down.
+class SyntheticKeySource {
+public:
+    SyntheticKeySource(uint32_t eventsPerSecond, int64_t startNs)
+        : rate_(eventsPerSecond), startNs_(startNs) {}
+
+    // Number of events that should have been emitted by nowNs but weren't yet.
+    // Callers that fall behind (e.g. coarse sleeps) catch up in a burst.
+    uint64_t Due(int64_t nowNs) const {
+        if (nowNs <= startNs_ || rate_ == 0) return 0;
+        uint64_t target = (uint64_t)(nowNs - startNs_) * rate_ / 1000000000ull;
+        return target > emitted_ ? target - emitted_ : 0;
+    }
+
+    KeyEvent Next(int64_t nowNs) {
+        KeyEvent ev;
+        bool down = (emitted_ % 2) == 0;
+        uint8_t vk = (uint8_t)('A' + (emitted_ / 2) % 26);
+        ev.time = (uint32_t)(nowNs / 1000000); // milliseconds, like KBDLLHOOKSTRUCT::time
+        ev.vkCode = vk;
+        ev.scanCode = 0;
+        ev.type = down ? KeyEventType::Down : KeyEventType::Up;
+        ev.hookNs = nowNs;
+        ev.stageNs = nowNs;
+        emitted_++;
+        return ev;
+    }
+
+    uint64_t Emitted() const { return emitted_; }
+
+private:
+    uint64_t rate_;
+    int64_t startNs_;
+    uint64_t emitted_ = 0;
+};
+
+// Produces mouse motion at a fixed rate (e.g. 1000/s like a 1 kHz mouse), moving back and
+// forth along x so the accumulated motion stays bounded.
+class SyntheticMouseSource {
+public:
+    SyntheticMouseSource(uint32_t movesPerSecond, int64_t startNs)
+        : rate_(movesPerSecond), startNs_(startNs) {}
+
+    uint64_t Due(int64_t nowNs) const {
+        if (nowNs <= startNs_ || rate_ == 0) return 0;
+        uint64_t target = (uint64_t)(nowNs - startNs_) * rate_ / 1000000000ull;
+        return target > emitted_ ? target - emitted_ : 0;
+    }
+
+    KeyEvent Next(int64_t nowNs) {
+        KeyEvent ev;
+        ev.time = (uint32_t)(nowNs / 1000000);
+        ev.type = KeyEventType::MouseMove;
+        ev.dx = ((emitted_ / 100) % 2) == 0 ? 1 : -1;
+        ev.dy = 0;
+        ev.hookNs = nowNs;
+        ev.stageNs = nowNs;
+        emitted_++;
+        return ev;
+    }
+
+    uint64_t Emitted() const { return emitted_; }
+
+private:
+    uint64_t rate_;
+    int64_t startNs_;
+    uint64_t emitted_ = 0;
+};
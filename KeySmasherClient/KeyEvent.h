@@ -0,0 +1,46 @@
+#pragma once
+
+// Portable event model shared by the hook, the send queue and the encoders.
+// Must not include <windows.h> so it can be built on any platform.
+
+#include <cstdint>
+#include <type_traits>
+
+enum class KeyEventType : uint8_t {
+    Down = 0,
+    Up = 1,
+    MouseMove = 2,    // relative motion in dx/dy
+    MouseWheel = 3,   // vertical wheel, delta in dx (WHEEL_DELTA = 120 per notch)
+    MouseHWheel = 4,  // horizontal wheel, delta in dx
+};
+
+// Fixed-size record of a single input event as seen by the low-level hooks.
+// Key and mouse button transitions are Down/Up with a virtual-key code (mouse buttons use
+// VK_LBUTTON etc.), so key state, release-all and resync treat them alike.
+// Trivially copyable so it can be passed through SpscRing without allocation.
+struct KeyEvent {
+    uint32_t time = 0;      // KBDLLHOOKSTRUCT/MSLLHOOKSTRUCT::time (milliseconds, wraps)
+    uint16_t scanCode = 0;  // KBDLLHOOKSTRUCT::scanCode
+    uint8_t vkCode = 0;     // virtual-key code (1..254), 0 for motion and wheel
+    KeyEventType type = KeyEventType::Down;
+    uint8_t flags = 0;      // KBDLLHOOKSTRUCT::flags (LLKHF_*) / MSLLHOOKSTRUCT::flags (LLMHF_*)
+    bool macro = false;     // played by a remap macro: sent as is, never coalesced (not on the wire)
+    int16_t dx = 0;         // MouseMove: x motion, MouseWheel/MouseHWheel: wheel delta
+    int16_t dy = 0;         // MouseMove: y motion
+
+    // latency instrumentation (MonotonicNs() clock, 0 for synthesized events)
+    int64_t hookNs = 0;     // hook entry
+    int64_t stageNs = 0;    // when the event entered its current pipeline stage
+};
+
+// Key or mouse button transition (as opposed to motion / wheel)
+inline bool IsKeyTransition(const KeyEvent& ev) {
+    return ev.type == KeyEventType::Down || ev.type == KeyEventType::Up;
+}
+
+// Motion and wheel events are relative, so consecutive ones of the same type can be summed
+inline bool IsAccumulating(const KeyEvent& ev) {
+    return ev.type == KeyEventType::MouseMove || ev.type == KeyEventType::MouseWheel || ev.type == KeyEventType::MouseHWheel;
+}
+
+static_assert(std::is_trivially_copyable<KeyEvent>::value, "KeyEvent must be trivially copyable");
@@ -0,0 +1,371 @@
+#pragma once
+
+// Key remapping and chord macros applied in the capture path. Portable (no windows.h).
+//
+// Rule syntax (one per entry of the active profile's section, [Remap.<profile>]):
+//   CapsLock -> LCtrl             the key is sent as another key
+//   ScrollLock -> None            the key is not sent at all
+//   LCtrl+Q -> LAlt+F4            chord: while LCtrl is held, Q plays the macro instead
+//   LCtrl+W -> None               chord that sends nothing
+//   F13 -> H E L L O              a single key can trigger a macro too
+// A macro is a list of steps separated by spaces; a step is a key or a combo ("LAlt+F4": pressed
+// left to right, released right to left). Chords list up to four keys; the last one triggers and
+// the others must already be held. Keys are names (A-Z, 0-9, F1-F24, LCtrl, Enter, ...; see
+// KeyNameToVk) or virtual-key codes in hex ("0x5B"). Chords match the physical keys, before remapping.
+//
+// KeyRemapTable is compiled from the rules and never changes afterwards (it lives in the config
+// snapshot). KeyRemapper is the hook's state: which physical keys are down and which key each one
+// was sent as, so a key-up always releases what its key-down pressed, even if the profile changed
+// in between, and how many physical keys hold each sent key (counting only key-downs that were
+// sent), so two keys remapped onto one don't release it early. Macro output is marked
+// KeyEvent::macro, so tap coalescing leaves it alone. Per event the hook does a table lookup and, for chord triggers, a check of the
+// few chords on that key; nothing allocates.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cwctype>
+#include <string>
+
+#include "KeyEvent.h"
+#include "KeyState.h"
+#include "WireFormat.h"
+
+// True for keys the hook reports with LLKHF_EXTENDED (right-hand modifiers, the navigation block,
+// Windows keys, NumLock, PrintScreen, numpad divide), so a key sent in place of another carries it
+inline bool IsExtendedKey(uint8_t vk) {
+    switch (vk) {
+    case 0xA3: case 0xA5:                                       // RCtrl, RAlt
+    case 0x25: case 0x26: case 0x27: case 0x28:                 // arrows
+    case 0x2D: case 0x2E: case 0x24: case 0x23: case 0x21: case 0x22: // Insert ... PageDown
+    case 0x5B: case 0x5C: case 0x5D:                            // LWin, RWin, Apps
+    case 0x90: case 0x2C: case 0x6F:                            // NumLock, PrintScreen, Divide
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Virtual-key code for a key name (case-insensitive), 0 if unknown. Generic modifier names are the
+// left-hand keys, which is what the low-level hook reports.
+inline uint8_t KeyNameToVk(const std::wstring& name) {
+    std::wstring n;
+    for (wchar_t c : name) n.push_back((wchar_t)std::towlower(c));
+    if (n.size() == 1 && ((n[0] >= L'a' && n[0] <= L'z') || (n[0] >= L'0' && n[0] <= L'9'))) return (uint8_t)std::towupper(n[0]);
+    if (n.size() >= 2 && n.size() <= 3 && n[0] == L'f' && n[1] >= L'1' && n[1] <= L'9') {
+        int f = n[1] - L'0';
+        if (n.size() == 3) f = (n[2] >= L'0' && n[2] <= L'9') ? f * 10 + (n[2] - L'0') : 0;
+        if (f >= 1 && f <= 24) return (uint8_t)(0x70 + f - 1);
+        return 0;
+    }
+    if (n.size() > 2 && n[0] == L'0' && n[1] == L'x') {
+        unsigned v = 0;
+        for (size_t i = 2; i < n.size(); ++i) {
+            wchar_t c = n[i];
+            unsigned d = (c >= L'0' && c <= L'9') ? c - L'0' : (c >= L'a' && c <= L'f') ? c - L'a' + 10 : 16;
+            if (d == 16 || v > 0xF) return 0;
+            v = v * 16 + d;
+        }
+        return v >= 1 && v <= 254 ? (uint8_t)v : 0;
+    }
+    static const struct { const wchar_t* name; uint8_t vk; } NAMES[] = {
+        { L"backspace", 0x08 }, { L"tab", 0x09 }, { L"enter", 0x0D }, { L"pause", 0x13 }, { L"capslock", 0x14 },
+        { L"esc", 0x1B }, { L"escape", 0x1B }, { L"space", 0x20 }, { L"pageup", 0x21 }, { L"pagedown", 0x22 },
+        { L"end", 0x23 }, { L"home", 0x24 }, { L"left", 0x25 }, { L"up", 0x26 }, { L"right", 0x27 }, { L"down", 0x28 },
+        { L"printscreen", 0x2C }, { L"insert", 0x2D }, { L"delete", 0x2E },
+        { L"lwin", 0x5B }, { L"rwin", 0x5C }, { L"apps", 0x5D },
+        { L"numpad0", 0x60 }, { L"numpad1", 0x61 }, { L"numpad2", 0x62 }, { L"numpad3", 0x63 }, { L"numpad4", 0x64 },
+        { L"numpad5", 0x65 }, { L"numpad6", 0x66 }, { L"numpad7", 0x67 }, { L"numpad8", 0x68 }, { L"numpad9", 0x69 },
+        { L"numlock", 0x90 }, { L"scrolllock", 0x91 },
+        { L"shift", 0xA0 }, { L"lshift", 0xA0 }, { L"rshift", 0xA1 },
+        { L"ctrl", 0xA2 }, { L"lctrl", 0xA2 }, { L"rctrl", 0xA3 },
+        { L"alt", 0xA4 }, { L"lalt", 0xA4 }, { L"ralt", 0xA5 },
+    };
+    for (const auto& k : NAMES) {
+        if (n == k.name) return k.vk;
+    }
+    return 0;
+}
+
+struct RemapStats {
+    std::atomic<uint64_t> remapped{ 0 };     // key events sent as another key (or not at all)
+    std::atomic<uint64_t> macrosPlayed{ 0 };
+};
+
+class KeyRemapTable {
+public:
+    static const size_t MAX_CHORDS = 32;
+    static const size_t MAX_CHORD_KEYS = 4;     // including the trigger
+    static const size_t MAX_MACRO_EVENTS = 32;  // per macro (a tap is two events)
+    static const size_t MACRO_POOL = 512;       // events of all macros together
+    static const uint8_t NO_CHORD = 0xFF;
+
+    KeyRemapTable() {
+        for (int vk = 0; vk < 256; ++vk) {
+            map_[vk] = (uint8_t)vk;
+            firstChord_[vk] = NO_CHORD;
+        }
+    }
+
+    // Parses and compiles one rule. Returns false (with a message in *error) if it is invalid.
+    bool AddRule(const std::wstring& spec, std::wstring* error) {
+        size_t arrow = spec.find(L"->");
+        if (arrow == std::wstring::npos) return Fail(error, L"missing '->' in remap rule '" + spec + L"'");
+
+        uint8_t from[MAX_CHORD_KEYS];
+        size_t fromCount = 0;
+        std::wstring lhs = Trim(spec.substr(0, arrow));
+        if (!ParseCombo(lhs, from, MAX_CHORD_KEYS, &fromCount)) return Fail(error, L"invalid keys '" + lhs + L"' in remap rule '" + spec + L"'");
+
+        std::wstring rhs = Trim(spec.substr(arrow + 2));
+        bool none = Lower(rhs) == L"none";
+        if (fromCount == 1 && none) {
+            map_[from[0]] = 0;
+            ruleCount_++;
+            return true;
+        }
+
+        // the macro's events go straight into the pool; they are dropped again if the rule is invalid
+        size_t start = macroCount_;
+        size_t steps = 0;
+        uint8_t single = 0;
+        for (size_t pos = 0; !none && pos < rhs.size();) {
+            size_t end = rhs.find(L' ', pos);
+            if (end == std::wstring::npos) end = rhs.size();
+            std::wstring step = rhs.substr(pos, end - pos);
+            pos = end + 1;
+            if (step.empty()) continue;
+
+            uint8_t keys[MAX_CHORD_KEYS];
+            size_t count = 0;
+            if (!ParseCombo(step, keys, MAX_CHORD_KEYS, &count)) {
+                macroCount_ = start;
+                return Fail(error, L"invalid keys '" + step + L"' in remap rule '" + spec + L"'");
+            }
+            if (macroCount_ - start + 2 * count > MAX_MACRO_EVENTS || macroCount_ + 2 * count > MACRO_POOL) {
+                macroCount_ = start;
+                return Fail(error, L"macro too long in remap rule '" + spec + L"'");
+            }
+            for (size_t i = 0; i < count; ++i) macro_[macroCount_++] = MacroEvent{ keys[i], true };
+            for (size_t i = count; i-- > 0;) macro_[macroCount_++] = MacroEvent{ keys[i], false };
+            single = keys[0];
+            steps += count;
+        }
+        if (steps == 0 && !none) return Fail(error, L"nothing to send in remap rule '" + spec + L"'");
+
+        // one key onto one key is a plain remap, everything else a chord
+        if (fromCount == 1 && steps == 1) {
+            macroCount_ = start;
+            map_[from[0]] = single;
+            ruleCount_++;
+            return true;
+        }
+        if (chordCount_ == MAX_CHORDS) {
+            macroCount_ = start;
+            return Fail(error, L"too many chords, remap rule '" + spec + L"' ignored");
+        }
+
+        Chord& c = chords_[chordCount_];
+        c.trigger = from[fromCount - 1];
+        c.heldCount = (uint8_t)(fromCount - 1);
+        for (size_t i = 0; i + 1 < fromCount; ++i) c.held[i] = from[i];
+        c.macroStart = (uint16_t)start;
+        c.macroLength = (uint8_t)(macroCount_ - start);
+        // chords with more keys first, so Ctrl+Shift+Q wins over Ctrl+Q
+        uint8_t* link = &firstChord_[c.trigger];
+        while (*link != NO_CHORD && chords_[*link].heldCount >= c.heldCount) link = &chords_[*link].next;
+        c.next = *link;
+        *link = (uint8_t)chordCount_;
+        chordCount_++;
+        ruleCount_++;
+        return true;
+    }
+
+    // Lets the platform layer supply scan codes for the keys that are sent in place of others
+    template <typename ScanCodeOf>
+    void ResolveScanCodes(ScanCodeOf scanCodeOf) {
+        for (int vk = 1; vk < 255; ++vk) scan_[vk] = (uint16_t)scanCodeOf((uint8_t)vk);
+    }
+
+    size_t RuleCount() const { return ruleCount_; }
+    bool Empty() const { return ruleCount_ == 0; }
+
+private:
+    friend class KeyRemapper;
+
+    struct MacroEvent {
+        uint8_t vk;
+        bool down;
+    };
+
+    struct Chord {
+        uint8_t trigger = 0;
+        uint8_t held[MAX_CHORD_KEYS - 1] = {};
+        uint8_t heldCount = 0;
+        uint16_t macroStart = 0;
+        uint8_t macroLength = 0;
+        uint8_t next = NO_CHORD; // next chord with the same trigger
+    };
+
+    static bool Fail(std::wstring* error, const std::wstring& message) {
+        if (error) *error = message;
+        return false;
+    }
+
+    static std::wstring Trim(const std::wstring& s) {
+        size_t b = s.find_first_not_of(L" \t");
+        if (b == std::wstring::npos) return std::wstring();
+        return s.substr(b, s.find_last_not_of(L" \t") - b + 1);
+    }
+
+    static std::wstring Lower(std::wstring s) {
+        for (wchar_t& c : s) c = (wchar_t)std::towlower(c);
+        return s;
+    }
+
+    // "LCtrl+Shift+Q" -> key codes in order
+    static bool ParseCombo(const std::wstring& combo, uint8_t* out, size_t cap, size_t* count) {
+        *count = 0;
+        for (size_t pos = 0; pos <= combo.size();) {
+            size_t end = combo.find(L'+', pos);
+            if (end == std::wstring::npos) end = combo.size();
+            uint8_t vk = KeyNameToVk(Trim(combo.substr(pos, end - pos)));
+            if (vk == 0 || *count == cap) return false;
+            out[(*count)++] = vk;
+            pos = end + 1;
+        }
+        return *count > 0;
+    }
+
+    uint8_t map_[256];          // physical key -> key sent (0 = not sent)
+    uint16_t scan_[256] = {};   // scan codes for keys sent in place of others
+    uint8_t firstChord_[256];   // chords triggered by the key, most specific first
+    Chord chords_[MAX_CHORDS];
+    size_t chordCount_ = 0;
+    MacroEvent macro_[MACRO_POOL];
+    size_t macroCount_ = 0;
+    size_t ruleCount_ = 0;
+};
+
+class KeyRemapper {
+public:
+    // most events one input event can turn into: a macro plus releasing and re-pressing the chord keys
+    static const size_t MAX_OUTPUT = KeyRemapTable::MAX_MACRO_EVENTS + 2 * (KeyRemapTable::MAX_CHORD_KEYS - 1);
+
+    // Turns one captured key event into the events to send (at most MAX_OUTPUT, in order). With
+    // emit false (target not focused, paused) the state is tracked but nothing is produced.
+    size_t Process(const KeyRemapTable& table, const KeyEvent& in, bool emit, KeyEvent* out, RemapStats* stats) {
+        if (!IsKeyTransition(in)) {
+            if (!emit) return 0;
+            out[0] = in;
+            return 1;
+        }
+        uint8_t vk = in.vkCode;
+        size_t n = 0;
+
+        if (in.type == KeyEventType::Down) {
+            if (physical_.Test(vk)) {
+                // auto-repeat: repeats what the first key-down sent (the capture filter drops it or not)
+                if (swallowed_.Test(vk) || sent_[vk] == 0 || !emit) return 0;
+                if (!holding_.Test(vk)) {
+                    // first key-down sent for this press (it started while nothing was emitted)
+                    Set(holding_, vk);
+                    holders_[sent_[vk]]++;
+                }
+                Emit(table, in, sent_[vk], true, out, &n);
+                return n;
+            }
+            Set(physical_, vk);
+
+            for (uint8_t i = table.firstChord_[vk]; i != KeyRemapTable::NO_CHORD; i = table.chords_[i].next) {
+                const KeyRemapTable::Chord& c = table.chords_[i];
+                if (!ChordHeld(c)) continue;
+                Set(swallowed_, vk);
+                sent_[vk] = 0;
+                if (!emit || c.macroLength == 0) return 0;
+                // the chord's other keys are up while the macro plays, so "LCtrl+Q -> LAlt+F4" sends Alt+F4 alone
+                for (size_t k = 0; k < c.heldCount; ++k) {
+                    uint8_t held = sent_[c.held[k]];
+                    if (held) Emit(table, in, held, false, out, &n);
+                }
+                for (size_t m = 0; m < c.macroLength; ++m) {
+                    const auto& e = table.macro_[c.macroStart + m];
+                    Emit(table, in, e.vk, e.down, out, &n);
+                }
+                for (size_t k = 0; k < c.heldCount; ++k) {
+                    uint8_t held = sent_[c.held[k]];
+                    if (held) Emit(table, in, held, true, out, &n);
+                }
+                for (size_t k = 0; k < n; ++k) out[k].macro = true;
+                if (stats) stats->macrosPlayed.fetch_add(1, std::memory_order_relaxed);
+                return n;
+            }
+
+            uint8_t target = table.map_[vk];
+            sent_[vk] = target;
+            if (target != vk && stats) stats->remapped.fetch_add(1, std::memory_order_relaxed);
+            if (target == 0) return 0;
+            // another physical key may already hold the target down; a key-down that isn't sent
+            // doesn't hold anything
+            if (!emit) return 0;
+            Set(holding_, vk);
+            if (holders_[target]++ == 0) Emit(table, in, target, true, out, &n);
+            return n;
+        }
+
+        // key-up
+        if (!physical_.Test(vk)) {
+            // pressed before we started tracking: release what the current table would have sent
+            uint8_t target = table.map_[vk];
+            if (target != 0 && emit) Emit(table, in, target, false, out, &n);
+            return n;
+        }
+        Clear(physical_, vk);
+        if (swallowed_.Test(vk)) {
+            Clear(swallowed_, vk);
+            return 0;
+        }
+        uint8_t target = sent_[vk];
+        sent_[vk] = 0;
+        if (target != vk && stats) stats->remapped.fetch_add(1, std::memory_order_relaxed);
+        if (target == 0) return 0;
+        if (holding_.Test(vk)) {
+            Clear(holding_, vk);
+            if (--holders_[target] > 0) return 0;
+        } else if (holders_[target] > 0) {
+            return 0; // its key-down wasn't sent; other keys still hold the target
+        }
+        if (emit) Emit(table, in, target, false, out, &n);
+        return n;
+    }
+
+private:
+    bool ChordHeld(const KeyRemapTable::Chord& c) const {
+        for (size_t k = 0; k < c.heldCount; ++k) {
+            if (!physical_.Test(c.held[k])) return false;
+        }
+        return true;
+    }
+
+    static void Set(KeySnapshot& s, uint8_t vk) { s.words[vk >> 6] |= 1ull << (vk & 63); }
+    static void Clear(KeySnapshot& s, uint8_t vk) { s.words[vk >> 6] &= ~(1ull << (vk & 63)); }
+
+    static void Emit(const KeyRemapTable& table, const KeyEvent& in, uint8_t vk, bool down, KeyEvent* out, size_t* n) {
+        KeyEvent& ev = out[(*n)++];
+        ev = in;
+        ev.type = down ? KeyEventType::Down : KeyEventType::Up;
+        if (vk != in.vkCode) {
+            ev.vkCode = vk;
+            ev.scanCode = table.scan_[vk];
+            ev.flags = (uint8_t)((down ? 0 : KEY_FLAG_UP) | (IsExtendedKey(vk) ? KEY_FLAG_EXTENDED : 0));
+        } else if (down != (in.type == KeyEventType::Down)) {
+            ev.flags = (uint8_t)(down ? (in.flags & ~KEY_FLAG_UP) : (in.flags | KEY_FLAG_UP));
+        }
+    }
+
+    KeySnapshot physical_;   // physical keys down
+    KeySnapshot swallowed_;  // chord triggers whose key-up must not be sent
+    uint8_t sent_[256] = {}; // physical key -> key its key-down was sent as
+    KeySnapshot holding_;    // physical keys whose key-down was sent and counted in holders_
+    uint8_t holders_[256] = {}; // sent key -> physical keys holding it down
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+// Lock-free pressed-key state: one bit per virtual-key code, 256 bits in four atomic words.
+// Portable (no windows.h).
+//
+// The input thread sets and clears bits as it enqueues events; other threads read snapshots
+// or take the whole state at once (release all). Set/Clear are a single atomic RMW each and
+// never block, so the hook never waits on a thread that is building a release.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+#include "KeyEvent.h"
+
+// Index of the lowest set bit; w must not be 0
+inline unsigned LowestSetBit(uint64_t w) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long idx;
+    _BitScanForward64(&idx, w);
+    return (unsigned)idx;
+#elif defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(w);
+#else
+    unsigned idx = 0;
+    while (!(w & 1)) { w >>= 1; idx++; }
+    return idx;
+#endif
+}
+
+// Plain copy of the key bits
+struct KeySnapshot {
+    uint64_t words[4] = {};
+
+    bool Test(uint8_t vk) const { return (words[vk >> 6] >> (vk & 63)) & 1; }
+    bool Any() const { return (words[0] | words[1] | words[2] | words[3]) != 0; }
+
+    size_t Count() const {
+        size_t n = 0;
+        for (uint64_t w : words) {
+            for (; w; w &= w - 1) n++;
+        }
+        return n;
+    }
+
+    // Writes one event of the given type per set bit, in ascending key order, without
+    // touching clear words. Returns the number written (at most cap).
+    size_t ToEvents(KeyEventType type, uint32_t time, KeyEvent* out, size_t cap) const {
+        size_t n = 0;
+        for (unsigned i = 0; i < 4; ++i) {
+            for (uint64_t w = words[i]; w && n < cap; w &= w - 1) {
+                KeyEvent& ev = out[n++];
+                ev = KeyEvent();
+                ev.time = time;
+                ev.vkCode = (uint8_t)(i * 64 + LowestSetBit(w));
+                ev.type = type;
+            }
+        }
+        return n;
+    }
+};
+
+class KeyStateBitset {
+public:
+    void Set(uint8_t vk) { words_[vk >> 6].fetch_or(Bit(vk), std::memory_order_acq_rel); }
+    void Clear(uint8_t vk) { words_[vk >> 6].fetch_and(~Bit(vk), std::memory_order_acq_rel); }
+
+    void Apply(const KeyEvent& ev) {
+        if (ev.type == KeyEventType::Down) Set(ev.vkCode);
+        else if (ev.type == KeyEventType::Up) Clear(ev.vkCode);
+    }
+
+    bool Test(uint8_t vk) const { return (words_[vk >> 6].load(std::memory_order_acquire) & Bit(vk)) != 0; }
+
+    // Reads all four words. A concurrent writer could change a word between the loads, so the
+    // read is repeated until two passes agree (bounded; a key changing mid-read is reported
+    // in either its old or its new state, which is all a resync needs).
+    KeySnapshot Load() const {
+        KeySnapshot a = LoadOnce();
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            KeySnapshot b = LoadOnce();
+            if (Same(a, b)) break;
+            a = b;
+        }
+        return a;
+    }
+
+    // Atomically clears every word and returns what was set. Each bit is handed out exactly
+    // once: a key pressed during the call is either taken here or stays set for later.
+    KeySnapshot TakeAll() {
+        KeySnapshot s;
+        for (size_t i = 0; i < 4; ++i) s.words[i] = words_[i].exchange(0, std::memory_order_acq_rel);
+        return s;
+    }
+
+private:
+    static uint64_t Bit(uint8_t vk) { return 1ull << (vk & 63); }
+
+    KeySnapshot LoadOnce() const {
+        KeySnapshot s;
+        for (size_t i = 0; i < 4; ++i) s.words[i] = words_[i].load(std::memory_order_acquire);
+        return s;
+    }
+
+    static bool Same(const KeySnapshot& a, const KeySnapshot& b) {
+        return a.words[0] == b.words[0] && a.words[1] == b.words[1] && a.words[2] == b.words[2] && a.words[3] == b.words[3];
+    }
+
+    std::atomic<uint64_t> words_[4] = {};
+};
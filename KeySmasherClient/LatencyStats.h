@@ -0,0 +1,130 @@
+#pragma once
+
+// Latency instrumentation for the capture -> send pipeline.
+// Portable (no windows.h): timestamps come from std::chrono::steady_clock, which is
+// QueryPerformanceCounter-backed on Windows.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+inline int64_t MonotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// HDR-style log-linear histogram of microsecond values. Values below 32 us get their own
+// bucket, above that every power of two is split into 16 sub-buckets (~6% precision) up to
+// 2^32 us. Record() is a single relaxed atomic increment and may be called from any thread.
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 4;
+    static const uint32_t SUB_COUNT = 1u << SUB_BITS;
+    static const int MAX_MSB = 31;
+    static const size_t BUCKET_COUNT = (MAX_MSB - SUB_BITS + 2) * SUB_COUNT;
+
+    void Record(uint64_t us) {
+        buckets_[BucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+        uint64_t prev = max_.load(std::memory_order_relaxed);
+        while (us > prev && !max_.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    void RecordNs(int64_t ns) {
+        Record(ns > 0 ? (uint64_t)ns / 1000 : 0);
+    }
+
+    uint64_t Count() const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) total += buckets_[i].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    uint64_t Max() const { return max_.load(std::memory_order_relaxed); }
+
+    // Value at percentile p (0..100), reported as the upper bound of its bucket. 0 if empty.
+    uint64_t Percentile(double p) const {
+        uint64_t total = Count();
+        if (total == 0) return 0;
+        uint64_t rank = (uint64_t)(p / 100.0 * (double)total + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > total) rank = total;
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t upper = BucketUpperBound(i);
+                uint64_t max = Max();
+                return upper < max ? upper : max;
+            }
+        }
+        return Max();
+    }
+
+    // not atomic with respect to concurrent Record() calls; a few samples may survive a reset
+    void Reset() {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) buckets_[i].store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    static size_t BucketIndex(uint64_t v) {
+        if (v < 2 * SUB_COUNT) return (size_t)v;
+        int msb = 0;
+        for (uint64_t x = v; x > 1; x >>= 1) msb++;
+        if (msb > MAX_MSB) return BUCKET_COUNT - 1;
+        return (size_t)(msb - SUB_BITS + 1) * SUB_COUNT + (size_t)((v >> (msb - SUB_BITS)) & (SUB_COUNT - 1));
+    }
+
+    static uint64_t BucketUpperBound(size_t index) {
+        if (index < 2 * SUB_COUNT) return index;
+        int msb = (int)(index / SUB_COUNT) + SUB_BITS - 1;
+        uint64_t sub = index % SUB_COUNT;
+        uint64_t width = 1ull << (msb - SUB_BITS);
+        return (1ull << msb) + sub * width + width - 1;
+    }
+
+private:
+    std::atomic<uint32_t> buckets_[BUCKET_COUNT] = {};
+    std::atomic<uint64_t> max_{ 0 };
+};
+
+// Per-stage histograms of a key event's trip from LowLevelKeyboardProc to WinHTTP's write completion.
+struct PipelineLatency {
+    LatencyHistogram hook;   // hook entry -> enqueued in eventRing
+    LatencyHistogram queue;  // enqueued -> dequeued by WSWorker
+    LatencyHistogram batch;  // dequeued -> send started (batching, outbox and in-flight wait)
+    LatencyHistogram send;   // send started -> write complete
+    LatencyHistogram total;  // hook entry -> write complete
+
+    void Reset() {
+        hook.Reset();
+        queue.Reset();
+        batch.Reset();
+        send.Reset();
+        total.Reset();
+    }
+
+    // Writes a small plain-text table (microseconds) into out. Returns the length written.
+    size_t Format(char* out, size_t cap) const {
+        struct Row { const char* name; const LatencyHistogram* h; };
+        const Row rows[] = { { "hook", &hook }, { "queue", &queue }, { "batch", &batch }, { "send", &send }, { "total", &total } };
+
+        size_t len = 0;
+        int n = snprintf(out, cap, "%-6s %10s %8s %8s %8s %8s %8s\n", "stage", "count", "p50", "p90", "p99", "p99.9", "max");
+        if (n < 0 || (size_t)n >= cap) return 0;
+        len = (size_t)n;
+        for (const Row& r : rows) {
+            n = snprintf(out + len, cap - len, "%-6s %10llu %8llu %8llu %8llu %8llu %8llu\n", r.name,
+                (unsigned long long)r.h->Count(),
+                (unsigned long long)r.h->Percentile(50), (unsigned long long)r.h->Percentile(90),
+                (unsigned long long)r.h->Percentile(99), (unsigned long long)r.h->Percentile(99.9),
+                (unsigned long long)r.h->Max());
+            if (n < 0 || (size_t)n >= cap - len) break;
+            len += (size_t)n;
+        }
+        return len;
+    }
+};
@@ -0,0 +1,215 @@
+#include "PosixUdpEngine.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <utility>
+
+#include "LatencyStats.h"
+
+PosixUdpEngine::PosixUdpEngine(std::function<void()> wake, const UdpOptions& options)
+    : wake_(std::move(wake)), session_(options), receiveBuffer_(MAX_DATAGRAM_SIZE) {
+}
+
+PosixUdpEngine::~PosixUdpEngine() {
+    // owner must wait for Finished(); the thread has nothing left to do but return
+    stop_ = true;
+    if (thread_.joinable()) thread_.join();
+}
+
+bool PosixUdpEngine::Start(const std::string& host, uint16_t port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = TransportState::Connecting;
+    try {
+        thread_ = std::thread(&PosixUdpEngine::Run, this, host, port);
+    } catch (...) {
+        FailLocked();
+        finished_.store(true, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+TransportState PosixUdpEngine::State() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+uint8_t* PosixUdpEngine::SendBuffer(size_t* cap) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != TransportState::Open) return nullptr;
+    return session_.SendBuffer(cap);
+}
+
+bool PosixUdpEngine::CommitSend(size_t len, bool binary) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != TransportState::Open) return false;
+    size_t datagramLen = session_.EncodeFrame(len, binary, MonotonicNs());
+    if (datagramLen == 0) {
+        // too long, or not a binary v1 frame: nothing was sent, and the owner must not wait
+        // for a completion that never comes
+        FailLocked();
+        return false;
+    }
+    if (!SendLocked(datagramLen)) return false;
+
+    // nothing to wait for: the datagram is on its way (or lost, which the next one repairs)
+    lastSendCompleteNs_.store(session_.LastDatagramNs(), std::memory_order_relaxed);
+    completedSends_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool PosixUdpEngine::TakeMessage(std::string* out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return session_.TakeMessage(out);
+}
+
+void PosixUdpEngine::Close() {
+    {
+        // there is no close handshake; see UdpSession::EncodeReleaseAll
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ == TransportState::Open && !stop_.load()) {
+            for (size_t i = 0, copies = session_.ReleaseCopies(); i < copies; ++i) {
+                size_t len = session_.EncodeReleaseAll(MonotonicNs());
+                if (len == 0 || !SendLocked(len)) break;
+            }
+        }
+    }
+    Abort();
+}
+
+void PosixUdpEngine::Abort() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_.exchange(true)) return;
+    if (state_ != TransportState::Failed && state_ != TransportState::Closed) state_ = TransportState::Closing;
+    if (!thread_.joinable()) {
+        state_ = TransportState::Closed;
+        finished_.store(true, std::memory_order_release);
+    }
+}
+
+void PosixUdpEngine::Run(std::string host, uint16_t port) {
+    if (Resolve(host, port)) {
+        for (;;) {
+            int waitMs;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stop_.load() || state_ != TransportState::Open) break;
+                waitMs = MaintainLocked();
+            }
+
+            // bounded, so Close()/Abort() are noticed quickly without a wake-up pipe
+            pollfd readable = { socket_, POLLIN, 0 };
+            int ready = poll(&readable, 1, waitMs < 50 ? waitMs : 50);
+            if (ready > 0) ReceiveAll();
+            else if (ready < 0 && errno != EINTR) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                FailLocked();
+            }
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(mutex_);
+        FailLocked();
+    }
+
+    // a failed engine stays Failed until the owner has seen it and aborted
+    while (!stop_.load()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // the owner may delete the engine as soon as finished_ is set, so it is the last member touched
+    std::function<void()> wake = wake_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (socket_ >= 0) close(socket_);
+        socket_ = -1;
+        state_ = TransportState::Closed;
+    }
+    finished_.store(true, std::memory_order_release);
+    if (wake) wake();
+}
+
+bool PosixUdpEngine::Resolve(const std::string& host, uint16_t port) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    std::string service = std::to_string(port);
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses) != 0) return false;
+
+    // a connected socket only receives from the server and reports an unreachable port
+    int s = -1;
+    for (addrinfo* a = addresses; a && s < 0; a = a->ai_next) {
+        s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (s < 0) continue;
+        if (connect(s, a->ai_addr, a->ai_addrlen) != 0) {
+            close(s);
+            s = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (s < 0) return false;
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    socket_ = s;
+    if (stop_.load()) return false;
+    session_.Reset();
+    state_ = TransportState::Open;
+    Signal();
+    return true;
+}
+
+void PosixUdpEngine::ReceiveAll() {
+    for (;;) {
+        // MSG_TRUNC: n is the real length, so an oversized datagram can be told apart and dropped
+        ssize_t n = recv(socket_, receiveBuffer_.data(), receiveBuffer_.size(), MSG_TRUNC);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            if (errno == EINTR) continue;
+            // ECONNREFUSED: the server's port is unreachable (ICMP); reconnect with backoff
+            std::lock_guard<std::mutex> lock(mutex_);
+            FailLocked();
+            return;
+        }
+        if ((size_t)n > receiveBuffer_.size()) continue;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (session_.OnDatagram(receiveBuffer_.data(), (size_t)n)) Signal();
+    }
+}
+
+// Sends what is due (window repeats, key state). Returns how long until something is due again.
+int PosixUdpEngine::MaintainLocked() {
+    if (state_ != TransportState::Open) return 50;
+    int64_t now = MonotonicNs();
+    while (size_t len = session_.EncodeDue(now)) {
+        if (!SendLocked(len)) return 50;
+    }
+    uint32_t waitMs = session_.WaitMs(now);
+    return waitMs < 50 ? (int)waitMs : 50;
+}
+
+bool PosixUdpEngine::SendLocked(size_t len) {
+    if (send(socket_, session_.Datagram(), len, 0) < 0) {
+        // a full socket buffer just drops the datagram, like the network would
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+        FailLocked();
+        return false;
+    }
+    return true;
+}
+
+void PosixUdpEngine::FailLocked() {
+    if (state_ == TransportState::Failed || state_ == TransportState::Closed) return;
+    state_ = TransportState::Failed;
+    Signal();
+}
+
+void PosixUdpEngine::Signal() {
+    if (wake_) wake_();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// UdpEngine on BSD sockets: the same datagram protocol (UdpSession) and the same engine thread
+// (resolve, receive acks and messages, send what is due while the link is quiet), for the
+// portable build. It is what lets the pipeline be tested against a real socket, and is the
+// starting point for a client on other platforms.
+//
+// Lifetime as with UdpEngine: the owner calls Close() or Abort() and may delete the engine only
+// once Finished() returns true. Every state change calls wake (if set) on the engine thread or
+// the caller's.
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DatagramFormat.h"
+#include "Transport.h"
+#include "UdpSession.h"
+
+class PosixUdpEngine : public ITransport {
+public:
+    static const size_t MAX_DATAGRAM_SIZE = 2048;  // larger datagrams from the server are ignored
+
+    PosixUdpEngine(std::function<void()> wake, const UdpOptions& options);
+    ~PosixUdpEngine();
+
+    PosixUdpEngine(const PosixUdpEngine&) = delete;
+    PosixUdpEngine& operator=(const PosixUdpEngine&) = delete;
+
+    // Starts resolving host in the background; returns false if the thread could not be started
+    bool Start(const std::string& host, uint16_t port);
+
+    // ITransport
+    TransportState State() const override;
+    std::string Subprotocol() const override { return DATAGRAM_PROTOCOL; }
+    uint8_t* SendBuffer(size_t* cap) override;
+    bool CommitSend(size_t len, bool binary) override;
+    uint64_t CompletedSends() const override { return completedSends_.load(std::memory_order_acquire); }
+    int64_t LastSendCompleteNs() const override { return lastSendCompleteNs_.load(std::memory_order_relaxed); }
+    bool TakeMessage(std::string* out) override;
+    void Close() override;
+    void Abort() override;
+    bool Finished() const override { return finished_.load(std::memory_order_acquire); }
+
+private:
+    void Run(std::string host, uint16_t port);
+    bool Resolve(const std::string& host, uint16_t port);
+    void ReceiveAll();
+    int MaintainLocked();
+    bool SendLocked(size_t len);
+    void FailLocked();
+    void Signal();
+
+    std::function<void()> wake_;
+
+    mutable std::mutex mutex_; // the worker (sends) and the engine thread (receive, repeats)
+    TransportState state_ = TransportState::Idle;
+    int socket_ = -1;          // owned by the engine thread
+    std::atomic<bool> stop_{ false };
+    std::thread thread_;
+
+    UdpSession session_;
+    std::vector<uint8_t> receiveBuffer_;
+    std::atomic<int64_t> lastSendCompleteNs_{ 0 };
+    std::atomic<uint64_t> completedSends_{ 0 };
+    std::atomic<bool> finished_{ false };
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+// Reconnect support for WSWorker: jittered exponential backoff and a bounded replay buffer.
+// Portable (no windows.h); both classes are owned and used by a single thread.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "KeyEvent.h"
+
+// Exponential backoff with "equal jitter": the n-th delay is drawn uniformly from
+// [d/2, d] where d = min(maxMs, baseMs * 2^n). Jitter keeps many clients from
+// reconnecting in lock-step after a server restart.
+class ReconnectBackoff {
+public:
+    ReconnectBackoff(uint32_t baseMs = 250, uint32_t maxMs = 10000, uint32_t seed = 0x9E3779B9u)
+        : baseMs_(baseMs ? baseMs : 1), maxMs_(maxMs < baseMs ? baseMs : maxMs), rng_(seed ? seed : 1) {}
+
+    uint32_t NextDelayMs() {
+        uint64_t d = (uint64_t)baseMs_ << (attempt_ < 20 ? attempt_ : 20);
+        if (d > maxMs_) d = maxMs_;
+        if (attempt_ < 32) attempt_++;
+        uint32_t half = (uint32_t)(d / 2);
+        return half + (uint32_t)(NextRandom() % (uint32_t)(d - half + 1));
+    }
+
+    void Reset() { attempt_ = 0; }
+    uint32_t Attempts() const { return attempt_; }
+
+private:
+    uint32_t NextRandom() {
+        // xorshift32
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 17;
+        rng_ ^= rng_ << 5;
+        return rng_;
+    }
+
+    uint32_t baseMs_;
+    uint32_t maxMs_;
+    uint32_t attempt_ = 0;
+    uint32_t rng_;
+};
+
+// Fixed-capacity FIFO of key events that have not been handed to the socket yet
+// (or whose send did not complete before the connection dropped).
+// Overflow policy: the oldest events are discarded and counted; the state resync
+// sent after reconnecting repairs whatever those events would have changed.
+template <size_t Capacity>
+class ReplayBuffer {
+public:
+    size_t Size() const { return count_; }
+    bool Empty() const { return count_ == 0; }
+    uint64_t Dropped() const { return dropped_; }
+
+    void PushBack(const KeyEvent& ev) {
+        if (count_ == Capacity) {
+            head_ = (head_ + 1) % Capacity;
+            count_--;
+            dropped_++;
+        }
+        slots_[(head_ + count_) % Capacity] = ev;
+        count_++;
+    }
+
+    void PushBack(const KeyEvent* events, size_t n) {
+        for (size_t i = 0; i < n; ++i) PushBack(events[i]);
+    }
+
+    // Puts events back in front of the queue (e.g. an unfinished frame). They are older
+    // than everything queued, so whatever does not fit is dropped.
+    void PushFront(const KeyEvent* events, size_t n) {
+        for (size_t i = n; i-- > 0;) {
+            if (count_ == Capacity) { dropped_ += i + 1; return; }
+            head_ = (head_ + Capacity - 1) % Capacity;
+            slots_[head_] = events[i];
+            count_++;
+        }
+    }
+
+    // copies up to maxCount events from the front without removing them
+    size_t Peek(KeyEvent* out, size_t maxCount) const {
+        size_t n = count_ < maxCount ? count_ : maxCount;
+        for (size_t i = 0; i < n; ++i) out[i] = slots_[(head_ + i) % Capacity];
+        return n;
+    }
+
+    void PopFront(size_t n) {
+        if (n > count_) n = count_;
+        head_ = (head_ + n) % Capacity;
+        count_ -= n;
+    }
+
+    // newest queued event, or nullptr if empty (e.g. to merge motion into it)
+    KeyEvent* Back() { return count_ ? &slots_[(head_ + count_ - 1) % Capacity] : nullptr; }
+
+    void Clear() { head_ = count_ = 0; }
+
+private:
+    KeyEvent slots_[Capacity];
+    size_t head_ = 0;
+    size_t count_ = 0;
+    uint64_t dropped_ = 0;
+};
@@ -0,0 +1,217 @@
+#include "SendPipeline.h"
+
+#include <algorithm>
+
+SendPipeline::SendPipeline(PipelineLatency* latency, SendStats* stats, FilterStats* filterStats)
+    : latency_(latency), stats_(stats), filterStats_(filterStats) {
+}
+
+void SendPipeline::Enqueue(const KeyEvent* events, size_t count, const SendOptions& options) {
+    if (count == 0) return;
+    for (size_t i = 0; i < count; ++i) {
+        KeyEvent* back = outbox_.Back();
+        if (back && AccumulateMotion(*back, events[i])) {
+            if (filterStats_) filterStats_->motionMerged.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        outbox_.PushBack(events[i]);
+    }
+    if (options.coalesceTaps && outbox_.Size() > 1) {
+        // only events that are still waiting are touched; the in-flight frame is separate
+        size_t queued = outbox_.Peek(scratch_, OUTBOX_CAPACITY);
+        size_t kept = CoalesceTaps(scratch_, queued, filterStats_);
+        if (kept < queued) {
+            outbox_.Clear();
+            outbox_.PushBack(scratch_, kept);
+        }
+    }
+}
+
+void SendPipeline::EnqueueSynthesized(const KeyEvent* events, size_t count) {
+    outbox_.PushBack(events, count);
+}
+
+void SendPipeline::OnConnected(const KeySnapshot& local, uint32_t timeMs) {
+    stats_->resyncs.fetch_add(1, std::memory_order_relaxed);
+
+    // the outbox (with the replayed frame) goes out first, then the state
+    RemoteKeyModel maybeDown = previous_;
+    size_t n = outbox_.Peek(scratch_, OUTBOX_CAPACITY);
+    maybeDown.Apply(scratch_, n);
+    previous_ = RemoteKeyModel();
+
+    for (int vk = 1; vk < 256; ++vk) {
+        bool down = local.Test((uint8_t)vk);
+        if (!down && !maybeDown.down[vk]) continue;
+        KeyEvent ev;
+        ev.time = timeMs;
+        ev.vkCode = (uint8_t)vk;
+        ev.type = down ? KeyEventType::Down : KeyEventType::Up;
+        outbox_.PushBack(ev);
+    }
+}
+
+void SendPipeline::Resync(const KeySnapshot& local, uint32_t timeMs) {
+    stats_->resyncs.fetch_add(1, std::memory_order_relaxed);
+
+    // the server will also see everything still in the outbox before the resync events
+    RemoteKeyModel remote = remote_;
+    size_t n = outbox_.Peek(scratch_, OUTBOX_CAPACITY);
+    remote.Apply(scratch_, n);
+
+    for (int vk = 1; vk < 256; ++vk) {
+        bool down = local.Test((uint8_t)vk);
+        if (remote.down[vk] == down) continue;
+        KeyEvent ev;
+        ev.time = timeMs;
+        ev.vkCode = (uint8_t)vk;
+        ev.type = down ? KeyEventType::Down : KeyEventType::Up;
+        outbox_.PushBack(ev);
+    }
+}
+
+void SendPipeline::ReleaseRemoteKeys(uint32_t timeMs) {
+    outbox_.Clear();
+    for (int vk = 1; vk < 256; ++vk) {
+        if (!remote_.down[vk]) continue;
+        KeyEvent ev;
+        ev.time = timeMs;
+        ev.vkCode = (uint8_t)vk;
+        ev.type = KeyEventType::Up;
+        outbox_.PushBack(ev);
+    }
+}
+
+static bool IsExpired(const KeyEvent& ev, const StalePolicy& policy, int64_t nowNs) {
+    if (ev.hookNs == 0 || ev.type == KeyEventType::Up) return false;
+    uint32_t maxAgeMs = IsKeyTransition(ev) ? policy.keyMaxAgeMs : policy.motionMaxAgeMs;
+    return maxAgeMs > 0 && nowNs - ev.hookNs > (int64_t)maxAgeMs * 1000000;
+}
+
+bool SendPipeline::ExpireStale(const StalePolicy& policy, int64_t nowNs) {
+    if (outbox_.Empty()) return false;
+
+    if (policy.maxQueued > 0 && outbox_.Size() > policy.maxQueued) {
+        // the backlog is not worth replaying: the resync conveys the key state in one burst
+        size_t n = outbox_.Peek(scratch_, OUTBOX_CAPACITY);
+        size_t captured = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (scratch_[i].hookNs != 0) captured++;
+        }
+        stats_->shed.fetch_add(captured, std::memory_order_relaxed);
+        outbox_.Clear();
+        return true;
+    }
+
+    // captured events are queued in capture order: if the oldest key-down and the oldest motion are
+    // within their deadlines, so is everything behind them
+    size_t n = outbox_.Peek(scratch_, OUTBOX_CAPACITY);
+    bool keySeen = false, motionSeen = false, anyExpired = false;
+    for (size_t i = 0; i < n && !(keySeen && motionSeen); ++i) {
+        const KeyEvent& ev = scratch_[i];
+        if (ev.hookNs == 0 || ev.type == KeyEventType::Up) continue;
+        bool& seen = IsKeyTransition(ev) ? keySeen : motionSeen;
+        if (seen) continue;
+        seen = true;
+        if (IsExpired(ev, policy, nowNs)) { anyExpired = true; break; }
+    }
+    if (!anyExpired) return false;
+
+    size_t kept = 0;
+    bool keyDropped = false;
+    for (size_t i = 0; i < n; ++i) {
+        if (IsExpired(scratch_[i], policy, nowNs)) {
+            if (IsKeyTransition(scratch_[i])) keyDropped = true;
+            continue;
+        }
+        scratch_[kept++] = scratch_[i];
+    }
+    stats_->expired.fetch_add(n - kept, std::memory_order_relaxed);
+    outbox_.Clear();
+    outbox_.PushBack(scratch_, kept);
+    // a key that is still held after its down expired is pressed again by the resync, now
+    return keyDropped;
+}
+
+void SendPipeline::OnTransportLost() {
+    outbox_.PushFront(inflight_, inflightCount_);
+    inflightCount_ = 0;
+    for (int vk = 1; vk < 256; ++vk) previous_.down[vk] = previous_.down[vk] || remote_.down[vk];
+    remote_ = RemoteKeyModel();
+    completedSeen_ = 0; // the next transport counts from zero
+}
+
+void SendPipeline::PollCompletions(const ITransport& transport) {
+    uint64_t completed = transport.CompletedSends();
+    if (completed == completedSeen_) return;
+
+    // the in-flight frame reached the socket: record its latency, it no longer needs replay
+    completedSeen_ = completed;
+    int64_t doneNs = transport.LastSendCompleteNs();
+    if (inflightCount_ > 0) flush_.OnSendComplete(doneNs - inflightSentNs_);
+    for (size_t i = 0; i < inflightCount_; ++i) {
+        if (inflight_[i].hookNs == 0) continue; // synthesized release/resync
+        latency_->send.RecordNs(doneNs - inflight_[i].stageNs);
+        latency_->total.RecordNs(doneNs - inflight_[i].hookNs);
+    }
+    inflightCount_ = 0;
+}
+
+bool SendPipeline::SendNext(ITransport& transport, WireEncoding encoding, const SendOptions& options, int64_t* flushAtNs) {
+    if (outbox_.Empty()) return false;
+
+    // a release-all or resync burst (synthesized events at the head of the outbox) goes out as one
+    // binary frame even without batching; text servers may expect one key per frame
+    bool binary = IsBinaryEncoding(encoding);
+    size_t maxFrame = MAX_FRAME_EVENTS;
+    size_t perFrame = options.batch ? std::min(options.maxEvents, maxFrame) : 1;
+    size_t n = outbox_.Peek(scratch_, binary ? maxFrame : perFrame);
+    size_t synthesized = 0;
+    while (synthesized < n && scratch_[synthesized].hookNs == 0) synthesized++;
+    if (synthesized > perFrame) perFrame = synthesized;
+    if (n > perFrame) n = perFrame;
+
+    // the buffer is only available once the previous frame has completed; until then the
+    // outbox collects what goes into the next frame
+    size_t cap = 0;
+    uint8_t* buf = transport.SendBuffer(&cap);
+    if (!buf) return false;
+
+    // what queued up behind that frame may be held a little longer for a fuller one
+    // (synthesized events never wait)
+    if (perFrame > 1) {
+        int64_t oldestNs = synthesized > 0 ? 0 : scratch_[0].stageNs;
+        if (!flush_.ShouldFlush(options.flush, MonotonicNs(), oldestNs, outbox_.Size(), perFrame,
+                transport.LastSendCompleteNs(), flushAtNs)) {
+            return false;
+        }
+    }
+
+    size_t len = 0;
+    switch (encoding) {
+    case WireEncoding::Text: len = EncodeTextBatch(scratch_, n, (char*)buf, cap); break;
+    case WireEncoding::Binary: len = EncodeBinaryBatch(scratch_, n, buf, cap); break;
+    case WireEncoding::Compact: len = EncodeCompactBatch(scratch_, n, buf, cap); break;
+    }
+    int64_t sendStartNs = MonotonicNs();
+    if (len == 0 || !transport.CommitSend(len, binary)) return false;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (scratch_[i].hookNs != 0) latency_->batch.RecordNs(sendStartNs - scratch_[i].stageNs);
+        scratch_[i].stageNs = sendStartNs;
+    }
+    std::copy(scratch_, scratch_ + n, inflight_);
+    inflightCount_ = n;
+    inflightSentNs_ = sendStartNs;
+    remote_.Apply(inflight_, inflightCount_);
+    outbox_.PopFront(n);
+
+    stats_->frames.fetch_add(1, std::memory_order_relaxed);
+    stats_->events.fetch_add(n, std::memory_order_relaxed);
+    stats_->bytes.fetch_add(len, std::memory_order_relaxed);
+    if (encoding == WireEncoding::Compact) {
+        stats_->compactBytes.fetch_add(len, std::memory_order_relaxed);
+        stats_->compactBinaryBytes.fetch_add(BinaryFrameSize(n), std::memory_order_relaxed);
+    }
+    return true;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+// Worker-side send path between the capture queue and a transport. Portable (no windows.h).
+//
+// Owns the outbox (events not handed to the transport yet; survives reconnects, bounded), the
+// in-flight frame (put back into the outbox if the connection drops before it completes) and a
+// model of which keys the server holds, used to resync the server after a reconnect or after
+// stale events were dropped.
+// Single-threaded: everything is called from the worker that drives the transport.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "EventFilter.h"
+#include "FlushScheduler.h"
+#include "KeyEvent.h"
+#include "KeyState.h"
+#include "LatencyStats.h"
+#include "Reconnect.h"
+#include "Transport.h"
+#include "WireFormat.h"
+
+// send statistics (events per frame = events / frames); bytes are frame payloads without framing
+struct SendStats {
+    std::atomic<uint64_t> frames{ 0 };
+    std::atomic<uint64_t> events{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+    std::atomic<uint64_t> compactBytes{ 0 };     // part of bytes sent in the compact encoding
+    std::atomic<uint64_t> compactBinaryBytes{ 0 }; // what those frames would have cost in binary v1
+    std::atomic<uint64_t> expired{ 0 };  // captured events dropped for missing their deadline
+    std::atomic<uint64_t> shed{ 0 };     // captured events dropped because the outbox grew too deep
+    std::atomic<uint64_t> resyncs{ 0 };  // key state resyncs (reconnects, expiry, shedding)
+};
+
+// What happens to events that waited too long (e.g. through a send stall): replaying key presses
+// seconds late is worse than dropping them. Deadlines count from the hook (KeyEvent::hookNs);
+// synthesized events and key-ups never expire, so no key can stay held on the server.
+struct StalePolicy {
+    uint32_t keyMaxAgeMs = 0;     // key-downs older than this are dropped; 0 = never
+    uint32_t motionMaxAgeMs = 0;  // motion and wheel; 0 = never
+    size_t maxQueued = 0;         // deeper outboxes are replaced by a key state resync; 0 = capacity only
+};
+
+struct SendOptions {
+    bool batch = false;         // several events per frame
+    size_t maxEvents = 1;       // per frame when batching (<= SendPipeline::MAX_FRAME_EVENTS)
+    bool coalesceTaps = false;  // see CoalesceTaps()
+    FlushPolicy flush;          // when batching: how long events queued behind a send may be held
+    StalePolicy stale;
+};
+
+// Which keys the server currently holds down, built from what was sent
+struct RemoteKeyModel {
+    bool down[256] = {};
+
+    void Apply(const KeyEvent* events, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (IsKeyTransition(events[i])) down[events[i].vkCode] = (events[i].type == KeyEventType::Down);
+        }
+    }
+};
+
+class SendPipeline {
+public:
+    static const size_t OUTBOX_CAPACITY = 512;
+    static const size_t MAX_FRAME_EVENTS = BINARY_MAX_EVENTS;
+
+    // latency, stats and filterStats may be shared with other pipelines; filterStats may be null
+    SendPipeline(PipelineLatency* latency, SendStats* stats, FilterStats* filterStats);
+
+    SendPipeline(const SendPipeline&) = delete;
+    SendPipeline& operator=(const SendPipeline&) = delete;
+
+    // Queues captured events (stageNs = when they left the capture queue)
+    void Enqueue(const KeyEvent* events, size_t count, const SendOptions& options);
+    // Queues synthesized events (hookNs == 0), e.g. a release-all; never coalesced
+    void EnqueueSynthesized(const KeyEvent* events, size_t count);
+
+    // The transport just opened: queue the full key state after the outbox. The server may have
+    // restarted, so nothing it was sent before can be assumed: every key held in `local` is
+    // pressed again and every other key the previous connection may have left held is released.
+    // timeMs stamps the synthesized events (KeyEvent::time clock).
+    void OnConnected(const KeySnapshot& local, uint32_t timeMs);
+    // Queues the events that bring the server from what it will have after the outbox to `local`
+    void Resync(const KeySnapshot& local, uint32_t timeMs);
+    // Applies the stale policy to the outbox: drops expired key-downs, motion and wheel, or (past
+    // maxQueued) everything queued. Returns true if the server's key state must be resynced.
+    bool ExpireStale(const StalePolicy& policy, int64_t nowNs);
+    // The connection is being retired (its endpoint changed or was removed): drops what is queued
+    // and queues key-ups for every key the server holds, so nothing stays pressed there
+    void ReleaseRemoteKeys(uint32_t timeMs);
+    // The transport failed or was closed: the unfinished frame goes back to the front of the
+    // outbox (it may or may not have reached the server; replaying it is harmless) and the
+    // server's key state becomes unknown
+    void OnTransportLost();
+
+    // Accounts for completed sends: records send/total latency, the in-flight frame is done
+    void PollCompletions(const ITransport& transport);
+
+    // Encodes and commits the next frame if the transport can take one and the flush scheduler
+    // doesn't hold the queued events for batching. Returns true if a frame was committed; if events
+    // are being held, *flushAtNs (if given) is set to when to call again (MonotonicNs clock).
+    bool SendNext(ITransport& transport, WireEncoding encoding, const SendOptions& options, int64_t* flushAtNs = nullptr);
+
+    bool HasPending() const { return !outbox_.Empty(); }
+    bool HasInflight() const { return inflightCount_ > 0; }
+    size_t Backlog() const { return outbox_.Size(); }
+    uint64_t Dropped() const { return outbox_.Dropped(); }
+    uint32_t FlushBudgetUs(const SendOptions& options) const { return flush_.BudgetUs(options.flush); }
+    int64_t SmoothedSendUs() const { return flush_.SmoothedSendUs(); }
+
+private:
+    PipelineLatency* latency_;
+    SendStats* stats_;
+    FilterStats* filterStats_;
+
+    ReplayBuffer<OUTBOX_CAPACITY> outbox_;
+    KeyEvent inflight_[MAX_FRAME_EVENTS];
+    size_t inflightCount_ = 0;
+    int64_t inflightSentNs_ = 0;
+    uint64_t completedSeen_ = 0; // transport->CompletedSends() already accounted for
+    RemoteKeyModel remote_;   // what the current connection's server holds
+    RemoteKeyModel previous_; // what servers of lost connections may still hold, until the next connect
+    FlushScheduler flush_;
+    KeyEvent scratch_[OUTBOX_CAPACITY];
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+// Fixed-capacity, allocation-free single-producer/single-consumer ring.
+//
+// TryPush() may only be called from one thread (the producer) and TryPop() /
+// PopBatch() only from one other thread (the consumer). Both sides are
+// wait-free: every call finishes in a bounded number of steps and never
+// blocks or allocates.
+//
+// Overflow policy: the ring never overwrites unread slots. When it is full,
+// TryPush() rejects the new element (drop newest), bumps the dropped counter
+// and returns false so the caller can keep its own state consistent with what
+// was actually enqueued.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "SpscRing elements must be trivially copyable");
+
+public:
+    SpscRing() = default;
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // producer side
+    bool TryPush(const T& item) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ >= Capacity) {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ >= Capacity) {
+                dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        slots_[tail & kMask] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+
+        const size_t depth = tail + 1 - cachedHead_;
+        if (depth > highWater_.load(std::memory_order_relaxed)) {
+            highWater_.store(depth, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // consumer side
+    bool TryPop(T& out) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cachedTail_) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == cachedTail_) return false;
+        }
+        out = slots_[head & kMask];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side: pop up to maxCount elements in one go, returns how many were copied
+    size_t PopBatch(T* out, size_t maxCount) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (cachedTail_ - head < maxCount) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+        }
+        size_t n = cachedTail_ - head;
+        if (n > maxCount) n = maxCount;
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = slots_[(head + i) & kMask];
+        }
+        if (n) head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // approximate when called concurrently; exact from either side when the other is idle
+    bool Empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t Size() const {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+    // counters (safe to read from any thread); HighWater() is measured against the producer's
+    // cached head, so it may overstate the deepest fill (never beyond Capacity) but never understates it
+    uint64_t Pushed() const { return tail_.load(std::memory_order_relaxed); }
+    uint64_t Popped() const { return head_.load(std::memory_order_relaxed); }
+    uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    size_t HighWater() const { return highWater_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kMask = Capacity - 1;
+    static constexpr size_t kCacheLine = 64;
+
+    // consumer-owned
+    alignas(kCacheLine) std::atomic<size_t> head_{ 0 };
+    size_t cachedTail_ = 0;
+
+    // producer-owned
+    alignas(kCacheLine) std::atomic<size_t> tail_{ 0 };
+    size_t cachedHead_ = 0;
+    std::atomic<uint64_t> dropped_{ 0 };
+    std::atomic<size_t> highWater_{ 0 };
+
+    alignas(kCacheLine) T slots_[Capacity];
+};
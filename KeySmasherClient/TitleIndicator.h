@@ -0,0 +1,78 @@
+#pragma once
+
+// Status indicator appended to the target window's title, e.g. "Parsec [/]". Portable (no windows.h):
+// the platform layer reports target changes and timer ticks and applies the title writes returned.
+//
+// Writing another process's title is a cross-process message, so the indicator only produces a
+// write when the text actually changes: the spinner advances on a tick only if events were sent
+// since the previous tick, and otherwise the title is left alone. Ticks are only needed while a
+// target is focused (TimerNeeded()); when the target changes, the old one gets its title back.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FocusTracker.h"
+
+struct TitleWrite {
+    WindowHandle hwnd;
+    std::wstring text;
+};
+
+// What the indicator reflects, sampled on every tick
+struct IndicatorInput {
+    bool paused = false;
+    bool connected = false;
+    uint64_t activity = 0; // any counter that grows while events are being sent
+};
+
+class TitleIndicator {
+public:
+    // The focused target changed (hwnd is null when no target is focused). currentTitle is the new
+    // target's title as it is now; it is what the window gets back when it loses the focus.
+    void OnTarget(WindowHandle hwnd, const std::wstring& currentTitle, const IndicatorInput& input, std::vector<TitleWrite>* out) {
+        if (hwnd == target_) return;
+        Restore(out);
+        target_ = hwnd;
+        if (!target_) return;
+        original_ = currentTitle;
+        activity_ = input.activity;
+        Render(input, out);
+    }
+
+    // Periodic update while a target is focused
+    void OnTick(const IndicatorInput& input, std::vector<TitleWrite>* out) {
+        if (!target_) return;
+        if (input.activity != activity_) {
+            activity_ = input.activity;
+            frame_ = (frame_ + 1) % 4;
+        }
+        Render(input, out);
+    }
+
+    // Gives the current target its original title back (e.g. on exit)
+    void Restore(std::vector<TitleWrite>* out) {
+        if (target_ && !shown_.empty()) out->push_back(TitleWrite{ target_, original_ });
+        target_ = nullptr;
+        shown_.clear();
+    }
+
+    bool TimerNeeded() const { return target_ != nullptr; }
+    WindowHandle Target() const { return target_; }
+
+private:
+    void Render(const IndicatorInput& input, std::vector<TitleWrite>* out) {
+        static const wchar_t* const SPINNER[4] = { L"-", L"\\", L"|", L"/" };
+        const wchar_t* glyph = input.paused ? L"=" : (!input.connected ? L"x" : SPINNER[frame_]);
+        std::wstring text = original_ + L" [" + glyph + L"]";
+        if (text == shown_) return;
+        shown_ = text;
+        out->push_back(TitleWrite{ target_, text });
+    }
+
+    WindowHandle target_ = nullptr;
+    std::wstring original_;
+    std::wstring shown_; // what the target's title was last set to; empty if untouched
+    uint64_t activity_ = 0;
+    unsigned frame_ = 0;
+};
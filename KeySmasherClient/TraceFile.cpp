@@ -0,0 +1,110 @@
+#include "TraceFile.h"
+
+bool TraceWriter::Open(const std::wstring& path) {
+    Close();
+    file_ = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_ == INVALID_HANDLE_VALUE) return false;
+    if (!Map(INITIAL_MAPPING)) {
+        Close();
+        return false;
+    }
+    EncodeTraceHeader(view_);
+    used_ = TRACE_HEADER_LEN;
+    records_ = 0;
+    lastHookNs_ = 0;
+    return true;
+}
+
+bool TraceWriter::Map(size_t capacity) {
+    // mapping a file with a size larger than its current length extends the file
+    LARGE_INTEGER size;
+    size.QuadPart = (LONGLONG)capacity;
+    mapping_ = CreateFileMappingW(file_, NULL, PAGE_READWRITE, (DWORD)size.HighPart, size.LowPart, NULL);
+    if (!mapping_) return false;
+    view_ = (uint8_t*)MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, capacity);
+    if (!view_) {
+        CloseHandle(mapping_);
+        mapping_ = NULL;
+        return false;
+    }
+    capacity_ = capacity;
+    return true;
+}
+
+void TraceWriter::Unmap() {
+    if (view_) { UnmapViewOfFile(view_); view_ = nullptr; }
+    if (mapping_) { CloseHandle(mapping_); mapping_ = NULL; }
+    capacity_ = 0;
+}
+
+bool TraceWriter::Append(const KeyEvent* events, size_t count) {
+    if (!view_) return false;
+    for (size_t i = 0; i < count; ++i) {
+        const KeyEvent& ev = events[i];
+        if (ev.hookNs == 0) continue;
+
+        if (used_ + TRACE_RECORD_LEN > capacity_) {
+            size_t next = capacity_ * 2;
+            Unmap();
+            if (!Map(next)) {
+                Close();
+                return false;
+            }
+        }
+
+        int64_t deltaNs = (lastHookNs_ == 0 || ev.hookNs < lastHookNs_) ? 0 : ev.hookNs - lastHookNs_;
+        int64_t deltaUs = deltaNs / 1000;
+        EncodeTraceRecord(view_ + used_, ev, deltaUs > 0xFFFFFFFFLL ? 0xFFFFFFFFu : (uint32_t)deltaUs);
+        lastHookNs_ = ev.hookNs;
+        used_ += TRACE_RECORD_LEN;
+        records_++;
+    }
+    return true;
+}
+
+void TraceWriter::Close() {
+    Unmap();
+    if (file_ == INVALID_HANDLE_VALUE) return;
+
+    // drop the unused tail of the last mapping
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)used_;
+    if (SetFilePointerEx(file_, end, NULL, FILE_BEGIN)) SetEndOfFile(file_);
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+    used_ = 0;
+}
+
+bool TraceReader::Open(const std::wstring& path) {
+    Close();
+    file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_ == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size) || size.QuadPart < (LONGLONG)TRACE_HEADER_LEN) {
+        Close();
+        return false;
+    }
+    mapping_ = CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_) view_ = (const uint8_t*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    if (view_) recordLen_ = DecodeTraceHeader(view_, (size_t)size.QuadPart);
+    if (recordLen_ == 0) {
+        Close();
+        return false;
+    }
+    count_ = TraceRecordCount((size_t)size.QuadPart, recordLen_);
+    return true;
+}
+
+bool TraceReader::Read(size_t i, KeyEvent* ev, uint32_t* deltaUs) const {
+    if (i >= count_) return false;
+    return DecodeTraceRecord(view_ + TRACE_HEADER_LEN + i * recordLen_, recordLen_, ev, deltaUs);
+}
+
+void TraceReader::Close() {
+    if (view_) { UnmapViewOfFile(view_); view_ = nullptr; }
+    if (mapping_) { CloseHandle(mapping_); mapping_ = NULL; }
+    if (file_ != INVALID_HANDLE_VALUE) { CloseHandle(file_); file_ = INVALID_HANDLE_VALUE; }
+    recordLen_ = 0;
+    count_ = 0;
+}
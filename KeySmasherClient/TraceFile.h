@@ -0,0 +1,72 @@
+#pragma once
+
+// Memory-mapped reader and writer for key event traces (format in TraceFormat.h).
+//
+// TraceWriter maps a growing window of the file and appends records with plain stores;
+// the mapping is doubled when full and the file is truncated to the written length on Close().
+// TraceReader maps the whole file read-only and decodes records by index.
+
+#include <windows.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "TraceFormat.h"
+
+class TraceWriter {
+public:
+    static const size_t INITIAL_MAPPING = 1024 * 1024;
+
+    TraceWriter() {}
+    ~TraceWriter() { Close(); }
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    // Creates (or truncates) the file and writes the header
+    bool Open(const std::wstring& path);
+    bool IsOpen() const { return file_ != INVALID_HANDLE_VALUE; }
+
+    // Appends captured events (synthesized ones, hookNs == 0, are skipped).
+    // Returns false if the mapping could not be grown; the trace is closed in that case.
+    bool Append(const KeyEvent* events, size_t count);
+    uint64_t Records() const { return records_; }
+
+    void Close();
+
+private:
+    bool Map(size_t capacity);
+    void Unmap();
+
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+    uint8_t* view_ = nullptr;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+    uint64_t records_ = 0;
+    int64_t lastHookNs_ = 0;
+};
+
+class TraceReader {
+public:
+    TraceReader() {}
+    ~TraceReader() { Close(); }
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    // Maps the file; returns false if it can't be opened or has no valid header
+    bool Open(const std::wstring& path);
+    size_t Count() const { return count_; }
+    // Decodes record i (< Count()); returns false for a corrupt record
+    bool Read(size_t i, KeyEvent* ev, uint32_t* deltaUs) const;
+
+    void Close();
+
+private:
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+    const uint8_t* view_ = nullptr;
+    size_t recordLen_ = 0;
+    size_t count_ = 0;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+// Key event trace files (capture / replay). Portable (no windows.h); TraceFile.h maps them on Windows.
+//
+// Layout (little-endian, fixed-size records so a mapped file can be indexed directly):
+//   header   "KSTR" | u16 version (=2) | u16 record length (=17) | u32 reserved (0) | u32 reserved (0)
+//   record   u32 delta to the previous record (us, hook clock) | u32 hook time (ms)
+//            | u16 scanCode | u8 vkCode | u8 type | u8 flags | i16 dx | i16 dy
+// Version 1 traces (13-byte records without dx/dy, keys only) are still read.
+// The record count is (file size - header) / record length; a partially written last record
+// (e.g. after a crash) is ignored.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "KeyEvent.h"
+#include "WireFormat.h"
+
+const uint8_t TRACE_MAGIC[4] = { 'K', 'S', 'T', 'R' };
+const uint16_t TRACE_VERSION = 2;
+const size_t TRACE_HEADER_LEN = 16;
+const size_t TRACE_RECORD_LEN = 17;
+const size_t TRACE_RECORD_LEN_V1 = 13;
+
+inline void EncodeTraceHeader(uint8_t* out) {
+    for (size_t i = 0; i < 4; ++i) out[i] = TRACE_MAGIC[i];
+    PutU16(out + 4, TRACE_VERSION);
+    PutU16(out + 6, (uint16_t)TRACE_RECORD_LEN);
+    PutU32(out + 8, 0);
+    PutU32(out + 12, 0);
+}
+
+// Returns the record length of the trace, or 0 if data does not start with a supported header
+inline size_t DecodeTraceHeader(const uint8_t* data, size_t len) {
+    if (len < TRACE_HEADER_LEN) return 0;
+    for (size_t i = 0; i < 4; ++i) {
+        if (data[i] != TRACE_MAGIC[i]) return 0;
+    }
+    uint16_t version = GetU16(data + 4);
+    uint16_t recordLen = GetU16(data + 6);
+    if (version == TRACE_VERSION && recordLen == TRACE_RECORD_LEN) return TRACE_RECORD_LEN;
+    if (version == 1 && recordLen == TRACE_RECORD_LEN_V1) return TRACE_RECORD_LEN_V1;
+    return 0;
+}
+
+inline size_t TraceRecordCount(size_t fileSize, size_t recordLen) {
+    return fileSize < TRACE_HEADER_LEN ? 0 : (fileSize - TRACE_HEADER_LEN) / recordLen;
+}
+
+inline void EncodeTraceRecord(uint8_t* out, const KeyEvent& ev, uint32_t deltaUs) {
+    PutU32(out, deltaUs);
+    PutU32(out + 4, ev.time);
+    PutU16(out + 8, ev.scanCode);
+    out[10] = ev.vkCode;
+    out[11] = (uint8_t)ev.type;
+    out[12] = ev.flags;
+    PutU16(out + 13, (uint16_t)ev.dx);
+    PutU16(out + 15, (uint16_t)ev.dy);
+}
+
+// Decodes a record of recordLen bytes. Returns false for a record that cannot be a captured event.
+inline bool DecodeTraceRecord(const uint8_t* in, size_t recordLen, KeyEvent* ev, uint32_t* deltaUs) {
+    if (in[11] > (uint8_t)KeyEventType::MouseHWheel) return false;
+    bool key = in[11] <= (uint8_t)KeyEventType::Up;
+    if (key && in[10] == 0) return false;
+    if (!key && recordLen < TRACE_RECORD_LEN) return false;
+    *deltaUs = GetU32(in);
+    *ev = KeyEvent();
+    ev->time = GetU32(in + 4);
+    ev->scanCode = GetU16(in + 8);
+    ev->vkCode = in[10];
+    ev->type = (KeyEventType)in[11];
+    ev->flags = in[12];
+    if (recordLen >= TRACE_RECORD_LEN) {
+        ev->dx = (int16_t)GetU16(in + 13);
+        ev->dy = (int16_t)GetU16(in + 15);
+    }
+    return true;
+}
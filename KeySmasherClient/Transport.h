@@ -0,0 +1,49 @@
+#pragma once
+
+// Transport interface used by the send pipeline. Portable (no windows.h).
+//
+// A transport is a message-oriented connection with a single send buffer: the owner encodes a
+// frame into SendBuffer(), commits it, and may send the next one once the previous send has
+// completed. Everything is non-blocking; implementations wake their owner on every state change.
+// WsEngine (WinHTTP WebSocket) and UdpEngine (sequenced datagrams) are the Windows implementations;
+// PosixUdpEngine is UdpEngine on BSD sockets.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class TransportState {
+    Idle,
+    Connecting,  // handshake in progress
+    Open,
+    Closing,     // graceful close in progress
+    Closed,      // all resources released
+    Failed,      // connect or send failed; call Abort()
+};
+
+class ITransport {
+public:
+    virtual ~ITransport() {}
+
+    virtual TransportState State() const = 0;
+
+    // Protocol selected by the server during the handshake (empty if none), valid once Open
+    virtual std::string Subprotocol() const = 0;
+
+    // Returns the send buffer if the connection is open and no send is in flight, otherwise nullptr.
+    virtual uint8_t* SendBuffer(size_t* cap) = 0;
+    // Sends the first len bytes of SendBuffer(). Returns false (and moves to Failed) on error.
+    virtual bool CommitSend(size_t len, bool binary) = 0;
+    // number of sends reported complete, and when the latest one completed (MonotonicNs)
+    virtual uint64_t CompletedSends() const = 0;
+    virtual int64_t LastSendCompleteNs() const = 0;
+
+    // Pops the oldest text message received from the server. Returns false if there is none.
+    // The text is copied into *out, so a caller that reuses one string doesn't allocate per message.
+    virtual bool TakeMessage(std::string* out) = 0;
+
+    virtual void Close() = 0;
+    virtual void Abort() = 0;
+    // true once the transport will not call back anymore and may be deleted
+    virtual bool Finished() const = 0;
+};
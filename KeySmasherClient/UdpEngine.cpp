@@ -0,0 +1,229 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include "UdpEngine.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+static uint32_t MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    return us > 0xFFFFFFFFLL ? 0xFFFFFFFFu : (uint32_t)us;
+}
+
+UdpEngine::UdpEngine(HANDLE wakeEvent, WsEngineStats* stats, const UdpOptions& options)
+    : wakeEvent_(wakeEvent), stats_(stats), socket_((uintptr_t)INVALID_SOCKET), session_(options),
+      receiveBuffer_(MAX_DATAGRAM_SIZE) {
+}
+
+UdpEngine::~UdpEngine() {
+    // owner must wait for Finished(); the thread has nothing left to do but return
+    stop_ = true;
+    if (thread_.joinable()) thread_.join();
+}
+
+bool UdpEngine::Start(const std::wstring& host, uint16_t port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    connectStart_ = std::chrono::steady_clock::now();
+    state_ = TransportState::Connecting;
+    try {
+        // name resolution blocks, so it runs on the engine thread like everything else network-bound
+        thread_ = std::thread(&UdpEngine::Run, this, host, port);
+    } catch (...) {
+        FailLocked();
+        finished_.store(true, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+TransportState UdpEngine::State() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+uint8_t* UdpEngine::SendBuffer(size_t* cap) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != TransportState::Open) return nullptr;
+    return session_.SendBuffer(cap);
+}
+
+bool UdpEngine::CommitSend(size_t len, bool binary) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != TransportState::Open) return false;
+    size_t datagramLen = session_.EncodeFrame(len, binary, MonotonicNs());
+    if (datagramLen == 0) {
+        // too long, or not a binary v1 frame: nothing was sent, and the owner must not wait
+        // for a completion that never comes
+        FailLocked();
+        return false;
+    }
+    if (!SendLocked(datagramLen)) return false;
+
+    // nothing to wait for: the datagram is on its way (or lost, which the next one repairs)
+    lastSendCompleteNs_.store(session_.LastDatagramNs(), std::memory_order_relaxed);
+    completedSends_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool UdpEngine::TakeMessage(std::string* out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return session_.TakeMessage(out);
+}
+
+void UdpEngine::Close() {
+    {
+        // there is no close handshake; see UdpSession::EncodeReleaseAll
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ == TransportState::Open && !stop_.load()) {
+            for (size_t i = 0, copies = session_.ReleaseCopies(); i < copies; ++i) {
+                size_t len = session_.EncodeReleaseAll(MonotonicNs());
+                if (len == 0 || !SendLocked(len)) break;
+            }
+        }
+    }
+    Abort();
+}
+
+void UdpEngine::Abort() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_.exchange(true)) return;
+    closeStart_ = std::chrono::steady_clock::now();
+    if (state_ != TransportState::Failed && state_ != TransportState::Closed) state_ = TransportState::Closing;
+    if (!thread_.joinable()) {
+        state_ = TransportState::Closed;
+        finished_.store(true, std::memory_order_release);
+    }
+}
+
+void UdpEngine::Run(std::wstring host, uint16_t port) {
+    WSADATA wsa;
+    bool started = WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+    if (started && Resolve(host, port)) {
+        for (;;) {
+            DWORD waitMs;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stop_.load() || state_ != TransportState::Open) break;
+                waitMs = MaintainLocked();
+            }
+
+            // bounded, so Close()/Abort() are noticed quickly without a wake-up socket
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET((SOCKET)socket_, &readable);
+            timeval timeout = { 0, (long)(waitMs < 50 ? waitMs : 50) * 1000 };
+            int ready = select(0, &readable, NULL, NULL, &timeout);
+            if (ready > 0) ReceiveAll();
+            else if (ready == SOCKET_ERROR) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                FailLocked();
+            }
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(mutex_);
+        FailLocked();
+    }
+
+    // a failed engine stays Failed until the owner has seen it and aborted
+    while (!stop_.load()) Sleep(10);
+
+    // the owner may delete the engine as soon as finished_ is set, so it is the last member touched
+    HANDLE wake = wakeEvent_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if ((SOCKET)socket_ != INVALID_SOCKET) closesocket((SOCKET)socket_);
+        socket_ = (uintptr_t)INVALID_SOCKET;
+        state_ = TransportState::Closed;
+        if (stats_) stats_->lastShutdownUs = MicrosecondsSince(closeStart_);
+    }
+    if (started) WSACleanup();
+    finished_.store(true, std::memory_order_release);
+    if (wake) SetEvent(wake);
+}
+
+bool UdpEngine::Resolve(const std::wstring& host, uint16_t port) {
+    ADDRINFOW hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    wchar_t service[8];
+    _itow_s(port, service, 10);
+    ADDRINFOW* addresses = NULL;
+    if (GetAddrInfoW(host.c_str(), service, &hints, &addresses) != 0) return false;
+
+    // a connected socket only receives from the server and reports an unreachable port
+    SOCKET s = INVALID_SOCKET;
+    for (ADDRINFOW* a = addresses; a && s == INVALID_SOCKET; a = a->ai_next) {
+        s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (s == INVALID_SOCKET) continue;
+        if (connect(s, a->ai_addr, (int)a->ai_addrlen) != 0) {
+            closesocket(s);
+            s = INVALID_SOCKET;
+        }
+    }
+    FreeAddrInfoW(addresses);
+    if (s == INVALID_SOCKET) return false;
+    u_long nonBlocking = 1;
+    ioctlsocket(s, FIONBIO, &nonBlocking);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    socket_ = (uintptr_t)s;
+    if (stop_.load()) return false;
+    session_.Reset();
+    state_ = TransportState::Open;
+    if (stats_) {
+        stats_->lastConnectUs = MicrosecondsSince(connectStart_);
+        stats_->connects.fetch_add(1, std::memory_order_relaxed);
+    }
+    Signal();
+    return true;
+}
+
+void UdpEngine::ReceiveAll() {
+    for (;;) {
+        int n = recv((SOCKET)socket_, (char*)receiveBuffer_.data(), (int)receiveBuffer_.size(), 0);
+        if (n == SOCKET_ERROR) {
+            int err = WSAGetLastError();
+            if (err == WSAEWOULDBLOCK) return;
+            if (err == WSAEMSGSIZE) continue; // oversized datagram, dropped
+            // WSAECONNRESET: the server's port is unreachable (ICMP); reconnect with backoff
+            std::lock_guard<std::mutex> lock(mutex_);
+            FailLocked();
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (session_.OnDatagram(receiveBuffer_.data(), (size_t)n)) Signal();
+    }
+}
+
+// Sends what is due (window repeats, key state). Returns how long until something is due again.
+DWORD UdpEngine::MaintainLocked() {
+    if (state_ != TransportState::Open) return 50;
+    int64_t now = MonotonicNs();
+    while (size_t len = session_.EncodeDue(now)) {
+        if (!SendLocked(len)) return 50;
+    }
+    return session_.WaitMs(now);
+}
+
+bool UdpEngine::SendLocked(size_t len) {
+    int sent = send((SOCKET)socket_, (const char*)session_.Datagram(), (int)len, 0);
+    if (sent == SOCKET_ERROR) {
+        // a full socket buffer just drops the datagram, like the network would
+        if (WSAGetLastError() == WSAEWOULDBLOCK) return true;
+        FailLocked();
+        return false;
+    }
+    return true;
+}
+
+void UdpEngine::FailLocked() {
+    if (state_ == TransportState::Failed || state_ == TransportState::Closed) return;
+    state_ = TransportState::Failed;
+    if (stats_) stats_->failures.fetch_add(1, std::memory_order_relaxed);
+    Signal();
+}
+
+void UdpEngine::Signal() {
+    if (wakeEvent_) SetEvent(wakeEvent_);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// UDP transport: sequenced datagrams with redundant events instead of a TCP stream (see
+// DatagramFormat.h). A lost datagram never delays the ones behind it; the events it carried
+// arrive with the next datagram, or the server resyncs from the periodic key state.
+//
+// The pipeline hands over binary v1 frames as with the WebSocket transport; CommitSend() adds
+// the unacknowledged events of earlier frames and sends the datagram right away, so a send is
+// complete as soon as it returns. A background thread resolves the host, receives acks and ping
+// answers, and sends what UdpSession says is due while the link is quiet (window repeats, key
+// state). Every state change signals wakeEvent. PosixUdpEngine is the same engine on BSD sockets.
+//
+// Lifetime: as with WsEngine, the owner calls Close() or Abort() and may delete the engine only
+// once Finished() returns true. Close() first sends an empty key state (see DatagramSender::
+// EncodeReleaseAll); Abort() just stops.
+
+#include <windows.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DatagramFormat.h"
+#include "LatencyStats.h"
+#include "Transport.h"
+#include "UdpSession.h"
+#include "WsEngine.h"
+
+class UdpEngine : public ITransport {
+public:
+    static const size_t SEND_BUFFER_SIZE = UdpSession::SEND_BUFFER_SIZE;
+    static const size_t MAX_DATAGRAM_SIZE = 2048;  // larger datagrams from the server are truncated and ignored
+
+    // stats are shared with the WebSocket transport (connects, failures, resolve and shutdown times)
+    UdpEngine(HANDLE wakeEvent, WsEngineStats* stats, const UdpOptions& options);
+    ~UdpEngine();
+
+    UdpEngine(const UdpEngine&) = delete;
+    UdpEngine& operator=(const UdpEngine&) = delete;
+
+    // Starts resolving host in the background; returns false if the thread could not be started
+    bool Start(const std::wstring& host, uint16_t port);
+
+    // ITransport
+    TransportState State() const override;
+    std::string Subprotocol() const override { return DATAGRAM_PROTOCOL; }
+    uint8_t* SendBuffer(size_t* cap) override;
+    bool CommitSend(size_t len, bool binary) override;
+    uint64_t CompletedSends() const override { return completedSends_.load(std::memory_order_acquire); }
+    int64_t LastSendCompleteNs() const override { return lastSendCompleteNs_.load(std::memory_order_relaxed); }
+    bool TakeMessage(std::string* out) override;
+    void Close() override;
+    void Abort() override;
+    bool Finished() const override { return finished_.load(std::memory_order_acquire); }
+
+private:
+    void Run(std::wstring host, uint16_t port);
+    bool Resolve(const std::wstring& host, uint16_t port);
+    void ReceiveAll();
+    DWORD MaintainLocked();
+    bool SendLocked(size_t len);
+    void FailLocked();
+    void Signal();
+
+    HANDLE wakeEvent_;
+    WsEngineStats* stats_;
+
+    mutable std::mutex mutex_; // the worker (sends) and the engine thread (receive, repeats)
+    TransportState state_ = TransportState::Idle;
+    uintptr_t socket_;         // SOCKET, owned by the engine thread
+    std::atomic<bool> stop_{ false };
+    std::thread thread_;
+    std::chrono::steady_clock::time_point connectStart_;
+    std::chrono::steady_clock::time_point closeStart_;
+
+    UdpSession session_;
+    std::vector<uint8_t> receiveBuffer_;
+    std::atomic<int64_t> lastSendCompleteNs_{ 0 };
+    std::atomic<uint64_t> completedSends_{ 0 };
+    std::atomic<bool> finished_{ false };
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+// Everything the UDP transport does apart from the socket: turning the frames the pipeline hands
+// over into datagrams, deciding what is due while the link is quiet (window repeats, key state),
+// and queueing the server's messages. Portable (no windows.h); UdpEngine (Winsock) and
+// PosixUdpEngine (BSD sockets) own one each and put its datagrams on the wire.
+// Not thread-safe; the engines serialize access with their mutex.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "DatagramFormat.h"
+#include "KeyEvent.h"
+
+struct UdpOptions {
+    size_t redundancy = 16;             // unacknowledged events repeated in every datagram
+    uint32_t keyStateIntervalMs = 250;  // how often the held keys are sent
+};
+
+class UdpSession {
+public:
+    static const size_t SEND_BUFFER_SIZE = 4096;
+    static const size_t MAX_QUEUED_MESSAGES = 64;
+    static const size_t MESSAGE_RESERVE = 256;
+    static const uint32_t REPEAT_INTERVAL_MS = 20;  // window repeats while the link is quiet...
+    static const int MAX_IDLE_REPEATS = 3;          // ...at most this many times after the last frame
+
+    explicit UdpSession(const UdpOptions& options)
+        : options_(options), sendBuffer_(SEND_BUFFER_SIZE), datagram_(DATAGRAM_HEADER_LEN + 4 + SEND_BUFFER_SIZE + DATAGRAM_TARGET_SIZE) {
+        for (std::string& slot : inbox_) slot.reserve(MESSAGE_RESERVE);
+    }
+
+    // The socket is connected: sequences restart and the first key state is due right away,
+    // telling the server where the connection starts
+    void Reset() {
+        sender_.Reset(options_.redundancy);
+        lastKeysNs_ = 0;
+        idleRepeats_ = MAX_IDLE_REPEATS;
+    }
+
+    uint8_t* SendBuffer(size_t* cap) {
+        *cap = sendBuffer_.size();
+        return sendBuffer_.data();
+    }
+
+    // Turns the first len bytes of SendBuffer() into the next datagram: a binary v1 frame becomes
+    // an events datagram (repeating the unacknowledged events of earlier frames), text a text
+    // datagram. Returns the datagram length, or 0 if the frame is too long or isn't binary v1.
+    size_t EncodeFrame(size_t len, bool binary, int64_t nowNs) {
+        if (len > sendBuffer_.size()) return 0;
+        size_t datagramLen = 0;
+        if (binary) {
+            // back to events, so the datagram can repeat the unacknowledged ones of earlier frames
+            size_t count = 0;
+            if (!DecodeBinaryBatch(sendBuffer_.data(), len, frameEvents_, BINARY_MAX_EVENTS, &count)) return 0;
+            datagramLen = sender_.EncodeEvents(frameEvents_, count, datagram_.data(), datagram_.size());
+            idleRepeats_ = 0;
+        } else {
+            datagramLen = sender_.EncodeText(sendBuffer_.data(), len, datagram_.data(), datagram_.size());
+        }
+        if (datagramLen > 0) lastDatagramNs_ = nowNs;
+        return datagramLen;
+    }
+
+    // Encodes the next datagram that is due at nowNs: a repeat of the unacknowledged window while
+    // the link is quiet (otherwise a lost last datagram would only be repaired by the next key
+    // press), then the periodic key state. Returns 0 once nothing is due.
+    size_t EncodeDue(int64_t nowNs) {
+        if (RepeatPending() && nowNs - lastDatagramNs_ >= RepeatNs()) {
+            idleRepeats_++;
+            size_t len = sender_.EncodeEvents(nullptr, 0, datagram_.data(), datagram_.size());
+            if (len > 0) {
+                lastDatagramNs_ = nowNs;
+                return len;
+            }
+        }
+        if (lastKeysNs_ == 0 || nowNs - lastKeysNs_ >= KeysNs()) {
+            lastKeysNs_ = nowNs;
+            lastDatagramNs_ = nowNs;
+            return sender_.EncodeKeys(datagram_.data(), datagram_.size());
+        }
+        return 0;
+    }
+
+    // How long after nowNs the next datagram is due
+    uint32_t WaitMs(int64_t nowNs) const {
+        int64_t dueNs = lastKeysNs_ + KeysNs();
+        if (RepeatPending() && lastDatagramNs_ + RepeatNs() < dueNs) dueNs = lastDatagramNs_ + RepeatNs();
+        int64_t waitMs = (dueNs - nowNs) / 1000000;
+        return waitMs > 0 ? (uint32_t)waitMs : 0;
+    }
+
+    // An empty key state, sent ReleaseCopies() times when the connection closes: there is no close
+    // handshake, and repeating it as often as events are releases everything on the server even
+    // if some of the copies are lost
+    size_t EncodeReleaseAll(int64_t nowNs) {
+        lastDatagramNs_ = nowNs;
+        return sender_.EncodeReleaseAll(datagram_.data(), datagram_.size());
+    }
+    size_t ReleaseCopies() const { return sender_.Redundancy() > 0 ? sender_.Redundancy() : 1; }
+
+    // The datagram encoded last
+    const uint8_t* Datagram() const { return datagram_.data(); }
+    int64_t LastDatagramNs() const { return lastDatagramNs_; }
+
+    // Handles a datagram from the server. Returns true if a message was queued for TakeMessage().
+    bool OnDatagram(const uint8_t* data, size_t len) {
+        DatagramType type;
+        uint32_t seq;
+        if (!DecodeDatagramHeader(data, len, &type, &seq)) return false;
+        switch (type) {
+        case DatagramType::Ack:
+            if (len >= DATAGRAM_HEADER_LEN + 4) sender_.OnAck(GetU32(data + DATAGRAM_HEADER_LEN));
+            return false;
+        case DatagramType::Text:
+            // the oldest message is dropped when the owner falls behind
+            if (inboxCount_ == MAX_QUEUED_MESSAGES) {
+                inboxHead_ = (inboxHead_ + 1) % MAX_QUEUED_MESSAGES;
+                inboxCount_--;
+            }
+            inbox_[(inboxHead_ + inboxCount_) % MAX_QUEUED_MESSAGES].assign((const char*)data + DATAGRAM_HEADER_LEN, len - DATAGRAM_HEADER_LEN);
+            inboxCount_++;
+            return true;
+        default:
+            // events and key state only flow to the server
+            return false;
+        }
+    }
+
+    bool TakeMessage(std::string* out) {
+        if (inboxCount_ == 0) return false;
+        out->assign(inbox_[inboxHead_]);
+        inboxHead_ = (inboxHead_ + 1) % MAX_QUEUED_MESSAGES;
+        inboxCount_--;
+        return true;
+    }
+
+private:
+    bool RepeatPending() const { return idleRepeats_ < MAX_IDLE_REPEATS && sender_.Unacked() > 0; }
+    static int64_t RepeatNs() { return (int64_t)REPEAT_INTERVAL_MS * 1000000; }
+    int64_t KeysNs() const { return (int64_t)options_.keyStateIntervalMs * 1000000; }
+
+    UdpOptions options_;
+    DatagramSender sender_;
+    std::vector<uint8_t> sendBuffer_;  // the frame from the pipeline
+    std::vector<uint8_t> datagram_;    // what goes on the wire
+    KeyEvent frameEvents_[BINARY_MAX_EVENTS];
+    int64_t lastDatagramNs_ = 0;
+    int64_t lastKeysNs_ = 0;
+    int idleRepeats_ = MAX_IDLE_REPEATS;
+
+    std::string inbox_[MAX_QUEUED_MESSAGES];  // ring of preallocated messages
+    size_t inboxHead_ = 0;
+    size_t inboxCount_ = 0;
+};
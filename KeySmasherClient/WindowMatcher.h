@@ -0,0 +1,185 @@
+#pragma once
+
+// Configurable target window rules, compiled once into a fast matcher.
+// Portable (no windows.h).
+//
+// Rule syntax (one per [Targets] entry in KeySmasherClient.ini):
+//   prefix:Parsec                 window title starts with "Parsec" (case-sensitive)
+//   regex:^Moonlight( - .*)?$     ECMAScript regex searched in the window title
+//   class:TscShellContainerClass  window class name (case-insensitive)
+//   process:steamlink.exe         executable file name of the owning process (case-insensitive)
+// A rule without a "kind:" prefix is treated as a title prefix.
+//
+// Prefix rules share one trie, so a title is checked against all of them in a single pass.
+// Class and process rules are hash lookups; regexes are compiled once and evaluated last.
+
+#include <cstddef>
+#include <cstdint>
+#include <cwctype>
+#include <regex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "FocusTracker.h"
+
+class WindowRuleMatcher : public IWindowMatcher {
+public:
+    WindowRuleMatcher() { nodes_.push_back(Node()); }
+
+    // Parses and compiles one rule. Returns false (with a message in *error) if it is invalid.
+    bool AddRule(const std::wstring& spec, std::wstring* error) {
+        std::wstring kind = L"prefix";
+        std::wstring pattern = spec;
+        size_t colon = spec.find(L':');
+        if (colon != std::wstring::npos) {
+            kind = Lower(spec.substr(0, colon));
+            pattern = spec.substr(colon + 1);
+        }
+        if (pattern.empty()) {
+            if (error) *error = L"empty pattern in rule '" + spec + L"'";
+            return false;
+        }
+
+        if (kind == L"prefix" || kind == L"title") {
+            InsertPrefix(pattern);
+        } else if (kind == L"regex") {
+            try {
+                regexes_.emplace_back(pattern, std::regex_constants::ECMAScript | std::regex_constants::optimize);
+            } catch (const std::regex_error&) {
+                if (error) *error = L"invalid regex in rule '" + spec + L"'";
+                return false;
+            }
+        } else if (kind == L"class") {
+            classes_.insert(Lower(pattern));
+        } else if (kind == L"process") {
+            processes_.insert(Lower(pattern));
+        } else {
+            if (error) *error = L"unknown rule kind '" + kind + L"'";
+            return false;
+        }
+        ruleCount_++;
+        return true;
+    }
+
+    size_t RuleCount() const { return ruleCount_; }
+
+    // Lets the platform layer skip expensive lookups nobody asked for
+    bool NeedsClassName() const { return !classes_.empty(); }
+    bool NeedsProcessName() const { return !processes_.empty(); }
+
+    bool Matches(const WindowInfo& info) const override {
+        if (MatchesPrefix(info.title)) return true;
+        if (!classes_.empty() && classes_.count(Lower(info.className))) return true;
+        if (!processes_.empty() && processes_.count(Lower(info.processName))) return true;
+        for (const std::wregex& re : regexes_) {
+            if (std::regex_search(info.title, re)) return true;
+        }
+        return false;
+    }
+
+    static std::wstring Lower(std::wstring s) {
+        for (wchar_t& c : s) c = (wchar_t)std::towlower(c);
+        return s;
+    }
+
+private:
+    struct Node {
+        std::vector<std::pair<wchar_t, uint32_t>> children; // sorted by character
+        bool terminal = false;
+    };
+
+    void InsertPrefix(const std::wstring& prefix) {
+        uint32_t node = 0;
+        for (wchar_t c : prefix) {
+            auto& children = nodes_[node].children;
+            auto it = children.begin();
+            while (it != children.end() && it->first < c) ++it;
+            if (it != children.end() && it->first == c) {
+                node = it->second;
+                continue;
+            }
+            uint32_t next = (uint32_t)nodes_.size();
+            children.insert(it, std::make_pair(c, next));
+            nodes_.push_back(Node()); // invalidates `children`, not used below
+            node = next;
+        }
+        nodes_[node].terminal = true;
+    }
+
+    bool MatchesPrefix(const std::wstring& title) const {
+        uint32_t node = 0;
+        for (wchar_t c : title) {
+            const auto& children = nodes_[node].children;
+            size_t lo = 0, hi = children.size();
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (children[mid].first < c) lo = mid + 1;
+                else hi = mid;
+            }
+            if (lo == children.size() || children[lo].first != c) return false;
+            node = children[lo].second;
+            if (nodes_[node].terminal) return true;
+        }
+        return false;
+    }
+
+    std::vector<Node> nodes_;
+    std::vector<std::wregex> regexes_;
+    std::unordered_set<std::wstring> classes_;
+    std::unordered_set<std::wstring> processes_;
+    size_t ruleCount_ = 0;
+};
+
+// Small direct-mapped cache of match results keyed by window handle and title, so revisiting
+// a window skips the class/process lookups and the rule evaluation. A recycled handle with the
+// same title would reuse the old result, which is acceptable for focus tracking.
+class WindowMatchCache {
+public:
+    static const size_t SIZE = 64;
+
+    bool Lookup(WindowHandle hwnd, const std::wstring& title, bool* matched) const {
+        const Entry& e = entries_[Slot(hwnd)];
+        if (!e.used || e.hwnd != hwnd || e.titleHash != Hash(title)) return false;
+        *matched = e.matched;
+        return true;
+    }
+
+    void Store(WindowHandle hwnd, const std::wstring& title, bool matched) {
+        Entry& e = entries_[Slot(hwnd)];
+        e.hwnd = hwnd;
+        e.titleHash = Hash(title);
+        e.matched = matched;
+        e.used = true;
+    }
+
+    void Clear() {
+        for (Entry& e : entries_) e.used = false;
+    }
+
+private:
+    struct Entry {
+        WindowHandle hwnd = nullptr;
+        uint64_t titleHash = 0;
+        bool matched = false;
+        bool used = false;
+    };
+
+    static size_t Slot(WindowHandle hwnd) {
+        uintptr_t v = (uintptr_t)hwnd;
+        return (size_t)((v >> 4) ^ (v >> 12)) % SIZE;
+    }
+
+    // FNV-1a
+    static uint64_t Hash(const std::wstring& s) {
+        uint64_t h = 14695981039346656037ull;
+        for (wchar_t c : s) {
+            h ^= (uint64_t)c;
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    Entry entries_[SIZE];
+};
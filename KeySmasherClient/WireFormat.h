@@ -0,0 +1,382 @@
+#pragma once
+
+// Wire encoders for the WebSocket messages sent by WSWorker.
+// Portable (no windows.h) and allocation-free: everything is written into a caller-provided buffer.
+//
+// Text format (one UTF-8 message per frame):
+//   single event   "d65" / "u65"          prefix 'd' = key down, 'u' = key up, followed by the decimal vkCode
+//                  "m12 -3"               mouse motion dx dy (pixels)
+//                  "w-120" / "h120"       vertical / horizontal wheel delta
+//   batch          "d65,u65,d16,u16"      events in capture order separated by ','
+// A batch of one is identical to the single-event message, so servers that split on ','
+// accept both.
+//
+// Binary format v1 (one binary message per frame, little-endian, negotiated at connect time
+// through the "keysmasher.bin.1" WebSocket subprotocol):
+//   header   u8 version (=1) | u8 event count | u32 base time (KeyEvent::time of the first event)
+//   record   u8 type | 4 bytes payload | u16 time delta to the previous event (ms)
+//   key      u8 type (0 down, 1 up) | u8 vkCode | u16 scanCode | u8 flags | u16 delta
+//   motion   u8 type (2) | i16 dx | i16 dy | u16 delta
+//   wheel    u8 type (3 vertical, 4 horizontal) | i16 delta | u16 0 | u16 delta
+// Records are fixed-size, so decoders can skip types they don't know.
+// Deltas larger than 65535 ms are saturated, so decoded times are exact only within that range.
+//
+// Compact binary format v2 (subprotocol "keysmasher.bin.2", for bandwidth-constrained links):
+//   header   u8 version (=2) | u8 event count | varint base time
+//   record   u8 tag | varint time delta (ms) | payload
+//   tag      bits 0-2 type | bit 3 explicit scan code / flags (keys) | bits 4-7 key dictionary index
+//   key      [u8 vkCode if dictionary index is 0] [varint scanCode | u8 flags if bit 3 is set]
+//            without bit 3 the scan code is the one of this key's previous record in the frame (0 for
+//            the first) and the flags are that record's with the LLKHF_UP bit (0x80) matching the type
+//   motion   zigzag varint dx | zigzag varint dy
+//   wheel    zigzag varint delta
+// varint = unsigned LEB128; zigzag maps 0, -1, 1, -2 ... to 0, 1, 2, 3 ... A typical key event
+// costs 2-3 bytes instead of 7. Records are variable-size, so unknown types end decoding.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "KeyEvent.h"
+
+// longest text event is "m-32768 -32768" plus the ',' separator
+const size_t TEXT_EVENT_MAX_LEN = 15;
+
+inline size_t AppendTextKey(char* out, size_t cap, KeyEventType type, uint8_t vkCode) {
+    char tmp[TEXT_EVENT_MAX_LEN];
+    size_t n = 0;
+    tmp[n++] = (type == KeyEventType::Down) ? 'd' : 'u';
+    if (vkCode >= 100) tmp[n++] = (char)('0' + vkCode / 100);
+    if (vkCode >= 10) tmp[n++] = (char)('0' + (vkCode / 10) % 10);
+    tmp[n++] = (char)('0' + vkCode % 10);
+    if (n > cap) return 0;
+    for (size_t i = 0; i < n; ++i) out[i] = tmp[i];
+    return n;
+}
+
+// Appends a signed decimal. Returns the length, or 0 if it doesn't fit.
+inline size_t AppendTextInt(char* out, size_t cap, int v) {
+    char tmp[8];
+    size_t n = 0;
+    unsigned u = v < 0 ? (unsigned)(-v) : (unsigned)v;
+    do { tmp[n++] = (char)('0' + u % 10); u /= 10; } while (u);
+    if (v < 0) tmp[n++] = '-';
+    if (n > cap) return 0;
+    for (size_t i = 0; i < n; ++i) out[i] = tmp[n - 1 - i];
+    return n;
+}
+
+// Appends one event in text form. Returns the length, or 0 if it doesn't fit.
+inline size_t AppendTextEvent(char* out, size_t cap, const KeyEvent& ev) {
+    if (IsKeyTransition(ev)) return AppendTextKey(out, cap, ev.type, ev.vkCode);
+    if (cap < 2) return 0;
+    out[0] = ev.type == KeyEventType::MouseMove ? 'm' : ev.type == KeyEventType::MouseWheel ? 'w' : 'h';
+    size_t len = 1;
+    size_t n = AppendTextInt(out + len, cap - len, ev.dx);
+    if (n == 0) return 0;
+    len += n;
+    if (ev.type == KeyEventType::MouseMove) {
+        if (len >= cap) return 0;
+        out[len++] = ' ';
+        n = AppendTextInt(out + len, cap - len, ev.dy);
+        if (n == 0) return 0;
+        len += n;
+    }
+    return len;
+}
+
+// Encodes count events as a text batch. Returns the number of bytes written,
+// or 0 if the buffer is too small (cap >= count * TEXT_EVENT_MAX_LEN always fits).
+inline size_t EncodeTextBatch(const KeyEvent* events, size_t count, char* out, size_t cap) {
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            if (len >= cap) return 0;
+            out[len++] = ',';
+        }
+        size_t n = AppendTextEvent(out + len, cap - len, events[i]);
+        if (n == 0) return 0;
+        len += n;
+    }
+    return len;
+}
+
+const char* const WIRE_SUBPROTOCOL_COMPACT = "keysmasher.bin.2";
+const char* const WIRE_SUBPROTOCOL_BINARY = "keysmasher.bin.1";
+const char* const WIRE_SUBPROTOCOL_TEXT = "keysmasher.text";
+
+// How frames are encoded on a connection, from the negotiated subprotocol
+enum class WireEncoding : uint8_t {
+    Text,
+    Binary,   // v1
+    Compact,  // v2
+};
+
+inline bool IsBinaryEncoding(WireEncoding encoding) {
+    return encoding != WireEncoding::Text;
+}
+
+const uint8_t BINARY_WIRE_VERSION = 1;
+const size_t BINARY_HEADER_LEN = 6;
+const size_t BINARY_RECORD_LEN = 7;
+const size_t BINARY_MAX_EVENTS = 255;
+
+inline void PutU16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+inline void PutU32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+inline uint16_t GetU16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t GetU32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline size_t BinaryFrameSize(size_t count) {
+    return BINARY_HEADER_LEN + count * BINARY_RECORD_LEN;
+}
+
+// Encodes up to BINARY_MAX_EVENTS events as one binary frame. Returns the number of bytes
+// written, or 0 if count is out of range or the buffer is too small.
+inline size_t EncodeBinaryBatch(const KeyEvent* events, size_t count, uint8_t* out, size_t cap) {
+    if (count == 0 || count > BINARY_MAX_EVENTS || cap < BinaryFrameSize(count)) return 0;
+
+    out[0] = BINARY_WIRE_VERSION;
+    out[1] = (uint8_t)count;
+    PutU32(out + 2, events[0].time);
+
+    uint8_t* rec = out + BINARY_HEADER_LEN;
+    uint32_t prev = events[0].time;
+    for (size_t i = 0; i < count; ++i, rec += BINARY_RECORD_LEN) {
+        const KeyEvent& ev = events[i];
+        uint32_t delta = ev.time - prev; // modular, KBDLLHOOKSTRUCT::time wraps after ~49 days
+        prev = ev.time;
+        rec[0] = (uint8_t)ev.type;
+        if (IsKeyTransition(ev)) {
+            rec[1] = ev.vkCode;
+            PutU16(rec + 2, ev.scanCode);
+            rec[4] = ev.flags;
+        } else {
+            PutU16(rec + 1, (uint16_t)ev.dx);
+            PutU16(rec + 3, ev.type == KeyEventType::MouseMove ? (uint16_t)ev.dy : (uint16_t)0);
+        }
+        PutU16(rec + 5, delta > 0xFFFF ? (uint16_t)0xFFFF : (uint16_t)delta);
+    }
+    return BinaryFrameSize(count);
+}
+
+// Decodes a binary frame produced by EncodeBinaryBatch. Records of unknown types are skipped
+// (their time delta still counts). Returns false on a malformed frame, an unknown version or
+// if cap is smaller than the event count.
+inline bool DecodeBinaryBatch(const uint8_t* data, size_t len, KeyEvent* out, size_t cap, size_t* count) {
+    if (len < BINARY_HEADER_LEN || data[0] != BINARY_WIRE_VERSION) return false;
+    size_t n = data[1];
+    if (n == 0 || n > cap || len != BinaryFrameSize(n)) return false;
+
+    const uint8_t* rec = data + BINARY_HEADER_LEN;
+    uint32_t time = GetU32(data + 2);
+    size_t decoded = 0;
+    for (size_t i = 0; i < n; ++i, rec += BINARY_RECORD_LEN) {
+        time += GetU16(rec + 5);
+        if (rec[0] > (uint8_t)KeyEventType::MouseHWheel) continue;
+        KeyEvent& ev = out[decoded++];
+        ev = KeyEvent();
+        ev.time = time;
+        ev.type = (KeyEventType)rec[0];
+        if (IsKeyTransition(ev)) {
+            ev.vkCode = rec[1];
+            ev.scanCode = GetU16(rec + 2);
+            ev.flags = rec[4];
+        } else {
+            ev.dx = (int16_t)GetU16(rec + 1);
+            if (ev.type == KeyEventType::MouseMove) ev.dy = (int16_t)GetU16(rec + 3);
+        }
+    }
+    *count = decoded;
+    return true;
+}
+
+const uint8_t COMPACT_WIRE_VERSION = 2;
+const size_t COMPACT_HEADER_MAX_LEN = 7;
+const size_t COMPACT_RECORD_MAX_LEN = 12; // tag + 5-byte delta + two 3-byte zigzag deltas
+const uint8_t COMPACT_EXPLICIT_SCAN = 0x08;
+const uint8_t KEY_FLAG_UP = 0x80;         // LLKHF_UP
+const uint8_t KEY_FLAG_EXTENDED = 0x01;   // LLKHF_EXTENDED
+
+// Keys that get a one-byte record: movement, modifiers and mouse buttons of typical games.
+// Index 0 is unused (it means "vkCode follows").
+const uint8_t COMPACT_KEY_DICTIONARY[16] = {
+    0, 'W', 'A', 'S', 'D', 0x20 /* space */, 0xA0 /* left shift */, 0xA2 /* left ctrl */,
+    0x01 /* left button */, 0x02 /* right button */, 'E', 'Q', 'R', 'F', 0x09 /* tab */, 0x1B /* esc */,
+};
+
+inline size_t CompactFrameMaxSize(size_t count) {
+    return COMPACT_HEADER_MAX_LEN + count * COMPACT_RECORD_MAX_LEN;
+}
+
+inline size_t PutVarint(uint8_t* p, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+// Reads a varint from [p, end). Returns the number of bytes read, or 0 if truncated or too long.
+inline size_t GetVarint(const uint8_t* p, const uint8_t* end, uint32_t* v) {
+    uint32_t result = 0;
+    for (size_t n = 0; n < 5 && p + n < end; ++n) {
+        result |= (uint32_t)(p[n] & 0x7F) << (7 * n);
+        if (!(p[n] & 0x80)) {
+            *v = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+inline uint32_t ZigZag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t UnZigZag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+inline uint8_t CompactDictionaryIndex(uint8_t vk) {
+    for (uint8_t i = 1; i < 16; ++i) {
+        if (COMPACT_KEY_DICTIONARY[i] == vk) return i;
+    }
+    return 0;
+}
+
+// Scan code and flags a decoder assumes for a key record without explicit ones
+struct CompactKeyPrediction {
+    uint16_t scanCode[256];
+    uint8_t flags[256];
+
+    CompactKeyPrediction() {
+        for (size_t i = 0; i < 256; ++i) { scanCode[i] = 0; flags[i] = 0; }
+    }
+
+    uint8_t Flags(const KeyEvent& ev) const {
+        uint8_t f = flags[ev.vkCode];
+        return ev.type == KeyEventType::Up ? (uint8_t)(f | KEY_FLAG_UP) : (uint8_t)(f & ~KEY_FLAG_UP);
+    }
+
+    void Update(const KeyEvent& ev) {
+        scanCode[ev.vkCode] = ev.scanCode;
+        flags[ev.vkCode] = ev.flags;
+    }
+};
+
+// Encodes up to BINARY_MAX_EVENTS events as one compact frame. Returns the number of bytes
+// written, or 0 if count is out of range or the buffer is too small
+// (cap >= CompactFrameMaxSize(count) always fits).
+inline size_t EncodeCompactBatch(const KeyEvent* events, size_t count, uint8_t* out, size_t cap) {
+    if (count == 0 || count > BINARY_MAX_EVENTS || cap < CompactFrameMaxSize(count)) return 0;
+
+    size_t len = 0;
+    out[len++] = COMPACT_WIRE_VERSION;
+    out[len++] = (uint8_t)count;
+    len += PutVarint(out + len, events[0].time);
+
+    CompactKeyPrediction predicted;
+    uint32_t prev = events[0].time;
+    for (size_t i = 0; i < count; ++i) {
+        const KeyEvent& ev = events[i];
+        uint8_t* tag = out + len++;
+        *tag = (uint8_t)ev.type;
+        len += PutVarint(out + len, ev.time - prev); // modular, like v1
+        prev = ev.time;
+        if (IsKeyTransition(ev)) {
+            uint8_t index = CompactDictionaryIndex(ev.vkCode);
+            *tag |= (uint8_t)(index << 4);
+            if (index == 0) out[len++] = ev.vkCode;
+            if (ev.scanCode != predicted.scanCode[ev.vkCode] || ev.flags != predicted.Flags(ev)) {
+                *tag |= COMPACT_EXPLICIT_SCAN;
+                len += PutVarint(out + len, ev.scanCode);
+                out[len++] = ev.flags;
+            }
+            predicted.Update(ev);
+        } else {
+            len += PutVarint(out + len, ZigZag(ev.dx));
+            if (ev.type == KeyEventType::MouseMove) len += PutVarint(out + len, ZigZag(ev.dy));
+        }
+    }
+    return len;
+}
+
+// Decodes a frame produced by EncodeCompactBatch. Returns false on a malformed or truncated frame,
+// an unknown version or record type, or if cap is smaller than the event count.
+inline bool DecodeCompactBatch(const uint8_t* data, size_t len, KeyEvent* out, size_t cap, size_t* count) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    if (len < 3 || p[0] != COMPACT_WIRE_VERSION) return false;
+    size_t n = p[1];
+    if (n == 0 || n > cap) return false;
+    p += 2;
+    uint32_t time = 0;
+    size_t used = GetVarint(p, end, &time);
+    if (used == 0) return false;
+    p += used;
+
+    CompactKeyPrediction predicted;
+    for (size_t i = 0; i < n; ++i) {
+        if (p >= end) return false;
+        uint8_t tag = *p++;
+        uint32_t delta = 0;
+        if ((used = GetVarint(p, end, &delta)) == 0) return false;
+        p += used;
+        time += delta;
+
+        KeyEvent& ev = out[i];
+        ev = KeyEvent();
+        ev.time = time;
+        if ((tag & 0x07) > (uint8_t)KeyEventType::MouseHWheel) return false;
+        ev.type = (KeyEventType)(tag & 0x07);
+        if (IsKeyTransition(ev)) {
+            uint8_t index = (uint8_t)(tag >> 4);
+            if (index != 0) {
+                ev.vkCode = COMPACT_KEY_DICTIONARY[index];
+            } else {
+                if (p >= end) return false;
+                ev.vkCode = *p++;
+            }
+            if (tag & COMPACT_EXPLICIT_SCAN) {
+                uint32_t scan = 0;
+                if ((used = GetVarint(p, end, &scan)) == 0 || scan > 0xFFFF || p + used >= end) return false;
+                p += used;
+                ev.scanCode = (uint16_t)scan;
+                ev.flags = *p++;
+            } else {
+                ev.scanCode = predicted.scanCode[ev.vkCode];
+                ev.flags = predicted.Flags(ev);
+            }
+            predicted.Update(ev);
+        } else {
+            uint32_t v = 0;
+            if ((used = GetVarint(p, end, &v)) == 0) return false;
+            p += used;
+            ev.dx = (int16_t)UnZigZag(v);
+            if (ev.type == KeyEventType::MouseMove) {
+                if ((used = GetVarint(p, end, &v)) == 0) return false;
+                p += used;
+                ev.dy = (int16_t)UnZigZag(v);
+            }
+        }
+    }
+    if (p != end) return false;
+    *count = n;
+    return true;
+}
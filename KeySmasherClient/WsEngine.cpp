@@ -0,0 +1,302 @@
+#include "WsEngine.h"
+
+#ifndef WINHTTP_WEB_SOCKET_SUCCESS_CLOSE
+#define WINHTTP_WEB_SOCKET_SUCCESS_CLOSE 1000
+#endif
+
+static uint32_t MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    return us > 0xFFFFFFFFLL ? 0xFFFFFFFFu : (uint32_t)us;
+}
+
+WsEngine::WsEngine(HANDLE wakeEvent, WsEngineStats* stats)
+    : wakeEvent_(wakeEvent), stats_(stats), sendBuffer_(SEND_BUFFER_SIZE), receiveBuffer_(RECEIVE_BUFFER_SIZE) {
+    // everything the receive path needs is allocated here, so messages don't allocate once open
+    partialMessage_.reserve(MESSAGE_RESERVE);
+    for (std::string& slot : inbox_) slot.reserve(MESSAGE_RESERVE);
+}
+
+WsEngine::~WsEngine() {
+    // owner must wait for Finished(); anything still open here is closed without callbacks
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (hSession_) WinHttpSetStatusCallback(hSession_, NULL, 0, 0);
+}
+
+bool WsEngine::Start(const std::wstring& host, INTERNET_PORT port, const std::wstring& path, const std::wstring& extraHeaders) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    connectStart_ = std::chrono::steady_clock::now();
+    state_ = TransportState::Connecting;
+
+    hSession_ = WinHttpOpen(L"KeySmasherClient/1.0",
+        WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+        WINHTTP_NO_PROXY_NAME,
+        WINHTTP_NO_PROXY_BYPASS, WINHTTP_FLAG_ASYNC);
+    if (!hSession_) { FailLocked(); return false; }
+
+    // callbacks are inherited by the connect, request and websocket handles created below
+    if (WinHttpSetStatusCallback(hSession_, StatusCallback,
+            WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS | WINHTTP_CALLBACK_FLAG_HANDLES, 0) == WINHTTP_INVALID_STATUS_CALLBACK
+        || !TrackHandle(hSession_)) {
+        WinHttpCloseHandle(hSession_);
+        hSession_ = NULL;
+        FailLocked();
+        return false;
+    }
+
+    // timeouts still bound every asynchronous step
+    WinHttpSetTimeouts(hSession_, 3000, 3000, 3000, 3000);
+
+    hConnect_ = WinHttpConnect(hSession_, host.c_str(), port, 0);
+    if (!hConnect_ || !TrackHandle(hConnect_)) { FailLocked(); return false; }
+
+    hRequest_ = WinHttpOpenRequest(
+        hConnect_, L"GET", path.c_str(),
+        NULL, WINHTTP_NO_REFERER,
+        WINHTTP_DEFAULT_ACCEPT_TYPES,
+        0);
+    if (!hRequest_ || !TrackHandle(hRequest_)) { FailLocked(); return false; }
+
+    if (!WinHttpSetOption(hRequest_, WINHTTP_OPTION_UPGRADE_TO_WEB_SOCKET, NULL, 0)) { FailLocked(); return false; }
+
+    if (!extraHeaders.empty()) {
+        WinHttpAddRequestHeaders(hRequest_, extraHeaders.c_str(), (DWORD)-1L, WINHTTP_ADDREQ_FLAG_ADD);
+    }
+
+    if (!WinHttpSendRequest(hRequest_,
+            WINHTTP_NO_ADDITIONAL_HEADERS, 0,
+            WINHTTP_NO_REQUEST_DATA, 0,
+            0, (DWORD_PTR)this)) {
+        FailLocked();
+        return false;
+    }
+    return true;
+}
+
+TransportState WsEngine::State() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return state_;
+}
+
+std::string WsEngine::Subprotocol() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return subprotocol_;
+}
+
+uint8_t* WsEngine::SendBuffer(size_t* cap) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (state_ != TransportState::Open || sendInFlight_) return nullptr;
+    *cap = sendBuffer_.size();
+    return sendBuffer_.data();
+}
+
+bool WsEngine::CommitSend(size_t len, bool binary) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (state_ != TransportState::Open || sendInFlight_ || len > sendBuffer_.size()) return false;
+
+    // set before the call: the completion may be delivered before WinHttpWebSocketSend returns
+    sendInFlight_ = true;
+    DWORD err = WinHttpWebSocketSend(hWebSocket_,
+        binary ? WINHTTP_WEB_SOCKET_BINARY_MESSAGE_BUFFER_TYPE : WINHTTP_WEB_SOCKET_UTF8_MESSAGE_BUFFER_TYPE,
+        sendBuffer_.data(),
+        (DWORD)len);
+    if (err != ERROR_SUCCESS) {
+        sendInFlight_ = false;
+        FailLocked();
+        return false;
+    }
+    return true;
+}
+
+bool WsEngine::TakeMessage(std::string* out) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (inboxCount_ == 0) return false;
+    out->assign(inbox_[inboxHead_]);
+    inboxHead_ = (inboxHead_ + 1) % MAX_QUEUED_MESSAGES;
+    inboxCount_--;
+    return true;
+}
+
+void WsEngine::Close() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (closeRequested_) return;
+    closeRequested_ = true;
+    closeStart_ = std::chrono::steady_clock::now();
+
+    if (state_ == TransportState::Open) {
+        state_ = TransportState::Closing;
+        // completes with WINHTTP_CALLBACK_STATUS_CLOSE_COMPLETE (or REQUEST_ERROR)
+        if (WinHttpWebSocketClose(hWebSocket_, WINHTTP_WEB_SOCKET_SUCCESS_CLOSE, NULL, 0) == ERROR_SUCCESS) return;
+    }
+    CloseHandlesLocked();
+}
+
+void WsEngine::Abort() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (!closeRequested_) {
+        closeRequested_ = true;
+        closeStart_ = std::chrono::steady_clock::now();
+    }
+    CloseHandlesLocked();
+}
+
+void CALLBACK WsEngine::StatusCallback(HINTERNET hInternet, DWORD_PTR context, DWORD status, LPVOID info, DWORD infoLength) {
+    WsEngine* self = (WsEngine*)context;
+    if (self) self->OnStatus(hInternet, status, info);
+}
+
+void WsEngine::OnStatus(HINTERNET hInternet, DWORD status, LPVOID info) {
+    if (status == WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING) {
+        // last callback for this handle; once the count reaches zero the owner may delete us,
+        // so finished_ is the final member touched
+        HANDLE wake = wakeEvent_;
+        bool last = false;
+        {
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
+            last = (--openHandles_ == 0);
+            if (last) {
+                state_ = TransportState::Closed;
+                if (stats_) stats_->lastShutdownUs = MicrosecondsSince(closeStart_);
+            }
+        }
+        if (last) finished_.store(true, std::memory_order_release);
+        if (wake) SetEvent(wake);
+        return;
+    }
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        switch (status) {
+        case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+            if (hInternet == hRequest_ && state_ == TransportState::Connecting) {
+                if (!WinHttpReceiveResponse(hRequest_, NULL)) FailLocked();
+            }
+            break;
+        case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+            if (hInternet == hRequest_ && state_ == TransportState::Connecting) OnHeadersAvailableLocked();
+            break;
+        case WINHTTP_CALLBACK_STATUS_WRITE_COMPLETE:
+            if (hInternet == hWebSocket_ && sendInFlight_) {
+                lastSendCompleteNs_.store(MonotonicNs(), std::memory_order_relaxed);
+                completedSends_.fetch_add(1, std::memory_order_release);
+                sendInFlight_ = false;
+            }
+            break;
+        case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+            if (hInternet == hWebSocket_ && info) OnReadCompleteLocked((const WINHTTP_WEB_SOCKET_STATUS*)info);
+            break;
+        case WINHTTP_CALLBACK_STATUS_CLOSE_COMPLETE:
+            if (hInternet == hWebSocket_) CloseHandlesLocked();
+            break;
+        case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+            sendInFlight_ = false;
+            if (state_ == TransportState::Closing) CloseHandlesLocked();
+            else FailLocked();
+            break;
+        default:
+            return;
+        }
+    }
+    Signal();
+}
+
+bool WsEngine::TrackHandle(HINTERNET h) {
+    DWORD_PTR context = (DWORD_PTR)this;
+    if (!WinHttpSetOption(h, WINHTTP_OPTION_CONTEXT_VALUE, &context, sizeof(context))) return false;
+    openHandles_++;
+    return true;
+}
+
+void WsEngine::OnHeadersAvailableLocked() {
+    wchar_t buf[64] = {};
+    DWORD size = sizeof(buf);
+    if (WinHttpQueryHeaders(hRequest_, WINHTTP_QUERY_CUSTOM, L"Sec-WebSocket-Protocol", buf, &size, WINHTTP_NO_HEADER_INDEX)) {
+        // subprotocol tokens are ASCII
+        subprotocol_.clear();
+        for (const wchar_t* c = buf; *c; ++c) subprotocol_.push_back((char)*c);
+    }
+
+    hWebSocket_ = WinHttpWebSocketCompleteUpgrade(hRequest_, (DWORD_PTR)this);
+    if (!hWebSocket_) { FailLocked(); return; }
+    openHandles_++; // context was passed to CompleteUpgrade
+
+    // the request handle is no longer needed once upgraded
+    WinHttpCloseHandle(hRequest_);
+    hRequest_ = NULL;
+
+    state_ = TransportState::Open;
+    if (stats_) {
+        stats_->lastConnectUs = MicrosecondsSince(connectStart_);
+        stats_->connects.fetch_add(1, std::memory_order_relaxed);
+    }
+    StartReceiveLocked();
+}
+
+void WsEngine::StartReceiveLocked() {
+    if (state_ != TransportState::Open) return;
+    // asynchronous: the result arrives as WINHTTP_CALLBACK_STATUS_READ_COMPLETE
+    DWORD err = WinHttpWebSocketReceive(hWebSocket_, receiveBuffer_.data(), (DWORD)receiveBuffer_.size(), &receivedBytes_, &receivedType_);
+    if (err != ERROR_SUCCESS) FailLocked();
+}
+
+void WsEngine::OnReadCompleteLocked(const WINHTTP_WEB_SOCKET_STATUS* status) {
+    switch (status->eBufferType) {
+    case WINHTTP_WEB_SOCKET_CLOSE_BUFFER_TYPE:
+        // server closed the connection; if we are closing ourselves CLOSE_COMPLETE follows
+        if (state_ == TransportState::Open) FailLocked();
+        return;
+    case WINHTTP_WEB_SOCKET_UTF8_FRAGMENT_BUFFER_TYPE:
+    case WINHTTP_WEB_SOCKET_UTF8_MESSAGE_BUFFER_TYPE:
+        if (!discardingMessage_) {
+            if (partialMessage_.size() + status->dwBytesTransferred > MAX_MESSAGE_SIZE) {
+                discardingMessage_ = true;
+                partialMessage_.clear();
+            } else {
+                partialMessage_.append((const char*)receiveBuffer_.data(), status->dwBytesTransferred);
+            }
+        }
+        if (status->eBufferType == WINHTTP_WEB_SOCKET_UTF8_MESSAGE_BUFFER_TYPE) {
+            if (!discardingMessage_) {
+                if (inboxCount_ == MAX_QUEUED_MESSAGES) {
+                    inboxHead_ = (inboxHead_ + 1) % MAX_QUEUED_MESSAGES;
+                    inboxCount_--;
+                }
+                inbox_[(inboxHead_ + inboxCount_) % MAX_QUEUED_MESSAGES].assign(partialMessage_);
+                inboxCount_++;
+            }
+            partialMessage_.clear();
+            discardingMessage_ = false;
+        }
+        break;
+    default:
+        // binary messages from the server are not part of the protocol; ignore them
+        break;
+    }
+    StartReceiveLocked();
+}
+
+void WsEngine::FailLocked() {
+    if (state_ == TransportState::Failed || state_ == TransportState::Closed) return;
+    state_ = TransportState::Failed;
+    if (stats_) stats_->failures.fetch_add(1, std::memory_order_relaxed);
+    Signal();
+}
+
+void WsEngine::CloseHandlesLocked() {
+    if (state_ != TransportState::Closed && state_ != TransportState::Failed) state_ = TransportState::Closing;
+
+    // closing a handle cancels its pending operations; HANDLE_CLOSING follows for each one
+    HINTERNET handles[] = { hWebSocket_, hRequest_, hConnect_, hSession_ };
+    hWebSocket_ = hRequest_ = hConnect_ = hSession_ = NULL;
+    for (HINTERNET h : handles) {
+        if (h) WinHttpCloseHandle(h);
+    }
+
+    if (openHandles_ == 0) {
+        state_ = TransportState::Closed;
+        finished_.store(true, std::memory_order_release);
+    }
+}
+
+void WsEngine::Signal() {
+    if (wakeEvent_) SetEvent(wakeEvent_);
+}
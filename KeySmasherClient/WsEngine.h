@@ -0,0 +1,106 @@
+#pragma once
+
+// Event-driven WebSocket connection built on WinHTTP's asynchronous mode.
+//
+// Start() only kicks off the handshake; every further step (send request -> receive
+// response -> upgrade -> open) runs from WinHTTP status callbacks on its own thread pool.
+// Sends are asynchronous too: the worker encodes straight into SendBuffer() and calls
+// CommitSend(), and the buffer becomes available again once WinHTTP reports the write
+// as complete. Once open, a receive is kept pending at all times: text messages from the
+// server are queued for TakeMessage() and a server-initiated close moves the engine to Failed.
+// Every state change signals wakeEvent, so the owner never blocks on the network.
+//
+// Lifetime: the owner calls Close() (graceful) or Abort() (immediate) and may delete the
+// engine only once Finished() returns true, i.e. WinHTTP has closed every handle and will
+// not call back again.
+
+#include <windows.h>
+#include <winhttp.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "LatencyStats.h"
+#include "Transport.h"
+
+// Shared counters that outlive individual engines.
+struct WsEngineStats {
+    std::atomic<uint32_t> lastConnectUs{ 0 };   // Start() -> Open
+    std::atomic<uint32_t> lastShutdownUs{ 0 };  // Close()/Abort() -> all handles closed
+    std::atomic<uint64_t> connects{ 0 };
+    std::atomic<uint64_t> failures{ 0 };
+};
+
+class WsEngine : public ITransport {
+public:
+    static const size_t SEND_BUFFER_SIZE = 4096;
+    static const size_t RECEIVE_BUFFER_SIZE = 1024;
+    static const size_t MAX_MESSAGE_SIZE = 64 * 1024;  // larger incoming messages are discarded
+    static const size_t MAX_QUEUED_MESSAGES = 64;      // oldest are dropped when the owner falls behind
+    static const size_t MESSAGE_RESERVE = 256;         // preallocated per queued message; longer ones allocate
+
+    WsEngine(HANDLE wakeEvent, WsEngineStats* stats);
+    ~WsEngine();
+
+    WsEngine(const WsEngine&) = delete;
+    WsEngine& operator=(const WsEngine&) = delete;
+
+    // extraHeaders may be empty; returns false if the handshake could not even be started
+    bool Start(const std::wstring& host, INTERNET_PORT port, const std::wstring& path, const std::wstring& extraHeaders);
+
+    // ITransport
+    TransportState State() const override;
+    std::string Subprotocol() const override;  // Sec-WebSocket-Protocol of the upgrade response
+    uint8_t* SendBuffer(size_t* cap) override;
+    bool CommitSend(size_t len, bool binary) override;
+    uint64_t CompletedSends() const override { return completedSends_.load(std::memory_order_acquire); }
+    int64_t LastSendCompleteNs() const override { return lastSendCompleteNs_.load(std::memory_order_relaxed); }
+    bool TakeMessage(std::string* out) override;
+    void Close() override;
+    void Abort() override;
+    bool Finished() const override { return finished_.load(std::memory_order_acquire); }
+
+private:
+    static void CALLBACK StatusCallback(HINTERNET hInternet, DWORD_PTR context, DWORD status, LPVOID info, DWORD infoLength);
+    void OnStatus(HINTERNET hInternet, DWORD status, LPVOID info);
+
+    bool TrackHandle(HINTERNET h);
+    void OnHeadersAvailableLocked();
+    void OnReadCompleteLocked(const WINHTTP_WEB_SOCKET_STATUS* status);
+    void StartReceiveLocked();
+    void FailLocked();
+    void CloseHandlesLocked();
+    void Signal();
+
+    HANDLE wakeEvent_;
+    WsEngineStats* stats_;
+
+    mutable std::recursive_mutex mutex_; // WinHTTP may invoke callbacks synchronously from inside its API calls
+    TransportState state_ = TransportState::Idle;
+    HINTERNET hSession_ = NULL;
+    HINTERNET hConnect_ = NULL;
+    HINTERNET hRequest_ = NULL;
+    HINTERNET hWebSocket_ = NULL;
+    int openHandles_ = 0;
+    bool closeRequested_ = false;
+    bool sendInFlight_ = false;
+    std::string subprotocol_;
+    std::chrono::steady_clock::time_point connectStart_;
+    std::chrono::steady_clock::time_point closeStart_;
+    std::atomic<int64_t> lastSendCompleteNs_{ 0 };
+    std::atomic<uint64_t> completedSends_{ 0 };
+
+    std::vector<uint8_t> sendBuffer_;
+    std::vector<uint8_t> receiveBuffer_;
+    DWORD receivedBytes_ = 0;                     // reported through READ_COMPLETE in async mode
+    WINHTTP_WEB_SOCKET_BUFFER_TYPE receivedType_ = WINHTTP_WEB_SOCKET_UTF8_MESSAGE_BUFFER_TYPE;
+    std::string partialMessage_;
+    bool discardingMessage_ = false;
+    std::string inbox_[MAX_QUEUED_MESSAGES];      // ring of preallocated messages
+    size_t inboxHead_ = 0;
+    size_t inboxCount_ = 0;
+    std::atomic<bool> finished_{ false };
+};
@@ -5,28 +5,46 @@
 #include <windows.h>
 #include <shellapi.h>
 #include <winhttp.h>
+#include <cstdarg>
+#include <cstring>
 #include <string>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <queue>
 #include <atomic>
 #include <memory>
 #include <chrono>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
+#include <algorithm>
 
 #include "resource.h"
-
-#ifndef WINHTTP_WEB_SOCKET_SUCCESS_CLOSE
-#define WINHTTP_WEB_SOCKET_SUCCESS_CLOSE 1000
+#include "AllocStats.h"
+#include "ClientConfig.h"
+#include "KeyEvent.h"
+#include "SpscRing.h"
+#include "WireFormat.h"
+#include "WsEngine.h"
+#include "UdpEngine.h"
+#include "Reconnect.h"
+#include "LatencyStats.h"
+#include "ClockSync.h"
+#include "FocusTracker.h"
+#include "WindowMatcher.h"
+#include "InputSource.h"
+#include "KeyState.h"
+#include "EventFilter.h"
+#include "EventLog.h"
+#include "TraceFile.h"
+#include "SendPipeline.h"
+#include "TitleIndicator.h"
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION // SDKs before 10.0.17134
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
 #endif
 
 #pragma comment(lib, "winhttp.lib")
 #pragma comment(linker, "/SUBSYSTEM:WINDOWS")
 
-HHOOK keyboardHook;
+HHOOK keyboardHook; // owned by the input thread
+HHOOK mouseHook = NULL; // owned by the input thread, only with CAPTURE_MOUSE
 HWND lastForeground = nullptr;
 HWND g_hWnd = NULL;
 
@@ -37,24 +55,228 @@ HICON g_hIconConnecting = NULL; // red icon while connecting
 // single-instance mutex
 HANDLE g_singletonMutex = NULL;
 
-const std::wstring TARGET_TITLE = L"Parsec";
+// settings that can change at runtime (see ClientConfig.h): read once at startup, then again whenever
+// KeySmasherClient.ini is written; every reading thread acquires the current snapshot through its own
+// reader slot, the config watcher publishes
+ConfigStore<ClientConfig> g_config;
+const size_t CONFIG_READER_INPUT = 0;  // hooks, synthetic and replayed input
+const size_t CONFIG_READER_WORKER = 1;
+const size_t CONFIG_READER_UI = 2;     // tray window
+std::thread configThread;
+
+// target window rules ([Targets] section, see WindowMatcher.h); used when the section has no valid rule
+const std::wstring DEFAULT_TARGET_RULE = L"prefix:Parsec";
+WindowMatchCache g_matchCache; // only used on the thread that receives WinEvent callbacks
+
+// foreground tracking: updated from WinEvent callbacks (matched against the current snapshot's
+// rules there), read by the hook with a single atomic load
+FocusTracker g_focus(nullptr);
+HWINEVENTHOOK g_foregroundEventHook = NULL;
+HWINEVENTHOOK g_nameChangeEventHook = NULL;
+
+// mirror endpoints ([Endpoints] name=host:port[/path]); every one gets the full key stream over its own
+// connection and outbox, so a slow or unreachable mirror never delays the primary or the others.
+// Each one also encodes its own frames: outboxes diverge as soon as one endpoint lags, and encoding
+// costs a few ns per event against microseconds per send (see bench/pipeline_bench).
+struct MirrorEndpoint {
+    EndpointConfig config;
+
+    // written by WSWorker, read by the stats dialog
+    WsEngineStats wsStats;
+    SendStats sendStats;
+    PipelineLatency latency; // batch/send/total stages only
+    std::atomic<bool> connected{ false };
+    std::atomic<int64_t> rttUs{ 0 };
+    std::atomic<size_t> backlog{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+};
+const size_t MAX_MIRROR_ENDPOINTS = 8;
+// created and removed by WSWorker as the configured endpoints change; the mutex only guards the list
+// against the stats dialog, never the hot path
+std::mutex g_mirrorsMutex;
+std::vector<std::unique_ptr<MirrorEndpoint>> g_mirrors;
+// mirrors removed by a reload; kept until exit because an aborted engine may still update their stats
+std::vector<std::unique_ptr<MirrorEndpoint>> g_removedMirrors;
+
+// most frames an endpoint sends at once ([Network] BatchMaxEvents is capped to this)
+const int MAX_BATCH_EVENTS = (int)BINARY_MAX_EVENTS;
+
+// Settings below are read once at startup; changing them needs a restart.
+
+// mouse buttons, motion and wheel through WH_MOUSE_LL ([Input] CaptureMouse); the server must
+// understand the mouse messages (see WireFormat.h)
+bool CAPTURE_MOUSE = false;
+
+// periodic latency report ([Diagnostics] LatencyDumpSeconds, 0 = off) written next to the executable
+int LATENCY_DUMP_SECONDS = 0;
+
+// load test: generate this many synthetic key events per second instead of installing the
+// keyboard hook ([Diagnostics] SyntheticKeysPerSecond, 0 = off)
+int SYNTHETIC_KEYS_PER_SECOND = 0;
+int SYNTHETIC_MOUSE_MOVES_PER_SECOND = 0; // [Diagnostics] SyntheticMouseMovesPerSecond
+
+// trace capture / replay ([Diagnostics] CaptureTrace, ReplayTrace, ReplayRealtime; see TraceFormat.h).
+// Relative paths are taken from the executable directory. Replay replaces the keyboard hook like
+// the synthetic source and runs once, either with the recorded timing or as fast as the queue allows.
+std::wstring CAPTURE_TRACE_PATH;
+std::wstring REPLAY_TRACE_PATH;
+bool REPLAY_REALTIME = true;
+
+// Directory of the executable, or an empty string if it cannot be determined
+std::wstring ExeDirectory() {
+    wchar_t exePath[MAX_PATH] = {};
+    if (GetModuleFileNameW(NULL, exePath, MAX_PATH) == 0) return std::wstring();
+    std::wstring p(exePath);
+    size_t pos = p.find_last_of(L"\\/");
+    return (pos == std::wstring::npos) ? L"." : p.substr(0, pos);
+}
+
+// Resolves a path from the INI relative to the executable directory; empty stays empty
+std::wstring ResolveConfigPath(const std::wstring& path) {
+    if (path.empty() || path.find(L':') != std::wstring::npos || path[0] == L'\\' || path[0] == L'/') return path;
+    return ExeDirectory() + L"\\" + path;
+}
+
+// Parses "host:port" or "host:port/path" (default path /ws). IPv6 literals are not supported.
+bool ParseEndpoint(const std::wstring& spec, EndpointConfig* ep) {
+    std::wstring hostPort = spec;
+    ep->path = EndpointConfig().path;
+    size_t slash = spec.find(L'/');
+    if (slash != std::wstring::npos) {
+        hostPort = spec.substr(0, slash);
+        ep->path = spec.substr(slash);
+    }
+    size_t colon = hostPort.rfind(L':');
+    if (colon == std::wstring::npos || colon == 0) return false;
+    int port = _wtoi(hostPort.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) return false;
+    ep->host = hostPort.substr(0, colon);
+    ep->port = (uint16_t)port;
+    return true;
+}
 
-// websocket endpoint (loaded from KeySmasherClient.ini next to the executable)
-std::wstring WS_HOST = L"0.0.0.0";
-INTERNET_PORT WS_PORT = 80;
-const std::wstring WS_PATH = L"/ws";
+std::wstring ConfigPath() {
+    return ExeDirectory() + L"\\KeySmasherClient.ini";
+}
 
-// Load configuration from KeySmasherClient.ini in the executable directory
-// If the INI does not exist, create it with default host 0.0.0.0 and default port 80.
+// Reads the settings that can change at runtime. Missing or invalid keys keep cfg's defaults;
+// invalid entries are listed in cfg->warnings.
+void ReadClientConfig(const std::wstring& iniPath, ClientConfig* cfg) {
+    // read host
+    wchar_t hostBuf[256] = {};
+    GetPrivateProfileStringW(L"Network", L"WebSocketHost", L"0.0.0.0", hostBuf, _countof(hostBuf), iniPath.c_str());
+    cfg->primary.host = hostBuf[0] != L'\0' ? std::wstring(hostBuf) : L"0.0.0.0";
+
+    // read port
+    int port = GetPrivateProfileIntW(L"Network", L"WebSocketPort", (int)cfg->primary.port, iniPath.c_str());
+    if (port > 0 && port <= 65535) cfg->primary.port = (uint16_t)port;
+
+    // read batching options (optional keys, defaults keep one frame per key event)
+    cfg->batch = GetPrivateProfileIntW(L"Network", L"BatchMode", cfg->batch ? 1 : 0, iniPath.c_str()) != 0;
+    int maxEvents = GetPrivateProfileIntW(L"Network", L"BatchMaxEvents", cfg->batchMaxEvents, iniPath.c_str());
+    if (maxEvents >= 1 && maxEvents <= MAX_BATCH_EVENTS) cfg->batchMaxEvents = maxEvents;
+    // flush scheduling when batching (see FlushScheduler.h): events queued behind an in-flight
+    // frame may be held for at most the budget; 0 = always flush right away. BatchWindowUs is the
+    // old name of the budget (it used to be a fixed collection window)
+    int budgetUs = GetPrivateProfileIntW(L"Network", L"BatchWindowUs", cfg->flushBudgetUs, iniPath.c_str());
+    budgetUs = GetPrivateProfileIntW(L"Network", L"FlushBudgetUs", budgetUs, iniPath.c_str());
+    if (budgetUs >= 0 && budgetUs <= 50000) cfg->flushBudgetUs = budgetUs;
+    cfg->adaptiveFlush = GetPrivateProfileIntW(L"Network", L"AdaptiveFlush", cfg->adaptiveFlush ? 1 : 0, iniPath.c_str()) != 0;
+
+    // offer the binary wire protocol at connect time; old servers fall back to text. The compact
+    // (delta/varint) encoding is preferred when the server accepts it
+    cfg->binaryProtocol = GetPrivateProfileIntW(L"Network", L"BinaryProtocol", cfg->binaryProtocol ? 1 : 0, iniPath.c_str()) != 0;
+    cfg->compactProtocol = GetPrivateProfileIntW(L"Network", L"CompactProtocol", cfg->compactProtocol ? 1 : 0, iniPath.c_str()) != 0;
+
+    // ping/ack round-trip measurement (0 = off; the server must answer "p" with "a")
+    int pingMs = GetPrivateProfileIntW(L"Network", L"PingIntervalMs", cfg->pingIntervalMs, iniPath.c_str());
+    if (pingMs == 0 || (pingMs >= 100 && pingMs <= 60000)) cfg->pingIntervalMs = pingMs;
+
+    // transport for every endpoint: "websocket" (default) or "udp" (see UdpEngine.h); with UDP each
+    // datagram repeats up to UdpRedundancy unacknowledged events and the held keys are sent every
+    // UdpKeyStateIntervalMs
+    wchar_t transportBuf[16] = {};
+    GetPrivateProfileStringW(L"Network", L"Transport", L"websocket", transportBuf, _countof(transportBuf), iniPath.c_str());
+    if (_wcsicmp(transportBuf, L"udp") == 0) cfg->primary.transport = EndpointTransport::Udp;
+    else if (_wcsicmp(transportBuf, L"websocket") != 0) cfg->warnings += L"[Network] unknown Transport '" + std::wstring(transportBuf) + L"'\n";
+    int redundancy = GetPrivateProfileIntW(L"Network", L"UdpRedundancy", cfg->udpRedundancy, iniPath.c_str());
+    if (redundancy >= 0 && redundancy <= (int)DatagramSender::MAX_REDUNDANCY) cfg->udpRedundancy = redundancy;
+    int keyStateMs = GetPrivateProfileIntW(L"Network", L"UdpKeyStateIntervalMs", cfg->udpKeyStateIntervalMs, iniPath.c_str());
+    if (keyStateMs >= 20 && keyStateMs <= 60000) cfg->udpKeyStateIntervalMs = keyStateMs;
+
+    // stale events (see StalePolicy): key-downs and motion still queued after their max age (0 = no
+    // limit) are dropped, and an outbox deeper than MaxQueuedEvents is replaced by a key state resync
+    int keyAgeMs = GetPrivateProfileIntW(L"Network", L"MaxKeyAgeMs", cfg->maxKeyAgeMs, iniPath.c_str());
+    if (keyAgeMs >= 0 && keyAgeMs <= 60000) cfg->maxKeyAgeMs = keyAgeMs;
+    int motionAgeMs = GetPrivateProfileIntW(L"Network", L"MaxMotionAgeMs", cfg->maxMotionAgeMs, iniPath.c_str());
+    if (motionAgeMs >= 0 && motionAgeMs <= 60000) cfg->maxMotionAgeMs = motionAgeMs;
+    int maxQueued = GetPrivateProfileIntW(L"Network", L"MaxQueuedEvents", cfg->maxQueuedEvents, iniPath.c_str());
+    if (maxQueued >= 16 && maxQueued <= (int)SendPipeline::OUTBOX_CAPACITY) cfg->maxQueuedEvents = maxQueued;
+
+    // filtering before the send queue (see EventFilter.h)
+    cfg->suppressRepeats = GetPrivateProfileIntW(L"Input", L"SuppressRepeats", cfg->suppressRepeats ? 1 : 0, iniPath.c_str()) != 0;
+    cfg->coalesceTaps = GetPrivateProfileIntW(L"Input", L"CoalesceTaps", cfg->coalesceTaps ? 1 : 0, iniPath.c_str()) != 0;
+
+    // read target window rules: every "key=rule" entry of [Targets]
+    std::vector<wchar_t> section(32768);
+    DWORD sectionLen = GetPrivateProfileSectionW(L"Targets", section.data(), (DWORD)section.size(), iniPath.c_str());
+    for (const wchar_t* entry = section.data(); sectionLen > 0 && *entry; entry += wcslen(entry) + 1) {
+        const wchar_t* eq = wcschr(entry, L'=');
+        if (!eq) continue;
+        std::wstring error;
+        if (!cfg->targets.AddRule(eq + 1, &error)) cfg->warnings += L"[Targets] " + error + L"\n";
+    }
+    if (cfg->targets.RuleCount() == 0) cfg->targets.AddRule(DEFAULT_TARGET_RULE, NULL);
+
+    // read the active remap profile (see KeyRemap.h): every "key=rule" entry of [Remap.<Profile>]
+    wchar_t profileBuf[64] = {};
+    GetPrivateProfileStringW(L"Remap", L"Profile", L"", profileBuf, _countof(profileBuf), iniPath.c_str());
+    cfg->remapProfile = profileBuf;
+    if (!cfg->remapProfile.empty()) {
+        std::wstring remapSection = L"Remap." + cfg->remapProfile;
+        sectionLen = GetPrivateProfileSectionW(remapSection.c_str(), section.data(), (DWORD)section.size(), iniPath.c_str());
+        for (const wchar_t* entry = section.data(); sectionLen > 0 && *entry; entry += wcslen(entry) + 1) {
+            const wchar_t* eq = wcschr(entry, L'=');
+            if (!eq) continue;
+            std::wstring error;
+            if (!cfg->remap.AddRule(eq + 1, &error)) cfg->warnings += L"[" + remapSection + L"] " + error + L"\n";
+        }
+        if (cfg->remap.Empty()) cfg->warnings += L"[Remap] profile '" + cfg->remapProfile + L"' has no valid rule\n";
+        cfg->remap.ResolveScanCodes([](uint8_t vk) { return MapVirtualKeyW(vk, MAPVK_VK_TO_VSC); });
+    }
+
+    // read mirror endpoints: every "name=host:port[/path]" entry of [Endpoints]
+    sectionLen = GetPrivateProfileSectionW(L"Endpoints", section.data(), (DWORD)section.size(), iniPath.c_str());
+    for (const wchar_t* entry = section.data(); sectionLen > 0 && *entry; entry += wcslen(entry) + 1) {
+        const wchar_t* eq = wcschr(entry, L'=');
+        if (!eq) continue;
+        EndpointConfig ep;
+        ep.name.assign(entry, eq);
+        ep.transport = cfg->primary.transport;
+        if (cfg->mirrors.size() >= MAX_MIRROR_ENDPOINTS) {
+            cfg->warnings += L"[Endpoints] too many endpoints, '" + ep.name + L"' ignored\n";
+        } else if (!ParseEndpoint(eq + 1, &ep)) {
+            cfg->warnings += L"[Endpoints] invalid endpoint '" + std::wstring(entry) + L"'\n";
+        } else {
+            cfg->mirrors.push_back(ep);
+        }
+    }
+}
+
+// Load configuration from KeySmasherClient.ini in the executable directory and publish the first
+// snapshot. If the INI does not exist, create it with default host 0.0.0.0 and default port 80.
 // Returns true if a new INI file was created.
 bool LoadConfig() {
     bool created = false;
-    wchar_t exePath[MAX_PATH] = {};
-    if (GetModuleFileNameW(NULL, exePath, MAX_PATH) == 0) return false;
-    std::wstring p(exePath);
-    size_t pos = p.find_last_of(L"\\/");
-    std::wstring dir = (pos == std::wstring::npos) ? L"." : p.substr(0, pos);
-    std::wstring iniPath = dir + L"\\KeySmasherClient.ini";
+    std::unique_ptr<ClientConfig> cfg(new ClientConfig());
+    cfg->version = 1;
+    std::wstring dir = ExeDirectory();
+    if (dir.empty()) {
+        cfg->targets.AddRule(DEFAULT_TARGET_RULE, NULL);
+        g_config.Publish(std::move(cfg));
+        return false;
+    }
+    std::wstring iniPath = ConfigPath();
 
     // If file doesn't exist, create with defaults
     DWORD attrs = GetFileAttributesW(iniPath.c_str());
@@ -62,50 +284,98 @@ bool LoadConfig() {
         // create default values
         WritePrivateProfileStringW(L"Network", L"WebSocketHost", L"0.0.0.0", iniPath.c_str());
         wchar_t portStr[16];
-        _itow_s((int)WS_PORT, portStr, 10);
+        _itow_s((int)cfg->primary.port, portStr, 10);
         WritePrivateProfileStringW(L"Network", L"WebSocketPort", portStr, iniPath.c_str());
+        WritePrivateProfileStringW(L"Network", L"BatchMode", L"0", iniPath.c_str());
+        WritePrivateProfileStringW(L"Targets", L"Rule1", DEFAULT_TARGET_RULE.c_str(), iniPath.c_str());
         created = true;
     }
 
-    // read host
-    wchar_t hostBuf[256] = {};
-    GetPrivateProfileStringW(L"Network", L"WebSocketHost", WS_HOST.c_str(), hostBuf, _countof(hostBuf), iniPath.c_str());
-    if (hostBuf[0] != L'\0') WS_HOST = std::wstring(hostBuf);
+    ReadClientConfig(iniPath, cfg.get());
+    g_config.Publish(std::move(cfg));
 
-    // read port
-    int port = GetPrivateProfileIntW(L"Network", L"WebSocketPort", (int)WS_PORT, iniPath.c_str());
-    if (port > 0 && port <= 65535) WS_PORT = (INTERNET_PORT)port;
+    CAPTURE_MOUSE = GetPrivateProfileIntW(L"Input", L"CaptureMouse", CAPTURE_MOUSE ? 1 : 0, iniPath.c_str()) != 0;
+    int dumpSeconds = GetPrivateProfileIntW(L"Diagnostics", L"LatencyDumpSeconds", LATENCY_DUMP_SECONDS, iniPath.c_str());
+    if (dumpSeconds >= 0 && dumpSeconds <= 86400) LATENCY_DUMP_SECONDS = dumpSeconds;
+
+    int syntheticRate = GetPrivateProfileIntW(L"Diagnostics", L"SyntheticKeysPerSecond", SYNTHETIC_KEYS_PER_SECOND, iniPath.c_str());
+    if (syntheticRate >= 0 && syntheticRate <= 100000) SYNTHETIC_KEYS_PER_SECOND = syntheticRate;
+    int syntheticMouseRate = GetPrivateProfileIntW(L"Diagnostics", L"SyntheticMouseMovesPerSecond", SYNTHETIC_MOUSE_MOVES_PER_SECOND, iniPath.c_str());
+    if (syntheticMouseRate >= 0 && syntheticMouseRate <= 100000) SYNTHETIC_MOUSE_MOVES_PER_SECOND = syntheticMouseRate;
+
+    wchar_t traceBuf[MAX_PATH] = {};
+    GetPrivateProfileStringW(L"Diagnostics", L"CaptureTrace", L"", traceBuf, _countof(traceBuf), iniPath.c_str());
+    CAPTURE_TRACE_PATH = ResolveConfigPath(traceBuf);
+    GetPrivateProfileStringW(L"Diagnostics", L"ReplayTrace", L"", traceBuf, _countof(traceBuf), iniPath.c_str());
+    REPLAY_TRACE_PATH = ResolveConfigPath(traceBuf);
+    REPLAY_REALTIME = GetPrivateProfileIntW(L"Diagnostics", L"ReplayRealtime", REPLAY_REALTIME ? 1 : 0, iniPath.c_str()) != 0;
 
     return created;
 }
 
-struct WSConnection {
-    HINTERNET hSession = NULL;
-    HINTERNET hConnect = NULL;
-    HINTERNET hWebSocket = NULL;
-};
-
-// Threading / queue for messages
-std::mutex queueMutex;
-std::condition_variable queueCv;
-std::queue<std::string> msgQueue;
+// Threading / queue for key events
+// The input thread (keyboard hook) is the only producer and WSWorker the only consumer of eventRing.
+// Other threads that need keys released set releaseAllRequested instead of pushing.
+const size_t EVENT_RING_CAPACITY = 1024;
+SpscRing<KeyEvent, EVENT_RING_CAPACITY> eventRing;
+HANDLE g_queueEvent = NULL; // auto-reset, signalled whenever there is work for WSWorker
+std::atomic<bool> releaseAllRequested{ false };
 std::atomic<bool> running{ true };
 std::atomic<bool> paused{ false };
 std::thread wsThread;
 
+// Input thread: runs the keyboard hook at time-critical priority and does nothing else,
+// so tray menus, message boxes and config work on the main thread can't delay key capture
+std::thread inputThread;
+std::atomic<DWORD> inputThreadId{ 0 };
+
 // connection state
 std::atomic<bool> wsConnected{ false };
 std::atomic<bool> wsConnecting{ false };
 std::atomic<bool> noConnectionAlertShown{ false };
-
-// state for pressed keys tracking
-std::mutex stateMutex;
-std::unordered_set<int> pressedKeys; // keys for which last sent prefix was 'd'
-
-// Title animator
-std::thread titleThread;
-std::mutex titleMutex;
-std::unordered_map<HWND, std::wstring> originalTitles;
+WsEngineStats g_wsStats; // connect/shutdown latency of the async connection engine
+
+// per-stage key event latency, hook entry -> WinHTTP write complete
+PipelineLatency g_latency;
+
+// round-trip / clock offset estimates published by WSWorker (microseconds, server clock - client clock)
+std::atomic<int64_t> g_rttUs{ 0 };
+std::atomic<int64_t> g_rttJitterUs{ 0 };
+std::atomic<int64_t> g_clockOffsetUs{ 0 };
+std::atomic<uint64_t> g_rttSamples{ 0 };
+std::thread statsThread;
+
+// send statistics (events per frame = events / frames)
+SendStats g_sendStats;
+
+// primary endpoint's current flush budget and smoothed send time, published by WSWorker (microseconds)
+std::atomic<uint32_t> g_flushBudgetUs{ 0 };
+std::atomic<int64_t> g_sendSmoothedUs{ 0 };
+
+// trace replay progress (replay runs on the input thread)
+TraceReader g_replayTrace;
+std::atomic<uint64_t> g_replayEvents{ 0 };
+std::atomic<uint64_t> g_replayUs{ 0 }; // set once the whole trace has been fed
+
+// pressed keys: bit set when the last enqueued event for that key was a key-down
+// (written lock-free by the input thread, taken as a whole by WSWorker on release-all)
+KeyStateBitset pressedKeys;
+FilterStats g_filterStats;
+
+// key remapping state (see KeyRemap.h); pressedKeys holds the keys as sent, after remapping.
+// g_remapper is input thread only
+KeyRemapper g_remapper;
+RemapStats g_remapStats;
+
+// heap allocations made by the input thread and by WSWorker once running (debug builds only, see AllocStats.h)
+AllocCounter g_inputAllocs;
+AllocCounter g_workerAllocs;
+
+// Title indicator: main thread only, driven by the foreground events and a timer on the tray
+// window that runs only while the target is focused
+TitleIndicator g_titleIndicator;
+const UINT_PTR TITLE_TIMER_ID = 1;
+const UINT TITLE_TIMER_MS = 200;
 
 // Tray
 const UINT TRAY_ICON_ID = 1;
@@ -113,6 +383,30 @@ const UINT WM_TRAY_CALLBACK = WM_APP + 1;
 // const int IDM_SHOW_CONSOLE = 1001; // removed - no console
 const int IDM_TOGGLE_PAUSE = 1002;
 const int IDM_EXIT = 1003;
+const int IDM_LATENCY_STATS = 1004;
+
+// posted by the event log writer with an Alert entry's text (heap wchar_t[], freed by the receiver)
+// so notifications are shown from the tray thread and never block the thread that raised them
+const UINT WM_SHOW_ALERT = WM_APP + 2;
+// posted by the config watcher after a new snapshot was published
+const UINT WM_CONFIG_RELOADED = WM_APP + 3;
+
+// notices from every thread: Post() never blocks; a background thread appends them to
+// KeySmasherClient-events.log next to the executable and shows alerts as tray notifications
+EventLog<256> g_eventLog;
+HANDLE g_logEvent = NULL; // auto-reset, signalled when an entry was posted
+std::thread logThread;
+const DWORD EVENT_LOG_MAX_BYTES = 1024 * 1024; // then rotated to KeySmasherClient-events.log.old
+
+// Formats and posts an event log entry. Safe on any thread, including inside the hooks.
+void LogEvent(LogLevel level, LogCode code, const char* fmt, ...) {
+    char text[LOG_TEXT_LEN];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+    if (g_eventLog.Post(MonotonicNs(), level, code, text) && g_logEvent) SetEvent(g_logEvent);
+}
 
 void UpdateTrayIcon() {
     if (!g_hWnd) return;
@@ -137,287 +431,633 @@ void UpdateTrayIcon() {
     Shell_NotifyIcon(NIM_MODIFY, &nid);
 }
 
+// Shows the rolling RTT and jitter in the tray tooltip once ping samples are available
+void UpdateTrayTooltip() {
+    if (!g_hWnd) return;
+    NOTIFYICONDATA nid = {};
+    nid.cbSize = sizeof(nid);
+    nid.hWnd = g_hWnd;
+    nid.uID = TRAY_ICON_ID;
+    nid.uFlags = NIF_TIP;
+
+    if (g_rttSamples.load() > 0) {
+        swprintf(nid.szTip, _countof(nid.szTip), L"KeySmasherClient\nRTT %.1f ms, jitter %.1f ms",
+            g_rttUs.load() / 1000.0, g_rttJitterUs.load() / 1000.0);
+    } else {
+        wcscpy_s(nid.szTip, L"KeySmasherClient");
+    }
+    Shell_NotifyIcon(NIM_MODIFY, &nid);
+}
+
 bool IsTargetWindowActive() {
-    HWND hwnd = GetForegroundWindow();
-    if (!hwnd) return false;
+    return g_focus.TargetActive();
+}
 
-    wchar_t title[256];
-    GetWindowTextW(hwnd, title, 256);
+// Executable file name of the process owning hwnd (e.g. "parsecd.exe"), empty if unavailable
+std::wstring ProcessImageName(HWND hwnd) {
+    DWORD pid = 0;
+    GetWindowThreadProcessId(hwnd, &pid);
+    if (!pid) return std::wstring();
+
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!process) return std::wstring();
+    wchar_t path[MAX_PATH] = {};
+    DWORD size = MAX_PATH;
+    BOOL ok = QueryFullProcessImageNameW(process, 0, path, &size);
+    CloseHandle(process);
+    if (!ok) return std::wstring();
+
+    std::wstring p(path, size);
+    size_t pos = p.find_last_of(L"\\/");
+    return (pos == std::wstring::npos) ? p : p.substr(pos + 1);
+}
 
-    std::wstring s(title);
-    // check starts with TARGET_TITLE
-    if (s.size() < TARGET_TITLE.size()) return false;
-    return s.compare(0, TARGET_TITLE.size(), TARGET_TITLE) == 0;
+void WakeWorker() {
+    if (g_queueEvent) SetEvent(g_queueEvent);
 }
 
-void CloseWSConnection(std::unique_ptr<WSConnection>& conn) {
-    // mark disconnected and allow future alerts
-    wsConnected = false;
-    noConnectionAlertShown = false;
+// Ask WSWorker to release every pressed key. Safe to call from any thread;
+// the releases themselves are produced on the worker so eventRing keeps a single producer.
+void ReleaseAllPressedKeys() {
+    releaseAllRequested = true;
+    WakeWorker();
+}
 
-    if (!conn) {
-        UpdateTrayIcon();
-        return;
-    }
-    if (conn->hWebSocket) {
-        WinHttpWebSocketClose(conn->hWebSocket, WINHTTP_WEB_SOCKET_SUCCESS_CLOSE, NULL, 0);
-        WinHttpCloseHandle(conn->hWebSocket);
-        conn->hWebSocket = NULL;
-    }
-    if (conn->hConnect) {
-        WinHttpCloseHandle(conn->hConnect);
-        conn->hConnect = NULL;
+IndicatorInput CurrentIndicatorInput() {
+    IndicatorInput input;
+    input.paused = paused.load();
+    input.connected = wsConnected.load();
+    input.activity = g_sendStats.events.load(std::memory_order_relaxed);
+    return input;
+}
+
+// WM_SETTEXT with a timeout, so a hung target can't block the tray thread
+void ApplyTitleWrites(const std::vector<TitleWrite>& writes) {
+    for (const TitleWrite& w : writes) {
+        HWND hwnd = (HWND)w.hwnd;
+        if (!IsWindow(hwnd)) continue;
+        SendMessageTimeoutW(hwnd, WM_SETTEXT, 0, (LPARAM)w.text.c_str(), SMTO_ABORTIFHUNG, 100, NULL);
     }
-    if (conn->hSession) {
-        WinHttpCloseHandle(conn->hSession);
-        conn->hSession = NULL;
+}
+
+// The focused target changed (null = none): move the indicator and run its timer only while needed
+void OnTargetChanged(HWND target) {
+    std::wstring title;
+    if (target) {
+        wchar_t buf[256] = {};
+        GetWindowTextW(target, buf, 256);
+        title = buf;
     }
-    conn.reset();
-    UpdateTrayIcon();
+    std::vector<TitleWrite> writes;
+    g_titleIndicator.OnTarget(target, title, CurrentIndicatorInput(), &writes);
+    ApplyTitleWrites(writes);
+    if (!g_hWnd) return;
+    if (g_titleIndicator.TimerNeeded()) SetTimer(g_hWnd, TITLE_TIMER_ID, TITLE_TIMER_MS, NULL);
+    else KillTimer(g_hWnd, TITLE_TIMER_ID);
 }
 
-std::unique_ptr<WSConnection> ConnectWebSocket() {
-    auto conn = std::make_unique<WSConnection>();
+void OnTitleTimer() {
+    std::vector<TitleWrite> writes;
+    g_titleIndicator.OnTick(CurrentIndicatorInput(), &writes);
+    ApplyTitleWrites(writes);
+}
 
-    conn->hSession = WinHttpOpen(L"KeySmasherClient/1.0",
-        WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
-        WINHTTP_NO_PROXY_NAME,
-        WINHTTP_NO_PROXY_BYPASS, 0);
+// Re-evaluates the target match for a new foreground window (or a title change of the current one).
+// Results are cached per window and title, so class/process lookups and rules only run for new windows.
+void RefreshForeground(HWND hwnd) {
+    const WindowRuleMatcher& matcher = g_config.Acquire(CONFIG_READER_UI)->targets;
+    bool active = false;
+    if (hwnd) {
+        WindowInfo info;
+        wchar_t title[256] = {};
+        GetWindowTextW(hwnd, title, 256);
+        info.title = title;
+
+        if (!g_matchCache.Lookup(hwnd, info.title, &active)) {
+            if (matcher.NeedsClassName()) {
+                wchar_t cls[256] = {};
+                GetClassNameW(hwnd, cls, 256);
+                info.className = cls;
+            }
+            if (matcher.NeedsProcessName()) info.processName = ProcessImageName(hwnd);
+            active = matcher.Matches(info);
+            g_matchCache.Store(hwnd, info.title, active);
+        }
+    }
+    HWND prevTarget = (HWND)g_focus.TargetWindow();
+    if (g_focus.SetForeground(hwnd, active) && !active) {
+        // target lost focus -> release pressed keys
+        ReleaseAllPressedKeys();
+    }
+    HWND target = (HWND)g_focus.TargetWindow();
+    if (target != prevTarget) OnTargetChanged(target);
+}
 
-    if (!conn->hSession) {
-        wsConnected = false;
-        return nullptr;
+// WINEVENT_OUTOFCONTEXT callback, runs on the thread that installed the hooks (the tray thread)
+void CALLBACK ForegroundEventProc(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD eventThread, DWORD eventTime) {
+    if (event == EVENT_SYSTEM_FOREGROUND) {
+        RefreshForeground(hwnd);
+    } else if (event == EVENT_OBJECT_NAMECHANGE && idObject == OBJID_WINDOW && idChild == CHILDID_SELF
+        && hwnd && hwnd == (HWND)g_focus.ForegroundWindow() && hwnd != (HWND)g_focus.TargetWindow()) {
+        // e.g. a client renames its window after connecting; a matched target stays matched while
+        // focused, so the title indicator doesn't make it drop out of an anchored regex rule
+        RefreshForeground(hwnd);
     }
+}
 
-    // set reasonable timeouts so blocking calls return in a timely manner
-    // resolveTimeout, connectTimeout, sendTimeout, receiveTimeout in milliseconds
-    WinHttpSetTimeouts(conn->hSession, 3000, 3000, 3000, 3000);
+// Foreground events include our own process so that e.g. our own dialogs deactivate the target.
+void InstallForegroundTracking() {
+    g_foregroundEventHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL,
+        ForegroundEventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+    g_nameChangeEventHook = SetWinEventHook(EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE, NULL,
+        ForegroundEventProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    RefreshForeground(GetForegroundWindow());
+}
 
-    if (!running.load()) { CloseWSConnection(conn); wsConnected = false; return nullptr; }
+void RemoveForegroundTracking() {
+    if (g_foregroundEventHook) { UnhookWinEvent(g_foregroundEventHook); g_foregroundEventHook = NULL; }
+    if (g_nameChangeEventHook) { UnhookWinEvent(g_nameChangeEventHook); g_nameChangeEventHook = NULL; }
+}
 
-    conn->hConnect = WinHttpConnect(conn->hSession, WS_HOST.c_str(), WS_PORT, 0);
-    if (!conn->hConnect) {
-        CloseWSConnection(conn);
-        wsConnected = false;
-        return nullptr;
-    }
+std::wstring Widen(const char* s) {
+    std::wstring w;
+    while (*s) w.push_back((wchar_t)(unsigned char)*s++);
+    return w;
+}
 
-    if (!running.load()) { CloseWSConnection(conn); wsConnected = false; return nullptr; }
+// Extra handshake headers: offer the binary protocols (compact first if enabled); servers that don't
+// know them ignore the header and get text
+std::wstring HandshakeHeaders(const ClientConfig& cfg) {
+    if (!cfg.binaryProtocol) return std::wstring();
+    std::wstring offer = L"Sec-WebSocket-Protocol: ";
+    if (cfg.compactProtocol) offer += Widen(WIRE_SUBPROTOCOL_COMPACT) + L", ";
+    return offer + Widen(WIRE_SUBPROTOCOL_BINARY) + L", " + Widen(WIRE_SUBPROTOCOL_TEXT);
+}
 
-    HINTERNET hRequest = WinHttpOpenRequest(
-        conn->hConnect, L"GET", WS_PATH.c_str(),
-        NULL, WINHTTP_NO_REFERER,
-        WINHTTP_DEFAULT_ACCEPT_TYPES,
-        0);
+// Encoding for the subprotocol the server picked (anything we didn't offer means text)
+WireEncoding NegotiatedEncoding(const ClientConfig& cfg, const std::string& subprotocol) {
+    if (!cfg.binaryProtocol) return WireEncoding::Text;
+    if (cfg.compactProtocol && subprotocol == WIRE_SUBPROTOCOL_COMPACT) return WireEncoding::Compact;
+    if (subprotocol == WIRE_SUBPROTOCOL_BINARY) return WireEncoding::Binary;
+    return WireEncoding::Text;
+}
 
-    if (!hRequest) {
-        CloseWSConnection(conn);
-        wsConnected = false;
-        return nullptr;
+// Waits (bounded) for an engine to finish closing its handles. Returns true if it can be deleted.
+bool WaitEngineFinished(ITransport* engine, DWORD timeoutMs) {
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+    while (!engine->Finished()) {
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline) return false;
+        WaitForSingleObject(g_queueEvent, (DWORD)(deadline - now));
     }
+    return true;
+}
 
-    if (!running.load()) { WinHttpCloseHandle(hRequest); CloseWSConnection(conn); wsConnected = false; return nullptr; }
+// Worker side of ReleaseAllPressedKeys(): takes the pressed keys in one atomic pass and turns
+// them into key-ups. cap must hold 254 events (every possible vk code).
+size_t TakeReleaseEvents(KeyEvent* out, size_t cap) {
+    KeySnapshot held = pressedKeys.TakeAll();
+    return held.ToEvents(KeyEventType::Up, GetTickCount(), out, cap); // same clock as KBDLLHOOKSTRUCT::time
+}
 
-    BOOL result = WinHttpSetOption(hRequest,
-        WINHTTP_OPTION_UPGRADE_TO_WEB_SOCKET,
-        NULL, 0);
+// Pops the events for the next frame. Without batching this is a single event, with batching
+// everything already queued (up to BatchMaxEvents).
+size_t CollectBatch(const ClientConfig& cfg, KeyEvent* out) {
+    size_t maxEvents = cfg.batch ? (size_t)cfg.batchMaxEvents : 1;
+    size_t count = eventRing.PopBatch(out, maxEvents);
 
-    if (!result) {
-        WinHttpCloseHandle(hRequest);
-        CloseWSConnection(conn);
-        wsConnected = false;
-        return nullptr;
+    int64_t now = MonotonicNs();
+    for (size_t i = 0; i < count; ++i) {
+        g_latency.queue.RecordNs(now - out[i].stageNs);
+        out[i].stageNs = now;
     }
+    return count;
+}
 
-    if (!running.load()) { WinHttpCloseHandle(hRequest); CloseWSConnection(conn); wsConnected = false; return nullptr; }
-
-    result = WinHttpSendRequest(hRequest,
-        WINHTTP_NO_ADDITIONAL_HEADERS, 0,
-        WINHTTP_NO_REQUEST_DATA, 0,
-        0, 0);
+// Send options for the current configuration
+SendOptions CurrentSendOptions(const ClientConfig& cfg) {
+    SendOptions options;
+    options.batch = cfg.batch;
+    options.maxEvents = (size_t)cfg.batchMaxEvents;
+    options.coalesceTaps = cfg.coalesceTaps;
+    options.flush.budgetUs = (uint32_t)cfg.flushBudgetUs;
+    options.flush.adaptive = cfg.adaptiveFlush;
+    options.stale.keyMaxAgeMs = (uint32_t)cfg.maxKeyAgeMs;
+    options.stale.motionMaxAgeMs = (uint32_t)cfg.maxMotionAgeMs;
+    options.stale.maxQueued = (size_t)cfg.maxQueuedEvents;
+    return options;
+}
 
-    if (!result || !WinHttpReceiveResponse(hRequest, NULL)) {
-        WinHttpCloseHandle(hRequest);
-        CloseWSConnection(conn);
-        wsConnected = false;
-        return nullptr;
+// Worker-side state of one endpoint: its connection, reconnect schedule, outbox and ping clock.
+// The primary endpoint reports through the global connection state and stats; mirrors through
+// their MirrorEndpoint.
+struct EndpointConnection {
+    EndpointConnection(MirrorEndpoint* mirror, const EndpointConfig& target, uint32_t seed)
+        : mirror(mirror),
+          target(target),
+          backoff(250, 10000, seed),
+          pipeline(mirror ? &mirror->latency : &g_latency, mirror ? &mirror->sendStats : &g_sendStats,
+              mirror ? nullptr : &g_filterStats) {
+        message.reserve(WsEngine::MESSAGE_RESERVE);
     }
 
-    if (!running.load()) { WinHttpCloseHandle(hRequest); CloseWSConnection(conn); wsConnected = false; return nullptr; }
-
-    conn->hWebSocket = WinHttpWebSocketCompleteUpgrade(hRequest, NULL);
-    WinHttpCloseHandle(hRequest);
+    MirrorEndpoint* mirror; // null for the primary
+    EndpointConfig target;
+    ITransport* engine = nullptr; // WsEngine or UdpEngine, per target.transport
+    bool open = false;
+    WireEncoding encoding = WireEncoding::Text;
+    ReconnectBackoff backoff;
+    ULONGLONG nextConnectAt = 0;
+    SendPipeline pipeline;
+    std::string message; // reused for every message from the server
+    ClockSyncEstimator clock;
+    uint32_t pingSeq = 0;
+    ULONGLONG nextPingAt = 0;
+};
 
-    if (!conn->hWebSocket) {
-        CloseWSConnection(conn);
-        wsConnected = false;
-        return nullptr;
+// Marks the endpoint connected / disconnected in the state the UI reads
+void PublishEndpointState(EndpointConnection& ep, bool connecting) {
+    if (ep.mirror) {
+        ep.mirror->connected = ep.open;
+        return;
     }
-
-    // mark connected
-    wsConnected = true;
+    wsConnected = ep.open;
+    wsConnecting = connecting;
     noConnectionAlertShown = false;
-
     UpdateTrayIcon();
+}
 
-    return conn;
+// host:port of the endpoint for log messages
+std::wstring EndpointLabel(const EndpointConnection& ep) {
+    std::wstring address = ep.target.host + L":" + std::to_wstring(ep.target.port);
+    return ep.mirror ? ep.target.name + L" (" + address + L")" : address;
 }
 
-void ReleaseAllPressedKeys() {
-    std::vector<std::string> outs;
-    {
-        std::lock_guard<std::mutex> lock(stateMutex);
-        for (int vk : pressedKeys) {
-            std::string msg = std::string(1, 'u') + std::to_string(vk);
-            outs.push_back(msg);
+// Advances one endpoint's connection without blocking. Returns true if it made progress that may
+// allow more right away (a frame or ping was committed); otherwise lowers *waitMs to the time
+// until the endpoint needs attention again (backoff or ping due) and *flushAtNs to when a held
+// partial frame is due (MonotonicNs clock; left alone if that is later than the current value).
+bool ServiceEndpoint(EndpointConnection& ep, std::vector<ITransport*>& retiring, const ClientConfig& cfg, const SendOptions& options,
+    DWORD* waitMs, int64_t* flushAtNs) {
+    ULONGLONG now = GetTickCount64();
+    if (!ep.engine) {
+        if (now < ep.nextConnectAt) {
+            // backing off: keep buffering and wait for the next attempt
+            DWORD untilConnect = (DWORD)(ep.nextConnectAt - now);
+            if (untilConnect < *waitMs) *waitMs = untilConnect;
+            return false;
         }
-        pressedKeys.clear();
+        WsEngineStats* stats = ep.mirror ? &ep.mirror->wsStats : &g_wsStats;
+        if (ep.target.transport == EndpointTransport::Udp) {
+            UdpOptions udp;
+            udp.redundancy = (size_t)cfg.udpRedundancy;
+            udp.keyStateIntervalMs = (uint32_t)cfg.udpKeyStateIntervalMs;
+            UdpEngine* engine = new UdpEngine(g_queueEvent, stats, udp);
+            engine->Start(ep.target.host, ep.target.port);
+            ep.engine = engine;
+        } else {
+            WsEngine* engine = new WsEngine(g_queueEvent, stats);
+            engine->Start(ep.target.host, ep.target.port, ep.target.path, HandshakeHeaders(cfg));
+            ep.engine = engine;
+        }
+        PublishEndpointState(ep, true);
     }
 
-    if (!outs.empty()) {
-        std::lock_guard<std::mutex> qlock(queueMutex);
-        for (auto &m : outs) msgQueue.push(m);
-        queueCv.notify_all();
+    ep.pipeline.PollCompletions(*ep.engine);
+
+    TransportState state = ep.engine->State();
+    if (state == TransportState::Failed) {
+        bool wasOpen = ep.open;
+        ep.engine->Abort();
+        retiring.push_back(ep.engine);
+        ep.engine = nullptr;
+        ep.open = false;
+        ep.pipeline.OnTransportLost();
+        PublishEndpointState(ep, false);
+
+        uint32_t delayMs = ep.backoff.NextDelayMs();
+        ep.nextConnectAt = GetTickCount64() + delayMs;
+        if (wasOpen) {
+            // only the primary is worth interrupting the user for
+            LogEvent(ep.mirror ? LogLevel::Warning : LogLevel::Alert, LogCode::ConnectionLost,
+                "Connection to %ls lost, reconnecting", EndpointLabel(ep).c_str());
+        } else {
+            LogEvent(LogLevel::Warning, LogCode::ConnectFailed, "Connecting to %ls failed, retrying in %u ms",
+                EndpointLabel(ep).c_str(), delayMs);
+        }
+        *waitMs = 0; // run the backoff check again right away
+        return false;
+    }
+    if (state != TransportState::Open) return false;
+
+    if (!ep.open) {
+        // mark connected and bring the server's key state in line with ours
+        ep.open = true;
+        // UDP takes binary v1 frames and wraps them into datagrams itself
+        bool udp = ep.target.transport == EndpointTransport::Udp;
+        ep.encoding = udp ? WireEncoding::Binary : NegotiatedEncoding(cfg, ep.engine->Subprotocol());
+        ep.backoff.Reset();
+        ep.clock.Reset();
+        ep.nextPingAt = now;
+        ep.pipeline.OnConnected(pressedKeys.Load(), GetTickCount());
+        PublishEndpointState(ep, false);
+        LogEvent(LogLevel::Info, LogCode::Connected, "Connected to %ls (%s)", EndpointLabel(ep).c_str(),
+            udp ? "udp" : ep.encoding == WireEncoding::Compact ? "compact" : ep.encoding == WireEncoding::Binary ? "binary" : "text");
     }
-}
 
-void WSWorker() {
-    std::unique_ptr<WSConnection> conn;
+    // acks for our pings; anything else from the server is ignored
+    while (ep.engine->TakeMessage(&ep.message)) {
+        PingAck ack;
+        if (!ParseAck(ep.message.data(), ep.message.size(), &ack)) continue;
+        if (ep.pingSeq - ack.seq >= 64) continue; // not one of our recent pings
+        ep.clock.AddSample(ack, MonotonicNs() / 1000);
+        if (ep.mirror) {
+            ep.mirror->rttUs = ep.clock.SmoothedRttUs();
+            continue;
+        }
+        g_rttUs = ep.clock.SmoothedRttUs();
+        g_rttJitterUs = ep.clock.JitterUs();
+        g_clockOffsetUs = ep.clock.OffsetUs();
+        g_rttSamples = ep.clock.Samples();
+        UpdateTrayTooltip();
+    }
 
-    while (running) {
-        if (!conn) {
-            // indicate connecting state and update tray
-            wsConnecting = true;
-            UpdateTrayIcon();
+    // events queued behind an in-flight frame wait for its completion, which wakes the worker,
+    // and possibly for the flush budget after that
+    int64_t heldUntilNs = 0;
+    if (ep.pipeline.SendNext(*ep.engine, ep.encoding, options, &heldUntilNs)) return true;
+    if (!ep.mirror) {
+        g_flushBudgetUs = ep.pipeline.FlushBudgetUs(options);
+        g_sendSmoothedUs = ep.pipeline.SmoothedSendUs();
+    }
+    if (heldUntilNs != 0 && (*flushAtNs == 0 || heldUntilNs < *flushAtNs)) *flushAtNs = heldUntilNs;
+
+    // pings only go out when no key frame is waiting
+    if (cfg.pingIntervalMs > 0 && !ep.pipeline.HasPending()) {
+        if (now >= ep.nextPingAt) {
+            size_t cap = 0;
+            uint8_t* buf = ep.engine->SendBuffer(&cap);
+            if (buf) {
+                size_t len = FormatPing((char*)buf, cap, ++ep.pingSeq, MonotonicNs() / 1000);
+                if (len > 0) ep.engine->CommitSend(len, false);
+                ep.nextPingAt = now + cfg.pingIntervalMs;
+                return true;
+            }
+            if (*waitMs > 1) *waitMs = 1; // a send is still in flight
+        } else if (ep.nextPingAt - now < *waitMs) {
+            *waitMs = (DWORD)(ep.nextPingAt - now);
+        }
+    }
+    return false;
+}
 
-            conn = ConnectWebSocket();
+// Graceful close first, then abort if the server doesn't answer in time
+void CloseEndpoint(EndpointConnection& ep, std::vector<ITransport*>& retiring) {
+    if (!ep.engine) return;
+    ep.engine->Close();
+    if (!WaitEngineFinished(ep.engine, 300)) ep.engine->Abort();
+    retiring.push_back(ep.engine);
+    ep.engine = nullptr;
+    ep.open = false;
+    if (ep.mirror) ep.mirror->connected = false;
+}
 
-            // finished attempt
-            wsConnecting = false;
-            UpdateTrayIcon();
+// An endpoint whose address changed or that was removed, still sending key-ups to its old server
+struct RetiredEndpoint {
+    std::unique_ptr<EndpointConnection> ep;
+    ULONGLONG deadline = 0; // aborted if the releases and the close haven't finished by then
+    bool closing = false;
+};
 
-            if (!conn) {
-                // failed to connect - always show error and exit
-                MessageBoxW(NULL, L"Couldn't establish WebSocket connection. Exiting application...", L"KeySmasherClient", MB_OK | MB_ICONERROR);
+const DWORD RETIRE_TIMEOUT_MS = 300;
+
+// Takes the endpoint out of service (its address changed or it was removed). An open connection
+// first releases the keys its server holds and then closes gracefully, see ServiceRetiredEndpoints;
+// anything else is dropped without waiting.
+void RetireEndpoint(std::unique_ptr<EndpointConnection> ep, std::vector<RetiredEndpoint>& retired,
+    std::vector<ITransport*>& retiring) {
+    bool drain = ep->engine && ep->open;
+    ep->open = false;
+    PublishEndpointState(*ep, false);
+    if (drain) {
+        ep->pipeline.ReleaseRemoteKeys(GetTickCount());
+        RetiredEndpoint r;
+        r.ep = std::move(ep);
+        r.deadline = GetTickCount64() + RETIRE_TIMEOUT_MS;
+        retired.push_back(std::move(r));
+        return;
+    }
+    if (ep->engine) {
+        ep->engine->Abort();
+        retiring.push_back(ep->engine);
+        ep->engine = nullptr;
+    }
+}
 
-                // request application to exit immediately
-                if (g_hWnd) {
-                    PostMessage(g_hWnd, WM_COMMAND, MAKEWPARAM(IDM_EXIT, 0), 0);
-                } else {
-                    // fallback: signal quit
-                    PostQuitMessage(0);
-                }
-                break; // break worker loop and exit thread
+// Sends the retired endpoints' key-ups, closes them once those completed and aborts whatever
+// is still running at its deadline
+void ServiceRetiredEndpoints(std::vector<RetiredEndpoint>& retired, std::vector<ITransport*>& retiring,
+    const SendOptions& options, DWORD* waitMs) {
+    ULONGLONG now = GetTickCount64();
+    for (auto it = retired.begin(); it != retired.end();) {
+        EndpointConnection& ep = *it->ep;
+        bool failed = ep.engine->State() == TransportState::Failed;
+        if (!it->closing && !failed) {
+            ep.pipeline.PollCompletions(*ep.engine);
+            ep.pipeline.SendNext(*ep.engine, ep.encoding, options);
+            if (!ep.pipeline.HasPending() && !ep.pipeline.HasInflight()) {
+                ep.engine->Close();
+                it->closing = true;
             }
         }
-
-        std::string msg;
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            if (msgQueue.empty()) {
-                // wait until a message arrives or running becomes false
-                queueCv.wait_for(lock, std::chrono::seconds(1));
-            }
-            if (!msgQueue.empty()) {
-                msg = std::move(msgQueue.front());
-                msgQueue.pop();
-            }
+        bool finished = ep.engine->Finished();
+        if (finished || failed || now >= it->deadline) {
+            if (!finished) ep.engine->Abort();
+            retiring.push_back(ep.engine);
+            ep.engine = nullptr;
+            it = retired.erase(it);
+            continue;
         }
+        // completions and state changes wake the worker; the deadline has to be polled
+        if (it->deadline - now < *waitMs) *waitMs = (DWORD)(it->deadline - now);
+        ++it;
+    }
+}
 
-        if (!msg.empty() && !paused.load()) {
-            if (!conn || !conn->hWebSocket) {
-                // no active connection while trying to process a message -> notify user (only once until reconnect)
-                if (!noConnectionAlertShown.exchange(true)) {
-                    MessageBoxW(NULL, L"Nelze zpracovat zpravu: neni aktivni WebSocket spojeni.", L"KeySmasherClient - Chyba", MB_OK | MB_ICONERROR);
-                }
-                continue;
-            }
+MirrorEndpoint* AddMirror(const EndpointConfig& config) {
+    std::unique_ptr<MirrorEndpoint> mirror(new MirrorEndpoint());
+    mirror->config = config;
+    std::lock_guard<std::mutex> lock(g_mirrorsMutex);
+    g_mirrors.push_back(std::move(mirror));
+    return g_mirrors.back().get();
+}
 
-            DWORD sendResult = WinHttpWebSocketSend(conn->hWebSocket,
-                WINHTTP_WEB_SOCKET_UTF8_MESSAGE_BUFFER_TYPE,
-                (BYTE*)msg.c_str(),
-                (DWORD)msg.size());
+void RemoveMirror(MirrorEndpoint* mirror) {
+    std::lock_guard<std::mutex> lock(g_mirrorsMutex);
+    for (auto it = g_mirrors.begin(); it != g_mirrors.end(); ++it) {
+        if (it->get() != mirror) continue;
+        g_removedMirrors.push_back(std::move(*it));
+        g_mirrors.erase(it);
+        return;
+    }
+}
 
-            if (sendResult != ERROR_SUCCESS) {
-                // treat as connection loss and attempt reconnect
-                CloseWSConnection(conn);
-            }
+uint32_t EndpointSeed(size_t index) {
+    return 0x9E3779B9u + 0x632BE5ABu * (uint32_t)index;
+}
+
+// Brings the endpoint list (primary first, then the mirrors) in line with cfg. Endpoints whose
+// address didn't change keep their connection, outbox and stats; changed and removed ones are
+// retired, changed and new ones start connecting on the next pass. Other settings
+// need nothing here: the worker reads them from the snapshot on every pass.
+void ReconfigureEndpoints(std::vector<std::unique_ptr<EndpointConnection>>& endpoints, const ClientConfig& cfg,
+    std::vector<RetiredEndpoint>& retired, std::vector<ITransport*>& retiring) {
+    std::vector<std::unique_ptr<EndpointConnection>> next;
+    if (!endpoints.empty() && endpoints[0]->target == cfg.primary) {
+        next.push_back(std::move(endpoints[0]));
+    } else {
+        if (!endpoints.empty()) RetireEndpoint(std::move(endpoints[0]), retired, retiring);
+        next.emplace_back(new EndpointConnection(nullptr, cfg.primary, EndpointSeed(0)));
+    }
+
+    for (const EndpointConfig& mirror : cfg.mirrors) {
+        std::unique_ptr<EndpointConnection> ep;
+        for (size_t i = 1; i < endpoints.size(); ++i) {
+            if (endpoints[i] && endpoints[i]->target == mirror) { ep = std::move(endpoints[i]); break; }
         }
+        if (!ep) ep.reset(new EndpointConnection(AddMirror(mirror), mirror, EndpointSeed(next.size())));
+        next.push_back(std::move(ep));
     }
 
-    // Clean up on exit
-    CloseWSConnection(conn);
+    for (size_t i = 1; i < endpoints.size(); ++i) {
+        if (!endpoints[i]) continue;
+        RemoveMirror(endpoints[i]->mirror);
+        RetireEndpoint(std::move(endpoints[i]), retired, retiring);
+    }
+    endpoints.swap(next);
 }
 
-void TitleAnimator() {
-    const wchar_t* indicators[] = {L"-", L"\\", L"|", L"/"};
-    size_t idx = 0;
-    bool prevActive = false;
+// Fans captured events out to the trace capture and every endpoint's outbox; while paused they are dropped
+void DispatchCaptured(const KeyEvent* events, size_t count, TraceWriter& capture,
+    std::vector<std::unique_ptr<EndpointConnection>>& endpoints, const SendOptions& options) {
+    if (count == 0) return;
+    if (capture.IsOpen()) capture.Append(events, count);
+    if (paused.load()) return;
+    for (auto& ep : endpoints) ep->pipeline.Enqueue(events, count, options);
+}
 
+void WSWorker() {
+    static_assert(WsEngine::SEND_BUFFER_SIZE >= BINARY_HEADER_LEN + MAX_BATCH_EVENTS * BINARY_RECORD_LEN, "send buffer too small for binary batches");
+    static_assert(WsEngine::SEND_BUFFER_SIZE >= COMPACT_HEADER_MAX_LEN + MAX_BATCH_EVENTS * COMPACT_RECORD_MAX_LEN, "send buffer too small for compact batches");
+    static_assert(WsEngine::SEND_BUFFER_SIZE >= MAX_BATCH_EVENTS * TEXT_EVENT_MAX_LEN, "send buffer too small for text batches");
+    static_assert(UdpEngine::SEND_BUFFER_SIZE >= BINARY_HEADER_LEN + MAX_BATCH_EVENTS * BINARY_RECORD_LEN, "UDP send buffer too small for binary batches");
+    const size_t RELEASE_CAPACITY = 256;
+
+    // primary first, then the mirrors; each with its own outbox and differently seeded backoff
+    std::vector<std::unique_ptr<EndpointConnection>> endpoints;
+    std::vector<RetiredEndpoint> retired; // replaced by a reload, releasing their keys
+    std::vector<ITransport*> retiring; // closed engines waiting for their last WinHTTP callback
+    const ClientConfig* cfg = g_config.Acquire(CONFIG_READER_WORKER);
+    uint64_t appliedVersion = cfg->version; // not the pointer: a freed snapshot's address may be reused
+    ReconfigureEndpoints(endpoints, *cfg, retired, retiring);
+
+    // held partial frames are due within microseconds, far below the default timer resolution; a
+    // high-resolution waitable timer wakes the worker for them without spinning (Windows 10 1803+,
+    // older systems flush right away)
+    HANDLE flushTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!flushTimer && cfg->flushBudgetUs > 0) {
+        LogEvent(LogLevel::Warning, LogCode::ConfigWarning, "no high-resolution timer: FlushBudgetUs is ignored");
+    }
+
+    KeyEvent batch[MAX_BATCH_EVENTS];
+    KeyEvent releases[RELEASE_CAPACITY];
+
+    // events are recorded as they leave eventRing, i.e. after the capture-side filters
+    TraceWriter capture;
+    if (!CAPTURE_TRACE_PATH.empty()) capture.Open(CAPTURE_TRACE_PATH);
+
+    uint64_t queueDropped = 0;
+
+    // from here on only reconnects (a new engine) are expected to allocate
+    TrackThreadAllocations(&g_workerAllocs);
     while (running) {
-        if (paused.load()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
-            continue;
+        for (auto it = retiring.begin(); it != retiring.end();) {
+            if ((*it)->Finished()) { delete *it; it = retiring.erase(it); }
+            else ++it;
         }
 
-        HWND hwnd = GetForegroundWindow();
-        bool active = false;
-        if (hwnd) {
-            wchar_t title[256];
-            GetWindowTextW(hwnd, title, 256);
-            std::wstring s(title);
-            if (s.size() >= TARGET_TITLE.size() && s.compare(0, TARGET_TITLE.size(), TARGET_TITLE) == 0) {
-                active = true;
-            }
+        // a reload only changes the endpoint list if an address changed
+        cfg = g_config.Acquire(CONFIG_READER_WORKER);
+        if (cfg->version != appliedVersion) {
+            ReconfigureEndpoints(endpoints, *cfg, retired, retiring);
+            appliedVersion = cfg->version;
         }
 
-        if (!active && prevActive) {
-            // Parsec lost focus -> release pressed keys
-            ReleaseAllPressedKeys();
+        SendOptions options = CurrentSendOptions(*cfg);
+        if (!flushTimer) options.flush.budgetUs = 0;
+        size_t count = CollectBatch(*cfg, batch);
+        if (eventRing.Dropped() != queueDropped) {
+            LogEvent(LogLevel::Warning, LogCode::QueueOverflow, "Capture queue full, %llu events dropped so far",
+                (unsigned long long)eventRing.Dropped());
+            queueDropped = eventRing.Dropped();
         }
-        prevActive = active;
-
-        if (active) {
-            // animate
-            std::wstring newTitle = TARGET_TITLE + L" [" + indicators[idx % 4] + L"]";
-            idx++;
-
-            // store original title once and set new title
-            {
-                std::lock_guard<std::mutex> lock(titleMutex);
-                if (originalTitles.find(hwnd) == originalTitles.end()) {
-                    wchar_t orig[256];
-                    GetWindowTextW(hwnd, orig, 256);
-                    originalTitles[hwnd] = std::wstring(orig);
-                }
+        DispatchCaptured(batch, count, capture, endpoints, options);
+        if (releaseAllRequested.exchange(false)) {
+            // releases are queued even while paused so no key stays held on the remote side
+            count = TakeReleaseEvents(releases, RELEASE_CAPACITY);
+            // the hook pushes a key-down before it sets the key's bit, so every key taken above may
+            // still have its key-down in eventRing; those go out first, or the release would precede
+            // the press and leave the key held
+            for (size_t queued = eventRing.Size(); queued > 0;) {
+                size_t n = CollectBatch(*cfg, batch);
+                if (n == 0) break;
+                DispatchCaptured(batch, n, capture, endpoints, options);
+                queued = n < queued ? queued - n : 0;
             }
+            for (auto& ep : endpoints) ep->pipeline.EnqueueSynthesized(releases, count);
+        }
 
-            SetWindowTextW(hwnd, newTitle.c_str());
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
-        } else {
-            // restore any titles we changed for windows that are no longer active
-            {
-                std::lock_guard<std::mutex> lock(titleMutex);
-                for (auto it = originalTitles.begin(); it != originalTitles.end();) {
-                    HWND h = it->first;
-                    if (h && IsWindow(h)) {
-                        SetWindowTextW(h, it->second.c_str());
-                    }
-                    it = originalTitles.erase(it);
-                }
+        // wait until an event arrives, a send completes, a connection changes state,
+        // a reconnect or ping is due or running becomes false
+        bool progress = false;
+        DWORD waitMs = 1000;
+        int64_t flushAtNs = 0;
+        int64_t nowNs = MonotonicNs();
+        ServiceRetiredEndpoints(retired, retiring, options, &waitMs);
+        for (auto& ep : endpoints) {
+            // stale events go before anything is sent; also while disconnected, so the outbox
+            // doesn't replay a stall's worth of keys on reconnect
+            if (ep->pipeline.ExpireStale(options.stale, nowNs)) ep->pipeline.Resync(pressedKeys.Load(), GetTickCount());
+            if (ServiceEndpoint(*ep, retiring, *cfg, options, &waitMs, &flushAtNs)) progress = true;
+            if (ep->mirror) {
+                ep->mirror->backlog = ep->pipeline.Backlog();
+                ep->mirror->dropped = ep->pipeline.Dropped();
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        if (progress) continue; // a send may have completed inline; try the next frame right away
+        if (flushAtNs != 0) {
+            int64_t remainingNs = flushAtNs - MonotonicNs();
+            if (remainingNs <= 0) continue;
+            LARGE_INTEGER due;
+            due.QuadPart = -(remainingNs / 100 + 1); // relative, 100 ns units
+            SetWaitableTimer(flushTimer, &due, 0, NULL, NULL, FALSE);
+            HANDLE wake[2] = { g_queueEvent, flushTimer };
+            WaitForMultipleObjects(2, wake, FALSE, waitMs);
+            CancelWaitableTimer(flushTimer);
+        } else {
+            WaitForSingleObject(g_queueEvent, waitMs);
         }
     }
+    if (flushTimer) CloseHandle(flushTimer);
 
-    // restore on exit
-    {
-        std::lock_guard<std::mutex> lock(titleMutex);
-        for (auto &p : originalTitles) {
-            if (p.first && IsWindow(p.first)) SetWindowTextW(p.first, p.second.c_str());
-        }
-        originalTitles.clear();
+    for (auto& ep : endpoints) CloseEndpoint(*ep, retiring);
+    for (RetiredEndpoint& r : retired) CloseEndpoint(*r.ep, retiring);
+    capture.Close();
+    wsConnected = false;
+    for (ITransport* e : retiring) {
+        if (WaitEngineFinished(e, 200)) delete e; // otherwise leaked deliberately: WinHTTP may still call back
     }
+    UpdateTrayIcon();
 }
 
 void AddTrayIcon(HWND hwnd) {
@@ -440,6 +1080,20 @@ void RemoveTrayIcon(HWND hwnd) {
     Shell_NotifyIcon(NIM_DELETE, &nid);
 }
 
+// Balloon / toast from the tray icon; returns immediately, unlike a message box
+void ShowTrayNotification(const wchar_t* title, const wchar_t* text) {
+    if (!g_hWnd) return;
+    NOTIFYICONDATA nid = {};
+    nid.cbSize = sizeof(nid);
+    nid.hWnd = g_hWnd;
+    nid.uID = TRAY_ICON_ID;
+    nid.uFlags = NIF_INFO;
+    nid.dwInfoFlags = NIIF_WARNING;
+    wcsncpy_s(nid.szInfoTitle, title, _TRUNCATE);
+    wcsncpy_s(nid.szInfo, text, _TRUNCATE);
+    Shell_NotifyIcon(NIM_MODIFY, &nid);
+}
+
 void ShowTrayMenu(HWND hwnd) {
     POINT pt;
     GetCursorPos(&pt);
@@ -448,6 +1102,7 @@ void ShowTrayMenu(HWND hwnd) {
     // no console menu when running as GUI
     std::wstring pauseLabel = paused.load() ? L"Unpause" : L"Pause";
     AppendMenu(hMenu, MF_STRING, IDM_TOGGLE_PAUSE, pauseLabel.c_str());
+    AppendMenu(hMenu, MF_STRING, IDM_LATENCY_STATS, L"Latency statistics...");
     AppendMenu(hMenu, MF_SEPARATOR, 0, NULL);
     AppendMenu(hMenu, MF_STRING, IDM_EXIT, L"Exit");
 
@@ -461,6 +1116,203 @@ void ShowTrayMenu(HWND hwnd) {
     }
 }
 
+// Latency table (microseconds) as wide text for the UI
+std::wstring FormatLatencyReport() {
+    const ClientConfig* cfg = g_config.Acquire(CONFIG_READER_UI);
+    char buf[1024];
+    size_t len = g_latency.Format(buf, sizeof(buf));
+    std::wstring text(buf, buf + len);
+    text += L"\nconnect: " + std::to_wstring(g_wsStats.lastConnectUs.load()) + L" us, last shutdown: " + std::to_wstring(g_wsStats.lastShutdownUs.load()) + L" us";
+    if (g_rttSamples.load() > 0) {
+        text += L"\nrtt: " + std::to_wstring(g_rttUs.load()) + L" us, jitter: " + std::to_wstring(g_rttJitterUs.load()) + L" us, clock offset: " + std::to_wstring(g_clockOffsetUs.load()) + L" us";
+    }
+    if (cfg->batch && cfg->flushBudgetUs > 0) {
+        text += L"\nflush budget: " + std::to_wstring(g_flushBudgetUs.load()) + L" us (max " + std::to_wstring(cfg->flushBudgetUs)
+            + (cfg->adaptiveFlush ? L" us, adaptive), smoothed send: " + std::to_wstring(g_sendSmoothedUs.load()) + L" us" : L" us, fixed)");
+    } else if (cfg->batch) {
+        text += L"\nsmoothed send: " + std::to_wstring(g_sendSmoothedUs.load()) + L" us";
+    }
+    text += L"\nframes: " + std::to_wstring(g_sendStats.frames.load()) + L", events: " + std::to_wstring(g_sendStats.events.load()) + L", dropped (queue full): " + std::to_wstring(eventRing.Dropped()) + L", bytes: " + std::to_wstring(g_sendStats.bytes.load());
+    text += L"\nstale events: expired " + std::to_wstring(g_sendStats.expired.load()) + L", shed " + std::to_wstring(g_sendStats.shed.load())
+        + L", resyncs " + std::to_wstring(g_sendStats.resyncs.load());
+    if (g_sendStats.compactBytes.load() > 0) {
+        uint64_t compact = g_sendStats.compactBytes.load();
+        uint64_t v1 = g_sendStats.compactBinaryBytes.load();
+        text += L"\ncompact encoding: " + std::to_wstring(compact) + L" bytes (binary v1: " + std::to_wstring(v1) + L", "
+            + std::to_wstring(v1 ? compact * 100 / v1 : 100) + L"%)";
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_mirrorsMutex); // a reload may add or remove mirrors
+        for (const auto& m : g_mirrors) {
+            text += L"\nmirror " + m->config.name + L" (" + m->config.host + L":" + std::to_wstring(m->config.port) + L"): "
+                + (m->connected.load() ? L"connected" : L"down")
+                + L", frames: " + std::to_wstring(m->sendStats.frames.load())
+                + L", events: " + std::to_wstring(m->sendStats.events.load())
+                + L", backlog: " + std::to_wstring(m->backlog.load())
+                + L", dropped: " + std::to_wstring(m->dropped.load())
+                + L", expired/shed: " + std::to_wstring(m->sendStats.expired.load()) + L"/" + std::to_wstring(m->sendStats.shed.load())
+                + L", total p99: " + std::to_wstring(m->latency.total.Percentile(99)) + L" us"
+                + L", connects/failures: " + std::to_wstring(m->wsStats.connects.load()) + L"/" + std::to_wstring(m->wsStats.failures.load());
+            if (m->rttUs.load() > 0) text += L", rtt: " + std::to_wstring(m->rttUs.load()) + L" us";
+        }
+    }
+    if (!REPLAY_TRACE_PATH.empty()) {
+        uint64_t replayed = g_replayEvents.load();
+        uint64_t replayUs = g_replayUs.load();
+        text += L"\nreplay: " + std::to_wstring(replayed) + L" / " + std::to_wstring(g_replayTrace.Count()) + L" events";
+        if (replayUs > 0) text += L" in " + std::to_wstring(replayUs / 1000) + L" ms (" + std::to_wstring(replayed * 1000000 / replayUs) + L" events/s)";
+    }
+    text += L"\nrepeats suppressed: " + std::to_wstring(g_filterStats.repeatsDropped.load()) + L", taps coalesced: " + std::to_wstring(g_filterStats.tapsCoalesced.load())
+        + L", motion merged: " + std::to_wstring(g_filterStats.motionMerged.load());
+    if (!cfg->remapProfile.empty()) {
+        text += L"\nremap profile " + cfg->remapProfile + L": " + std::to_wstring(cfg->remap.RuleCount()) + L" rules, keys remapped: "
+            + std::to_wstring(g_remapStats.remapped.load()) + L", macros played: " + std::to_wstring(g_remapStats.macrosPlayed.load());
+    }
+    if (g_eventLog.Dropped() + g_eventLog.Suppressed() > 0) {
+        text += L"\nevent log: rate-limited " + std::to_wstring(g_eventLog.Suppressed()) + L", dropped " + std::to_wstring(g_eventLog.Dropped());
+    }
+#if KS_ALLOC_STATS
+    text += L"\nheap allocations: input thread " + std::to_wstring(g_inputAllocs.count.load()) + L", worker " + std::to_wstring(g_workerAllocs.count.load())
+        + L", process " + std::to_wstring(TotalAllocations());
+#endif
+    return text;
+}
+
+void ShowLatencyStats() {
+    std::wstring text = FormatLatencyReport();
+    MessageBoxW(NULL, text.c_str(), L"KeySmasherClient - Latency (us)", MB_OK | MB_ICONINFORMATION);
+}
+
+// Appends the latency table to KeySmasherClient-latency.log every LATENCY_DUMP_SECONDS
+void LatencyDumper() {
+    std::wstring path = ExeDirectory() + L"\\KeySmasherClient-latency.log";
+    ULONGLONG nextDump = GetTickCount64() + (ULONGLONG)LATENCY_DUMP_SECONDS * 1000;
+
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (GetTickCount64() < nextDump) continue;
+        nextDump += (ULONGLONG)LATENCY_DUMP_SECONDS * 1000;
+
+        char buf[1024];
+        int n = snprintf(buf, sizeof(buf), "--- uptime %llu s\n", (unsigned long long)(GetTickCount64() / 1000));
+        size_t len = (n > 0) ? (size_t)n : 0;
+        len += g_latency.Format(buf + len, sizeof(buf) - len);
+
+        HANDLE h = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (h == INVALID_HANDLE_VALUE) continue;
+        SetFilePointer(h, 0, NULL, FILE_END);
+        DWORD written = 0;
+        WriteFile(h, buf, (DWORD)len, &written, NULL);
+        CloseHandle(h);
+    }
+}
+
+// Opens the event log for appending, rotating it first if it grew past EVENT_LOG_MAX_BYTES
+HANDLE OpenEventLogFile(const std::wstring& path) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) return h;
+    if (GetFileSize(h, NULL) > EVENT_LOG_MAX_BYTES) {
+        CloseHandle(h);
+        MoveFileExW(path.c_str(), (path + L".old").c_str(), MOVEFILE_REPLACE_EXISTING);
+        h = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (h == INVALID_HANDLE_VALUE) return h;
+    }
+    SetFilePointer(h, 0, NULL, FILE_END);
+    return h;
+}
+
+// Drains g_eventLog: appends every entry to the log file and hands alerts to the tray thread.
+// Runs until running is false, then writes what is left.
+void EventLogWriter() {
+    std::wstring path = ExeDirectory() + L"\\KeySmasherClient-events.log";
+    HANDLE file = OpenEventLogFile(path);
+    DWORD written = 0;
+
+    bool stop = false;
+    while (!stop) {
+        stop = !running.load();
+        if (!stop) WaitForSingleObject(g_logEvent, 1000);
+
+        LogEntry e;
+        while (g_eventLog.Take(&e)) {
+            if (file != INVALID_HANDLE_VALUE) {
+                char line[LOG_TEXT_LEN + 48];
+                int64_t ms = e.timeNs / 1000000;
+                int n = snprintf(line, sizeof(line), "[%lld.%03lld] %s %s\r\n", (long long)(ms / 1000), (long long)(ms % 1000),
+                    LogLevelName(e.level), e.text);
+                // snprintf returns the untruncated length; std::min is unusable here (windows.h defines min)
+                size_t len = (size_t)n < sizeof(line) - 1 ? (size_t)n : sizeof(line) - 1;
+                if (n > 0) WriteFile(file, line, (DWORD)len, &written, NULL);
+                if (GetFileSize(file, NULL) > EVENT_LOG_MAX_BYTES) {
+                    CloseHandle(file);
+                    file = OpenEventLogFile(path);
+                }
+            }
+            if (e.level == LogLevel::Alert && !stop && g_hWnd) {
+                // texts are ASCII; the tray thread owns and frees the copy
+                size_t len = strlen(e.text);
+                wchar_t* text = new wchar_t[len + 1];
+                for (size_t i = 0; i <= len; ++i) text[i] = (wchar_t)(unsigned char)e.text[i];
+                if (!PostMessage(g_hWnd, WM_SHOW_ALERT, 0, (LPARAM)text)) delete[] text;
+            }
+        }
+    }
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+// Reads KeySmasherClient.ini again and publishes it as the next snapshot. The worker picks it up on
+// its next pass (re-establishing only the endpoints whose address changed) and the tray thread
+// re-evaluates the foreground window against the new [Targets].
+void ReloadConfig() {
+    std::wstring iniPath = ConfigPath();
+    std::unique_ptr<ClientConfig> cfg(new ClientConfig());
+    cfg->version = g_config.Current()->version + 1;
+    ReadClientConfig(iniPath, cfg.get());
+    uint64_t version = cfg->version;
+    std::wstring warnings = cfg->warnings;
+    g_config.Publish(std::move(cfg));
+
+    LogEvent(LogLevel::Info, LogCode::ConfigReloaded, "configuration reloaded (version %llu)", (unsigned long long)version);
+    if (!warnings.empty()) {
+        std::wstring first = warnings.substr(0, warnings.find(L'\n'));
+        LogEvent(LogLevel::Alert, LogCode::ConfigWarning, "config entry ignored: %ls", first.c_str());
+    }
+    bool captureMouse = GetPrivateProfileIntW(L"Input", L"CaptureMouse", CAPTURE_MOUSE ? 1 : 0, iniPath.c_str()) != 0;
+    if (captureMouse != CAPTURE_MOUSE) {
+        LogEvent(LogLevel::Warning, LogCode::ConfigWarning, "CaptureMouse changes take effect after a restart");
+    }
+
+    WakeWorker();
+    if (g_hWnd) PostMessage(g_hWnd, WM_CONFIG_RELOADED, 0, 0);
+}
+
+// Watches the executable's directory and reloads the configuration when the INI file was written.
+// Editors often write a file in several steps, so changes are collected for a short while first.
+void ConfigWatcher() {
+    std::wstring dir = ExeDirectory();
+    std::wstring iniPath = ConfigPath();
+    HANDLE change = FindFirstChangeNotificationW(dir.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (change == INVALID_HANDLE_VALUE) return;
+
+    WIN32_FILE_ATTRIBUTE_DATA data = {};
+    FILETIME lastWrite = {};
+    if (GetFileAttributesExW(iniPath.c_str(), GetFileExInfoStandard, &data)) lastWrite = data.ftLastWriteTime;
+
+    while (running.load()) {
+        if (WaitForSingleObject(change, 250) != WAIT_OBJECT_0) continue;
+        Sleep(200);
+        if (!FindNextChangeNotification(change)) break;
+        if (!running.load()) break;
+
+        // other files in the directory (logs, traces) change all the time
+        if (!GetFileAttributesExW(iniPath.c_str(), GetFileExInfoStandard, &data)) continue;
+        if (CompareFileTime(&data.ftLastWriteTime, &lastWrite) == 0) continue;
+        lastWrite = data.ftLastWriteTime;
+        ReloadConfig();
+    }
+    FindCloseChangeNotification(change);
+}
+
 LRESULT CALLBACK TrayWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
     case WM_TRAY_CALLBACK:
@@ -484,14 +1336,31 @@ LRESULT CALLBACK TrayWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             }
             UpdateTrayIcon();
             break;
+        case IDM_LATENCY_STATS:
+            ShowLatencyStats();
+            break;
         case IDM_EXIT:
             // signal shutdown
             running = false;
-            queueCv.notify_all();
+            WakeWorker();
             PostQuitMessage(0);
             break;
         }
         break;
+    case WM_TIMER:
+        if (wParam == TITLE_TIMER_ID) OnTitleTimer();
+        break;
+    case WM_SHOW_ALERT: {
+        wchar_t* text = (wchar_t*)lParam;
+        ShowTrayNotification(L"KeySmasherClient", text);
+        delete[] text;
+        break;
+    }
+    case WM_CONFIG_RELOADED:
+        // cached matches were made with the previous [Targets]
+        g_matchCache.Clear();
+        RefreshForeground(GetForegroundWindow());
+        break;
     case WM_DESTROY:
         RemoveTrayIcon(hwnd);
         PostQuitMessage(0);
@@ -502,40 +1371,54 @@ LRESULT CALLBACK TrayWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     return 0;
 }
 
+// Enqueues a captured key event and updates pressedKeys. Input thread only (eventRing producer).
+// Returns false if the event was filtered out or the ring was full.
+bool CaptureKeyEvent(KeyEvent& ev) {
+    if (g_config.Acquire(CONFIG_READER_INPUT)->suppressRepeats && IsAutoRepeat(pressedKeys, ev)) {
+        g_filterStats.repeatsDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // ring full -> event is dropped (counted by eventRing); pressedKeys is left
+    // untouched so it still reflects what was actually enqueued
+    ev.stageNs = MonotonicNs();
+    if (!eventRing.TryPush(ev)) return false;
+    g_latency.hook.RecordNs(ev.stageNs - ev.hookNs);
+    WakeWorker();
+
+    pressedKeys.Apply(ev);
+    return true;
+}
+
 LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam) {
+    int64_t hookNs = MonotonicNs();
     if (nCode == HC_ACTION) {
         if (wParam == WM_KEYDOWN || wParam == WM_KEYUP || wParam == WM_SYSKEYDOWN || wParam == WM_SYSKEYUP) {
-            if (paused.load()) return CallNextHookEx(NULL, nCode, wParam, lParam);
-
             KBDLLHOOKSTRUCT* kb = (KBDLLHOOKSTRUCT*)lParam;
 
             bool keyDown = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN);
-            bool keyUp = (wParam == WM_KEYUP || wParam == WM_SYSKEYUP);
-
-            if (IsTargetWindowActive()) {
-                // if no websocket connection, show an error (only once until reconnect)
-                if (!wsConnected.load()) {
-                    if (!noConnectionAlertShown.exchange(true)) {
-                        MessageBoxW(NULL, L"Nelze zpracovat zpravu: neni aktivni WebSocket spojeni.", L"KeySmasherClient - Chyba", MB_OK | MB_ICONERROR);
-                    }
-                    return CallNextHookEx(NULL, nCode, wParam, lParam);
-                }
 
-                char prefix = keyDown ? 'd' : 'u';
-                std::string msg = std::string(1, prefix) + std::to_string(kb->vkCode);
-                {
-                    std::lock_guard<std::mutex> lock(queueMutex);
-                    msgQueue.push(msg);
+            KeyEvent ev;
+            ev.time = kb->time;
+            ev.scanCode = (uint16_t)kb->scanCode;
+            ev.vkCode = (uint8_t)kb->vkCode;
+            ev.type = keyDown ? KeyEventType::Down : KeyEventType::Up;
+            ev.flags = (uint8_t)kb->flags;
+            ev.hookNs = hookNs;
+
+            // the remapper sees every key, also while paused or unfocused, so chords and key-ups
+            // match what was physically pressed
+            bool active = !paused.load() && IsTargetWindowActive();
+            KeyEvent out[KeyRemapper::MAX_OUTPUT];
+            size_t n = g_remapper.Process(g_config.Acquire(CONFIG_READER_INPUT)->remap, ev, active, out, &g_remapStats);
+
+            if (active) {
+                // if no websocket connection, raise an alert (only once until reconnect); the event
+                // is still queued and replayed once WSWorker has reconnected
+                if (!wsConnected.load() && !noConnectionAlertShown.exchange(true)) {
+                    LogEvent(LogLevel::Alert, LogCode::NoConnection, "Nelze zpracovat zpravu: neni aktivni WebSocket spojeni.");
                 }
-                queueCv.notify_one();
-
-                // update pressedKeys state
-                {
-                    std::lock_guard<std::mutex> slock(stateMutex);
-                    if (prefix == 'd') pressedKeys.insert((int)kb->vkCode);
-                    else pressedKeys.erase((int)kb->vkCode);
-                }
-                //std::cout << msg + "\n"; no console available to print
+                for (size_t i = 0; i < n; ++i) CaptureKeyEvent(out[i]);
             }
         }
     }
@@ -543,6 +1426,192 @@ LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam) {
     return CallNextHookEx(NULL, nCode, wParam, lParam);
 }
 
+// Last cursor position seen by the mouse hook; low-level hooks report absolute positions,
+// so motion is the difference to the previous one. Input thread only.
+POINT lastMousePos = {};
+bool lastMousePosValid = false;
+
+int16_t ClampDelta(LONG d) {
+    return (int16_t)(d < -32768 ? -32768 : d > 32767 ? 32767 : d);
+}
+
+LRESULT CALLBACK LowLevelMouseProc(int nCode, WPARAM wParam, LPARAM lParam) {
+    int64_t hookNs = MonotonicNs();
+    if (nCode != HC_ACTION) return CallNextHookEx(NULL, nCode, wParam, lParam);
+
+    MSLLHOOKSTRUCT* ms = (MSLLHOOKSTRUCT*)lParam;
+    KeyEvent ev;
+    ev.time = ms->time;
+    ev.flags = (uint8_t)ms->flags;
+    ev.hookNs = hookNs;
+
+    bool capture = true;
+    switch (wParam) {
+    case WM_MOUSEMOVE:
+        // track the position even while the target is inactive so the first motion after
+        // switching to it isn't a jump from a stale position
+        ev.type = KeyEventType::MouseMove;
+        ev.dx = ClampDelta(ms->pt.x - lastMousePos.x);
+        ev.dy = ClampDelta(ms->pt.y - lastMousePos.y);
+        capture = lastMousePosValid && (ev.dx != 0 || ev.dy != 0);
+        lastMousePos = ms->pt;
+        lastMousePosValid = true;
+        break;
+    case WM_LBUTTONDOWN: ev.type = KeyEventType::Down; ev.vkCode = VK_LBUTTON; break;
+    case WM_LBUTTONUP: ev.type = KeyEventType::Up; ev.vkCode = VK_LBUTTON; break;
+    case WM_RBUTTONDOWN: ev.type = KeyEventType::Down; ev.vkCode = VK_RBUTTON; break;
+    case WM_RBUTTONUP: ev.type = KeyEventType::Up; ev.vkCode = VK_RBUTTON; break;
+    case WM_MBUTTONDOWN: ev.type = KeyEventType::Down; ev.vkCode = VK_MBUTTON; break;
+    case WM_MBUTTONUP: ev.type = KeyEventType::Up; ev.vkCode = VK_MBUTTON; break;
+    case WM_XBUTTONDOWN:
+    case WM_XBUTTONUP:
+        ev.type = (wParam == WM_XBUTTONDOWN) ? KeyEventType::Down : KeyEventType::Up;
+        ev.vkCode = (HIWORD(ms->mouseData) == XBUTTON1) ? VK_XBUTTON1 : VK_XBUTTON2;
+        break;
+    case WM_MOUSEWHEEL:
+    case WM_MOUSEHWHEEL:
+        ev.type = (wParam == WM_MOUSEWHEEL) ? KeyEventType::MouseWheel : KeyEventType::MouseHWheel;
+        ev.dx = (int16_t)HIWORD(ms->mouseData);
+        break;
+    default:
+        capture = false;
+        break;
+    }
+
+    if (capture && !paused.load() && IsTargetWindowActive()) CaptureKeyEvent(ev);
+    return CallNextHookEx(NULL, nCode, wParam, lParam);
+}
+
+// Load-test input: feeds SyntheticKeySource / SyntheticMouseSource events through CaptureKeyEvent()
+// at the configured rates, regardless of the foreground window, until the thread receives WM_QUIT.
+void RunSyntheticInput() {
+    int64_t start = MonotonicNs();
+    SyntheticKeySource keys((uint32_t)SYNTHETIC_KEYS_PER_SECOND, start);
+    SyntheticMouseSource mouse((uint32_t)SYNTHETIC_MOUSE_MOVES_PER_SECOND, start);
+    MSG msg;
+    for (;;) {
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) return;
+        }
+        int64_t now = MonotonicNs();
+        for (uint64_t due = keys.Due(now); due > 0; --due) {
+            KeyEvent ev = keys.Next(now);
+            if (!paused.load()) CaptureKeyEvent(ev);
+        }
+        for (uint64_t due = mouse.Due(now); due > 0; --due) {
+            KeyEvent ev = mouse.Next(now);
+            if (!paused.load()) CaptureKeyEvent(ev);
+        }
+        MsgWaitForMultipleObjects(0, NULL, FALSE, 1, QS_ALLINPUT);
+    }
+}
+
+// Replay input: feeds g_replayTrace through CaptureKeyEvent() once, with the recorded spacing
+// (REPLAY_REALTIME) or as fast as eventRing accepts, then idles until WM_QUIT.
+void RunTraceReplay() {
+    MSG msg;
+    int64_t start = MonotonicNs();
+    int64_t dueNs = start;
+    size_t next = 0;
+    size_t count = g_replayTrace.Count();
+
+    while (next < count) {
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) return;
+        }
+
+        size_t fed = 0;
+        int64_t now = MonotonicNs();
+        while (next < count && fed < EVENT_RING_CAPACITY) {
+            KeyEvent ev;
+            uint32_t deltaUs = 0;
+            if (!g_replayTrace.Read(next, &ev, &deltaUs)) { next++; continue; }
+            if (REPLAY_REALTIME) {
+                if (dueNs + (int64_t)deltaUs * 1000 > now) break;
+                dueNs += (int64_t)deltaUs * 1000;
+            } else if (eventRing.Size() >= EVENT_RING_CAPACITY) {
+                break; // never drop in benchmark mode, wait for the worker instead
+            }
+            ev.hookNs = MonotonicNs();
+            if (!paused.load()) CaptureKeyEvent(ev);
+            next++;
+            fed++;
+        }
+        g_replayEvents = next;
+
+        if (REPLAY_REALTIME) MsgWaitForMultipleObjects(0, NULL, FALSE, 1, QS_ALLINPUT);
+        else if (fed == 0) std::this_thread::yield();
+    }
+    g_replayUs = (uint64_t)((MonotonicNs() - start) / 1000);
+
+    while (GetMessage(&msg, NULL, 0, 0) > 0) {}
+}
+
+// Whether the input thread captures the real keyboard (as opposed to a load-test source)
+bool UsesKeyboardHook() {
+    return SYNTHETIC_KEYS_PER_SECOND == 0 && SYNTHETIC_MOUSE_MOVES_PER_SECOND == 0 && REPLAY_TRACE_PATH.empty();
+}
+
+// Input thread body. The low-level hook is called on the thread that installed it, and only
+// while that thread pumps messages, so this thread installs it and then just runs GetMessage.
+// readyEvent is signalled once the hook is in place (or failed, leaving keyboardHook NULL).
+void InputThread(HANDLE readyEvent) {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+    // make sure the thread has a message queue before anyone posts WM_QUIT to it
+    MSG msg;
+    PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+    inputThreadId = GetCurrentThreadId();
+    TrackThreadAllocations(&g_inputAllocs);
+
+    if (!REPLAY_TRACE_PATH.empty()) {
+        SetEvent(readyEvent);
+        RunTraceReplay();
+        return;
+    }
+    if (!UsesKeyboardHook()) {
+        SetEvent(readyEvent);
+        RunSyntheticInput();
+        return;
+    }
+
+    keyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, LowLevelKeyboardProc, NULL, 0);
+    // mouse capture is optional: without the hook the client still works for keys
+    if (keyboardHook && CAPTURE_MOUSE) mouseHook = SetWindowsHookEx(WH_MOUSE_LL, LowLevelMouseProc, NULL, 0);
+    SetEvent(readyEvent);
+    if (!keyboardHook) return;
+
+    while (GetMessage(&msg, NULL, 0, 0) > 0) {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+
+    if (mouseHook) { UnhookWindowsHookEx(mouseHook); mouseHook = NULL; }
+    UnhookWindowsHookEx(keyboardHook);
+    keyboardHook = NULL;
+}
+
+// Starts the input thread and waits until the hook is installed. Returns false if it couldn't be.
+bool StartInputThread() {
+    HANDLE ready = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!ready) return false;
+    inputThread = std::thread(InputThread, ready);
+    WaitForSingleObject(ready, INFINITE);
+    CloseHandle(ready);
+
+    if (UsesKeyboardHook() && !keyboardHook) {
+        inputThread.join();
+        return false;
+    }
+    return true;
+}
+
+void StopInputThread() {
+    if (!inputThread.joinable()) return;
+    PostThreadMessage(inputThreadId.load(), WM_QUIT, 0, 0);
+    inputThread.join();
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
     // enforce single instance using a named mutex
     g_singletonMutex = CreateMutexW(NULL, FALSE, L"Global\\KeySmasherClient_Mutex");
@@ -558,6 +1627,16 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     }
 
     bool iniCreated = LoadConfig();
+    if (!g_config.Acquire(CONFIG_READER_UI)->warnings.empty()) {
+        std::wstring text = L"Some entries in 'KeySmasherClient.ini' were ignored:\n" + g_config.Acquire(CONFIG_READER_UI)->warnings;
+        MessageBoxW(NULL, text.c_str(), L"KeySmasherClient - Configuration", MB_OK | MB_ICONWARNING);
+    }
+    if (!REPLAY_TRACE_PATH.empty() && !g_replayTrace.Open(REPLAY_TRACE_PATH)) {
+        std::wstring text = L"Cannot open the replay trace '" + REPLAY_TRACE_PATH + L"'.";
+        MessageBoxW(NULL, text.c_str(), L"KeySmasherClient - Configuration", MB_OK | MB_ICONERROR);
+        if (g_singletonMutex) { CloseHandle(g_singletonMutex); g_singletonMutex = NULL; }
+        return 1;
+    }
     if (iniCreated) {
         MessageBoxW(NULL, L"A configuration file 'KeySmasherClient.ini' was created next to the executable. Please set 'WebSocketHost' and 'WebSocketPort' in the [Network] section and restart the application.", L"KeySmasherClient - Configuration", MB_OK | MB_ICONINFORMATION);
         if (g_singletonMutex) { CloseHandle(g_singletonMutex); g_singletonMutex = NULL; }
@@ -599,24 +1678,41 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     AddTrayIcon(g_hWnd);
     UpdateTrayIcon();
 
+    g_queueEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    // conditions that can repeat on every key press or reconnect attempt are logged at most once per interval
+    g_eventLog.SetRateLimit(LogCode::NoConnection, 30 * 1000000000LL);
+    g_eventLog.SetRateLimit(LogCode::ConnectFailed, 60 * 1000000000LL);
+    g_eventLog.SetRateLimit(LogCode::ConnectionLost, 10 * 1000000000LL);
+    g_eventLog.SetRateLimit(LogCode::QueueOverflow, 10 * 1000000000LL);
+    g_logEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    logThread = std::thread(EventLogWriter);
+
     // start websocket worker thread (will try to connect immediately and set connecting icon)
     wsThread = std::thread(WSWorker);
+    configThread = std::thread(ConfigWatcher);
 
-    keyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, LowLevelKeyboardProc, NULL, 0);
+    // the hooks read the cached foreground state; focus changes also drive the title indicator
+    InstallForegroundTracking();
 
-    if (!keyboardHook) {
+    // capture keys on their own thread; this thread only runs the tray UI from here on
+    if (!StartInputThread()) {
         MessageBoxW(NULL, L"Failed to install hook", L"KeySmasherClient", MB_OK | MB_ICONERROR);
+        RemoveForegroundTracking();
+        OnTargetChanged(NULL);
         running = false;
-        queueCv.notify_all();
+        WakeWorker();
+        SetEvent(g_logEvent);
         if (wsThread.joinable()) wsThread.join();
+        if (configThread.joinable()) configThread.join();
+        if (logThread.joinable()) logThread.join();
         RemoveTrayIcon(g_hWnd);
         DestroyWindow(g_hWnd);
         if (g_singletonMutex) { CloseHandle(g_singletonMutex); g_singletonMutex = NULL; }
         return 1;
     }
 
-    // start title animator
-    titleThread = std::thread(TitleAnimator);
+    if (LATENCY_DUMP_SECONDS > 0) statsThread = std::thread(LatencyDumper);
 
     // message loop for tray window and commands
     MSG msg;
@@ -625,13 +1721,18 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         DispatchMessage(&msg);
     }
 
-    // signal thread to stop and clean up
+    // signal threads to stop and clean up (input first, so nothing is captured during shutdown)
+    StopInputThread();
     running = false;
-    queueCv.notify_all();
+    WakeWorker();
     if (wsThread.joinable()) wsThread.join();
-    if (titleThread.joinable()) titleThread.join();
+    if (configThread.joinable()) configThread.join();
+    if (statsThread.joinable()) statsThread.join();
+    SetEvent(g_logEvent); // after the worker, so its last entries are written
+    if (logThread.joinable()) logThread.join();
 
-    UnhookWindowsHookEx(keyboardHook);
+    RemoveForegroundTracking();
+    OnTargetChanged(NULL); // give the target its title back
 
     RemoveTrayIcon(g_hWnd);
     if (g_hIconRunning) DestroyIcon(g_hIconRunning);
@@ -639,6 +1740,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     if (g_hIconConnecting) DestroyIcon(g_hIconConnecting);
     DestroyWindow(g_hWnd);
     UnregisterClass(wc.lpszClassName, hInstance);
+    if (g_queueEvent) { CloseHandle(g_queueEvent); g_queueEvent = NULL; }
+    if (g_logEvent) { CloseHandle(g_logEvent); g_logEvent = NULL; }
 
     if (g_singletonMutex) { CloseHandle(g_singletonMutex); g_singletonMutex = NULL; }
 
@@ -0,0 +1,66 @@
+// Latency against throughput of the flush scheduling: events arrive at a fixed rate while every
+// send occupies the (in-memory) transport for a fixed time; for each flush budget (fixed, and
+// adaptive at the largest) reports p50/p99 hook -> send complete, events per frame and frames per
+// second. Usage: flush_bench [sendUs] [seconds per run]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "SendPipeline.h"
+
+#include "MemoryTransport.h"
+
+static void Run(const FlushPolicy& flush, uint32_t eventsPerSecond, int64_t sendNs, double seconds) {
+    PipelineLatency latency;
+    SendStats stats;
+    SendPipeline pipeline(&latency, &stats, nullptr);
+    MemoryTransport transport(false);
+    transport.KeepFrames(false);
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 64;
+    options.flush = flush;
+
+    int64_t start = MonotonicNs();
+    int64_t end = start + (int64_t)(seconds * 1e9);
+    int64_t intervalNs = 1000000000LL / eventsPerSecond;
+    int64_t nextEventNs = start;
+    int64_t committedNs = 0;
+    uint64_t seq = 0;
+    for (int64_t now = start; now < end; now = MonotonicNs()) {
+        while (nextEventNs <= now) {
+            KeyEvent ev;
+            ev.vkCode = (uint8_t)('A' + (seq / 2) % 26);
+            ev.type = (seq % 2) ? KeyEventType::Up : KeyEventType::Down;
+            ev.hookNs = ev.stageNs = nextEventNs;
+            pipeline.Enqueue(&ev, 1, options);
+            nextEventNs += intervalNs;
+            seq++;
+        }
+        if (transport.Inflight() && now - committedNs >= sendNs) transport.CompleteSend();
+        pipeline.PollCompletions(transport);
+        // a held frame is simply polled again; the simulation spins anyway
+        if (pipeline.SendNext(transport, WireEncoding::Binary, options)) committedNs = MonotonicNs();
+    }
+    std::printf("%6u%s %8u events/s: p50 %6llu us  p99 %6llu us  %5.1f events/frame  %7.0f frames/s  backlog %zu\n",
+        flush.budgetUs, flush.adaptive ? "a" : " ", eventsPerSecond,
+        (unsigned long long)latency.total.Percentile(50), (unsigned long long)latency.total.Percentile(99),
+        stats.frames.load() ? (double)stats.events.load() / stats.frames.load() : 0.0, stats.frames.load() / seconds,
+        pipeline.Backlog());
+}
+
+int main(int argc, char** argv) {
+    int64_t sendUs = argc > 1 ? std::atoll(argv[1]) : 200;
+    double seconds = argc > 2 ? std::atof(argv[2]) : 0.5;
+    std::printf("send time %lld us; budget in us (a = adaptive)\n", (long long)sendUs);
+    const struct { uint32_t budgetUs; bool adaptive; } budgets[] = { { 0, false }, { 100, false }, { 250, false }, { 1000, false }, { 1000, true } };
+    const uint32_t rates[] = { 100, 1000, 5000, 20000, 100000 };
+    for (const auto& budget : budgets) {
+        FlushPolicy flush;
+        flush.budgetUs = budget.budgetUs;
+        flush.adaptive = budget.adaptive;
+        for (uint32_t rate : rates) Run(flush, rate, sendUs * 1000, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+// Synthetic input at real-time rates through the capture ring and SendPipeline: keys plus mouse
+// motion from a producer thread, a worker draining the ring into a transport whose sends take a
+// fixed time. Reports whether the rates are sustained and how deep the ring and the outbox get.
+// Usage: input_bench [seconds per run] [send time us]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "InputSource.h"
+#include "SendPipeline.h"
+#include "SpscRing.h"
+
+#include "MemoryTransport.h"
+
+struct Capture {
+    SpscRing<KeyEvent, 1024> ring; // EVENT_RING_CAPACITY
+    std::atomic<bool> stop{ false };
+};
+
+static void Produce(Capture* capture, uint32_t keysPerSecond, uint32_t movesPerSecond) {
+    int64_t start = MonotonicNs();
+    SyntheticKeySource keys(keysPerSecond, start);
+    SyntheticMouseSource mouse(movesPerSecond, start);
+    while (!capture->stop.load()) {
+        int64_t now = MonotonicNs();
+        for (uint64_t due = keys.Due(now); due > 0; --due) capture->ring.TryPush(keys.Next(now));
+        for (uint64_t due = mouse.Due(now); due > 0; --due) capture->ring.TryPush(mouse.Next(now));
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+static void Run(uint32_t keysPerSecond, uint32_t movesPerSecond, double seconds, int64_t sendNs) {
+    Capture capture;
+    PipelineLatency latency;
+    SendStats stats;
+    FilterStats filterStats;
+    SendPipeline pipeline(&latency, &stats, &filterStats);
+    MemoryTransport transport(false);
+    transport.KeepFrames(false);
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 64;
+
+    std::thread producer(Produce, &capture, keysPerSecond, movesPerSecond);
+    KeyEvent batch[64];
+    size_t maxQueued = 0; // ring depth seen by the worker (HighWater() is the producer's upper bound)
+    size_t maxBacklog = 0;
+    int64_t sentAt = 0;
+    int64_t end = MonotonicNs() + (int64_t)(seconds * 1e9);
+    for (int64_t now = MonotonicNs(); now < end; now = MonotonicNs()) {
+        size_t queued = capture.ring.Size();
+        if (queued > maxQueued) maxQueued = queued;
+        size_t n = capture.ring.PopBatch(batch, 64);
+        pipeline.Enqueue(batch, n, options);
+        if (pipeline.Backlog() > maxBacklog) maxBacklog = pipeline.Backlog();
+        if (transport.Inflight() && now - sentAt >= sendNs) transport.CompleteSend();
+        pipeline.PollCompletions(transport);
+        if (pipeline.SendNext(transport, WireEncoding::Compact, options)) sentAt = now;
+        if (n == 0) std::this_thread::yield();
+    }
+    capture.stop.store(true);
+    producer.join();
+
+    uint64_t captured = capture.ring.Pushed();
+    uint64_t events = stats.events.load();
+    std::printf("keys %6u/s mouse %6u/s: captured %8.0f/s  sent %8.0f events/s in %6.0f frames/s  merged %8llu  "
+                "ring depth %4zu  dropped %6llu  max backlog %4zu  left %4zu\n",
+        keysPerSecond, movesPerSecond, captured / seconds, events / seconds, stats.frames.load() / seconds,
+        (unsigned long long)filterStats.motionMerged.load(), maxQueued,
+        (unsigned long long)(capture.ring.Dropped() + pipeline.Dropped()), maxBacklog, pipeline.Backlog());
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+    int64_t sendNs = (argc > 2 ? std::strtoll(argv[2], nullptr, 10) : 1000) * 1000;
+    Run(20, 1000, seconds, sendNs);      // typing with a 1 kHz mouse
+    Run(1000, 0, seconds, sendNs);
+    Run(1000, 8000, seconds, sendNs);    // 8 kHz mouse
+    Run(10000, 100000, seconds, sendNs); // far past any real input
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Cost of a key state update on the input thread while another thread reads the state, for
+// KeyStateBitset and for the unordered_set under a mutex it replaced. Usage: key_state_bench [events]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "KeyState.h"
+
+struct MutexSetState {
+    std::mutex mutex;
+    std::unordered_set<int> keys;
+
+    void Apply(const KeyEvent& ev) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ev.type == KeyEventType::Down) keys.insert(ev.vkCode);
+        else keys.erase(ev.vkCode);
+    }
+    size_t Snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t n = 0;
+        for (int vk : keys) n += (size_t)vk;
+        return n;
+    }
+};
+
+struct BitsetState {
+    KeyStateBitset keys;
+
+    void Apply(const KeyEvent& ev) { keys.Apply(ev); }
+    size_t Snapshot() { return keys.Load().Count(); }
+};
+
+// readerSleepUs < 0: no reader; 0: reads back to back (worst case); > 0: reads at that interval
+template <typename State>
+static double NsPerUpdate(uint64_t events, int readerSleepUs) {
+    State state;
+    std::atomic<bool> done{ false };
+    std::thread reader;
+    if (readerSleepUs >= 0) {
+        reader = std::thread([&state, &done, readerSleepUs] {
+            volatile size_t sink = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                sink = sink + state.Snapshot();
+                if (readerSleepUs > 0) std::this_thread::sleep_for(std::chrono::microseconds(readerSleepUs));
+            }
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < events; ++i) {
+        KeyEvent ev;
+        ev.vkCode = (uint8_t)(1 + (i / 2) % 64);
+        ev.type = (i % 2) ? KeyEventType::Up : KeyEventType::Down;
+        state.Apply(ev);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    done = true;
+    if (reader.joinable()) reader.join();
+    return ns / events;
+}
+
+int main(int argc, char** argv) {
+    uint64_t events = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 5000000;
+    const int readers[] = { -1, 1000, 0 };
+    const char* names[] = { "no reader", "reader every 1 ms", "reader back to back" };
+    for (size_t i = 0; i < 3; ++i) {
+        std::printf("%-20s bitset %6.1f ns/update   unordered_set+mutex %6.1f ns/update\n", names[i],
+            NsPerUpdate<BitsetState>(events, readers[i]), NsPerUpdate<MutexSetState>(events, readers[i]));
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+// Per-event cost of KeyRemapper::Process in the hook: unmapped keys, remapped keys and chord
+// macros, each with an empty table and with a profile of typical size. Usage: keyremap_bench [events]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "KeyRemap.h"
+
+static void Run(const char* name, const KeyRemapTable& table, const uint8_t* keys, size_t keyCount, uint64_t events) {
+    KeyRemapper remapper;
+    RemapStats stats;
+    KeyEvent out[KeyRemapper::MAX_OUTPUT];
+    uint64_t produced = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < events; ++i) {
+        KeyEvent ev;
+        ev.vkCode = keys[(i / 2) % keyCount];
+        ev.type = (i % 2) ? KeyEventType::Up : KeyEventType::Down;
+        produced += remapper.Process(table, ev, true, out, &stats);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-28s %7.1f ns/event  %5.2f events out per event\n", name, ns / events, (double)produced / events);
+}
+
+int main(int argc, char** argv) {
+    uint64_t events = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+
+    KeyRemapTable empty;
+    KeyRemapTable profile;
+    const wchar_t* rules[] = {
+        L"CapsLock -> LCtrl", L"ScrollLock -> None", L"F13 -> H E L L O", L"LCtrl+Q -> LAlt+F4",
+        L"LCtrl+LShift+Q -> X", L"Q -> W", L"E -> R", L"LAlt+1 -> F1", L"LAlt+2 -> F2",
+    };
+    for (const wchar_t* rule : rules) profile.AddRule(rule, nullptr);
+
+    const uint8_t plain[] = { 'W', 'A', 'S', 'D', 0x20, 0xA0 };
+    const uint8_t remapped[] = { 0x14, 'Q', 'E' };
+    const uint8_t macro[] = { 0x7C };
+    Run("unmapped, empty table", empty, plain, sizeof(plain), events);
+    Run("unmapped, profile", profile, plain, sizeof(plain), events);
+    Run("remapped", profile, remapped, sizeof(remapped), events);
+    Run("macro (10 events)", profile, macro, sizeof(macro), events);
+    return 0;
+}
@@ -0,0 +1,86 @@
+// Throughput of the portable send path: events through SendPipeline into an in-memory transport,
+// per encoding and batch size, and the share of it spent encoding (what every mirror endpoint
+// repeats for itself). Usage: pipeline_bench [events]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "SendPipeline.h"
+
+#include "MemoryTransport.h"
+
+static void Run(const char* name, WireEncoding encoding, size_t batch, uint64_t total) {
+    PipelineLatency latency;
+    SendStats stats;
+    SendPipeline pipeline(&latency, &stats, nullptr);
+    MemoryTransport transport;
+    transport.KeepFrames(false);
+    SendOptions options;
+    options.batch = batch > 1;
+    options.maxEvents = batch;
+
+    KeyEvent batchEvents[64];
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t sent = 0; sent < total;) {
+        size_t n = batch < 64 ? batch : 64;
+        int64_t now = MonotonicNs();
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t seq = sent + i;
+            KeyEvent& ev = batchEvents[i];
+            ev = KeyEvent();
+            ev.time = (uint32_t)(seq / 4);
+            ev.vkCode = (uint8_t)('A' + (seq / 2) % 26);
+            ev.type = (seq % 2) ? KeyEventType::Up : KeyEventType::Down;
+            ev.scanCode = (uint16_t)(0x10 + ev.vkCode);
+            ev.hookNs = ev.stageNs = now;
+        }
+        pipeline.Enqueue(batchEvents, n, options);
+        while (pipeline.SendNext(transport, encoding, options)) pipeline.PollCompletions(transport);
+        sent += n;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t events = stats.events.load();
+    std::printf("%-8s batch %3zu: %10.0f events/s  %6.1f ns/event  %5.2f bytes/event  %6.1f events/frame\n", name, batch,
+        events / seconds, seconds * 1e9 / events, (double)stats.bytes.load() / events, (double)events / stats.frames.load());
+}
+
+// The encoder alone, on frames like the ones above
+static double EncodeNsPerEvent(WireEncoding encoding, size_t batch, uint64_t total) {
+    KeyEvent events[64];
+    for (size_t i = 0; i < 64; ++i) {
+        events[i].time = (uint32_t)(i / 4);
+        events[i].vkCode = (uint8_t)('A' + (i / 2) % 26);
+        events[i].type = (i % 2) ? KeyEventType::Up : KeyEventType::Down;
+        events[i].scanCode = (uint16_t)(0x10 + events[i].vkCode);
+    }
+    static uint8_t buf[64 * TEXT_EVENT_MAX_LEN];
+    size_t n = batch < 64 ? batch : 64;
+    volatile size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t done = 0; done < total; done += n) {
+        events[0].time = (uint32_t)done; // keeps the loop from being hoisted
+        switch (encoding) {
+        case WireEncoding::Text: sink = sink + EncodeTextBatch(events, n, (char*)buf, sizeof(buf)); break;
+        case WireEncoding::Binary: sink = sink + EncodeBinaryBatch(events, n, buf, sizeof(buf)); break;
+        case WireEncoding::Compact: sink = sink + EncodeCompactBatch(events, n, buf, sizeof(buf)); break;
+        }
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / total;
+}
+
+int main(int argc, char** argv) {
+    uint64_t total = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    const size_t batches[] = { 1, 8, 64 };
+    for (size_t batch : batches) {
+        Run("text", WireEncoding::Text, batch, total);
+        Run("binary", WireEncoding::Binary, batch, total);
+        Run("compact", WireEncoding::Compact, batch, total);
+    }
+    for (size_t batch : batches) {
+        std::printf("encode only, batch %3zu: text %5.1f  binary %5.1f  compact %5.1f ns/event\n", batch,
+            EncodeNsPerEvent(WireEncoding::Text, batch, total), EncodeNsPerEvent(WireEncoding::Binary, batch, total),
+            EncodeNsPerEvent(WireEncoding::Compact, batch, total));
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Offline replay of a trace through the capture filters, the capture ring and SendPipeline into an
+// in-memory transport, as fast as possible: events/s, per-stage latency and bytes on the wire per
+// encoding. Without a trace file a synthetic one (typing, a held key with auto-repeat, 1 kHz
+// mouse motion) is used, so runs are comparable between changes.
+// Usage: trace_replay_bench [trace file] [passes]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "EventFilter.h"
+#include "SendPipeline.h"
+#include "SpscRing.h"
+#include "TraceFormat.h"
+
+#include "MemoryTransport.h"
+
+static bool LoadTrace(const char* path, std::vector<KeyEvent>* events) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return false;
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), f)) > 0;) data.insert(data.end(), chunk, chunk + n);
+    std::fclose(f);
+
+    size_t recordLen = DecodeTraceHeader(data.data(), data.size());
+    if (recordLen == 0) return false;
+    for (size_t i = 0; i < TraceRecordCount(data.size(), recordLen); ++i) {
+        KeyEvent ev;
+        uint32_t deltaUs = 0;
+        if (DecodeTraceRecord(data.data() + TRACE_HEADER_LEN + i * recordLen, recordLen, &ev, &deltaUs)) events->push_back(ev);
+    }
+    return true;
+}
+
+static std::vector<KeyEvent> SyntheticTrace() {
+    std::vector<KeyEvent> events;
+    uint32_t time = 0;
+    for (int second = 0; second < 60; ++second) {
+        for (int ms = 0; ms < 1000; ++ms, ++time) {
+            KeyEvent move;
+            move.type = KeyEventType::MouseMove;
+            move.dx = (int16_t)((ms / 50) % 2 ? -3 : 3);
+            move.dy = 1;
+            move.time = time;
+            events.push_back(move);
+            if (ms % 100 == 0 || ms % 100 == 60) { // typing: ten taps a second
+                KeyEvent key;
+                key.vkCode = (uint8_t)('A' + (second * 10 + ms / 100) % 26);
+                key.type = ms % 100 ? KeyEventType::Up : KeyEventType::Down;
+                key.flags = ms % 100 ? KEY_FLAG_UP : 0;
+                key.time = time;
+                events.push_back(key);
+            }
+            if (ms % 33 == 0 && ms < 900) { // W held with auto-repeat for most of the second
+                KeyEvent w;
+                w.vkCode = 'W';
+                w.time = time;
+                events.push_back(w);
+            }
+            if (ms == 900) {
+                KeyEvent w;
+                w.vkCode = 'W';
+                w.type = KeyEventType::Up;
+                w.flags = KEY_FLAG_UP;
+                w.time = time;
+                events.push_back(w);
+            }
+        }
+    }
+    return events;
+}
+
+static void Replay(const char* name, const std::vector<KeyEvent>& trace, WireEncoding encoding, int passes) {
+    SpscRing<KeyEvent, 1024> ring;
+    KeyStateBitset pressed;
+    PipelineLatency latency;
+    SendStats stats;
+    FilterStats filterStats;
+    SendPipeline pipeline(&latency, &stats, &filterStats);
+    MemoryTransport transport;
+    transport.KeepFrames(false);
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 64;
+
+    KeyEvent batch[64];
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (size_t next = 0; next < trace.size();) {
+            // CaptureKeyEvent: repeats are dropped, the rest goes into the ring until it is full
+            for (; next < trace.size(); ++next) {
+                KeyEvent ev = trace[next];
+                if (IsAutoRepeat(pressed, ev)) {
+                    filterStats.repeatsDropped.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                ev.hookNs = ev.stageNs = MonotonicNs();
+                if (!ring.TryPush(ev)) break;
+                latency.hook.RecordNs(MonotonicNs() - ev.hookNs);
+                pressed.Apply(ev);
+            }
+            // WSWorker: CollectBatch and send until the ring is empty
+            for (size_t n; (n = ring.PopBatch(batch, 64)) > 0;) {
+                int64_t now = MonotonicNs();
+                for (size_t i = 0; i < n; ++i) {
+                    latency.queue.RecordNs(now - batch[i].stageNs);
+                    batch[i].stageNs = now;
+                }
+                pipeline.Enqueue(batch, n, options);
+                while (pipeline.SendNext(transport, encoding, options)) pipeline.PollCompletions(transport);
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t replayed = (uint64_t)trace.size() * passes;
+    std::printf("%s: %llu trace events in %.3f s, %.0f events/s; %llu sent in %llu frames, %llu bytes (%.2f per trace event); "
+                "repeats dropped %llu, motion merged %llu\n",
+        name, (unsigned long long)replayed, seconds, replayed / seconds, (unsigned long long)stats.events.load(),
+        (unsigned long long)stats.frames.load(), (unsigned long long)stats.bytes.load(), (double)stats.bytes.load() / replayed,
+        (unsigned long long)filterStats.repeatsDropped.load(), (unsigned long long)filterStats.motionMerged.load());
+    char table[1024];
+    if (latency.Format(table, sizeof(table)) > 0) std::fputs(table, stdout);
+}
+
+int main(int argc, char** argv) {
+    std::vector<KeyEvent> trace;
+    if (argc > 1) {
+        if (!LoadTrace(argv[1], &trace)) {
+            std::fprintf(stderr, "%s: not a trace file\n", argv[1]);
+            return 1;
+        }
+    } else {
+        trace = SyntheticTrace();
+    }
+    int passes = argc > 2 ? std::atoi(argv[2]) : 10;
+    Replay("text", trace, WireEncoding::Text, passes);
+    Replay("binary", trace, WireEncoding::Binary, passes);
+    Replay("compact", trace, WireEncoding::Compact, passes);
+    return 0;
+}
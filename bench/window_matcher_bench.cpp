@@ -0,0 +1,62 @@
+// Cost of evaluating the target window rules on a foreground change, with hundreds of rules of
+// each kind, and of a cache hit. Usage: window_matcher_bench [rules per kind] [lookups]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "WindowMatcher.h"
+
+static double NsPerMatch(const WindowRuleMatcher& m, const WindowInfo* windows, size_t windowCount, uint64_t lookups, size_t* hits) {
+    *hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < lookups; ++i) *hits += m.Matches(windows[i % windowCount]);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lookups;
+}
+
+int main(int argc, char** argv) {
+    size_t rules = argc > 1 ? (size_t)std::strtoul(argv[1], nullptr, 10) : 200;
+    uint64_t lookups = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200000;
+
+    WindowRuleMatcher prefixOnly, withClassAndProcess, withRegex;
+    for (size_t i = 0; i < rules; ++i) {
+        std::wstring n = std::to_wstring(i);
+        for (WindowRuleMatcher* m : { &prefixOnly, &withClassAndProcess, &withRegex }) m->AddRule(L"prefix:Remote Session " + n, nullptr);
+        withClassAndProcess.AddRule(L"class:StreamWindowClass" + n, nullptr);
+        withClassAndProcess.AddRule(L"process:client" + n + L".exe", nullptr);
+        withRegex.AddRule(L"class:StreamWindowClass" + n, nullptr);
+        withRegex.AddRule(L"process:client" + n + L".exe", nullptr);
+        withRegex.AddRule(L"regex:^Game " + n + L" \\((Windowed|Fullscreen)\\)$", nullptr);
+    }
+
+    // half the foreground windows are targets
+    WindowInfo windows[4];
+    windows[0].title = L"Remote Session 17 - connected";
+    windows[1].title = L"Untitled - Notepad";
+    windows[1].className = L"Notepad";
+    windows[1].processName = L"notepad.exe";
+    windows[2].title = L"Mail";
+    windows[2].className = L"StreamWindowClass42";
+    windows[3].title = L"Some document.txt - Editor";
+    windows[3].className = L"EditorFrame";
+    windows[3].processName = L"editor.exe";
+
+    size_t hits = 0;
+    std::printf("%zu rules per kind, %llu lookups\n", rules, (unsigned long long)lookups);
+    double ns = NsPerMatch(prefixOnly, windows, 4, lookups, &hits);
+    std::printf("prefix trie only          %8.1f ns/match  (%zu hits)\n", ns, hits);
+    ns = NsPerMatch(withClassAndProcess, windows, 4, lookups, &hits);
+    std::printf("+ class and process       %8.1f ns/match  (%zu hits)\n", ns, hits);
+    ns = NsPerMatch(withRegex, windows, 4, lookups / 100, &hits);
+    std::printf("+ regexes (misses scan)   %8.1f ns/match  (%zu hits)\n", ns, hits);
+
+    WindowMatchCache cache;
+    cache.Store((WindowHandle)0x1230, windows[0].title, true);
+    bool matched = false;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < lookups; ++i) hits += cache.Lookup((WindowHandle)0x1230, windows[0].title, &matched);
+    ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lookups;
+    std::printf("cache hit                 %8.1f ns/lookup\n", ns);
+    return 0;
+}
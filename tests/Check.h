@@ -0,0 +1,34 @@
+#pragma once
+
+// Minimal test support: CHECK records a failure and carries on, so one run reports every broken
+// expectation. A test program calls its test functions from main() and returns TestExitCode().
+
+#include <cstdio>
+
+inline int& TestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            TestFailures()++;                                                    \
+        }                                                                        \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                           \
+    do {                                                                         \
+        long long va_ = (long long)(a), vb_ = (long long)(b);                    \
+        if (va_ != vb_) {                                                        \
+            std::fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, va_, vb_); \
+            TestFailures()++;                                                    \
+        }                                                                        \
+    } while (0)
+
+inline int TestExitCode() {
+    if (TestFailures() == 0) return 0;
+    std::fprintf(stderr, "%d check(s) failed\n", TestFailures());
+    return 1;
+}
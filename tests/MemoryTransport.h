@@ -0,0 +1,101 @@
+#pragma once
+
+// In-memory ITransport for tests and benchmarks: keeps every committed frame and completes
+// sends when told to (or right away with autoComplete), so the pipeline can be driven step by
+// step without a network.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "KeyEvent.h"
+#include "LatencyStats.h"
+#include "Transport.h"
+#include "WireFormat.h"
+
+struct SentFrame {
+    std::vector<uint8_t> data;
+    bool binary = false;
+};
+
+class MemoryTransport : public ITransport {
+public:
+    explicit MemoryTransport(bool autoComplete = true) : autoComplete_(autoComplete), buffer_(4096) {}
+
+    TransportState State() const override { return state_; }
+    std::string Subprotocol() const override { return subprotocol_; }
+
+    uint8_t* SendBuffer(size_t* cap) override {
+        if (state_ != TransportState::Open || inflight_) return nullptr;
+        *cap = buffer_.size();
+        return buffer_.data();
+    }
+
+    bool CommitSend(size_t len, bool binary) override {
+        if (state_ != TransportState::Open || inflight_ || len > buffer_.size()) return false;
+        if (keepFrames_) {
+            SentFrame frame;
+            frame.data.assign(buffer_.begin(), buffer_.begin() + len);
+            frame.binary = binary;
+            frames_.push_back(frame);
+        }
+        frameCount_++;
+        inflight_ = true;
+        if (autoComplete_) CompleteSend();
+        return true;
+    }
+
+    uint64_t CompletedSends() const override { return completed_; }
+    int64_t LastSendCompleteNs() const override { return lastCompleteNs_; }
+
+    bool TakeMessage(std::string* out) override {
+        if (messages_.empty()) return false;
+        *out = messages_.front();
+        messages_.erase(messages_.begin());
+        return true;
+    }
+
+    void Close() override { state_ = TransportState::Closed; }
+    void Abort() override { state_ = TransportState::Closed; }
+    bool Finished() const override { return state_ == TransportState::Closed; }
+
+    // test controls
+    void SetState(TransportState state) { state_ = state; }
+    void CompleteSend() {
+        if (!inflight_) return;
+        inflight_ = false;
+        completed_++;
+        lastCompleteNs_ = MonotonicNs();
+    }
+    bool Inflight() const { return inflight_; }
+    void KeepFrames(bool keep) { keepFrames_ = keep; }
+    const std::vector<SentFrame>& Frames() const { return frames_; }
+    uint64_t FrameCount() const { return frameCount_; }
+    void ClearFrames() { frames_.clear(); }
+
+    // every event of the binary v1 frames sent so far, in order
+    std::vector<KeyEvent> SentEvents() const {
+        std::vector<KeyEvent> events;
+        for (const SentFrame& frame : frames_) {
+            KeyEvent decoded[BINARY_MAX_EVENTS];
+            size_t n = 0;
+            if (frame.binary && DecodeBinaryBatch(frame.data.data(), frame.data.size(), decoded, BINARY_MAX_EVENTS, &n)) {
+                events.insert(events.end(), decoded, decoded + n);
+            }
+        }
+        return events;
+    }
+
+private:
+    bool autoComplete_;
+    bool keepFrames_ = true;
+    TransportState state_ = TransportState::Open;
+    std::string subprotocol_ = WIRE_SUBPROTOCOL_BINARY;
+    std::vector<uint8_t> buffer_;
+    bool inflight_ = false;
+    uint64_t completed_ = 0;
+    int64_t lastCompleteNs_ = 0;
+    uint64_t frameCount_ = 0;
+    std::vector<SentFrame> frames_;
+    std::vector<std::string> messages_;
+};
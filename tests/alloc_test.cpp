@@ -0,0 +1,116 @@
+// Steady-state allocations of the capture -> send path, counted by AllocStats.cpp (built into this
+// test with KS_ALLOC_STATS): once everything is constructed, capturing, remapping, filtering,
+// encoding in every format, reconnecting and resyncing must not touch the heap on either thread.
+
+#include "AllocStats.h"
+#include "EventFilter.h"
+#include "InputSource.h"
+#include "KeyRemap.h"
+#include "SendPipeline.h"
+#include "SpscRing.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "MemoryTransport.h"
+
+static const uint64_t KEY_EVENTS = 50000;
+static const uint64_t MOTION_EVENTS = 50000;
+
+static void CountersSeeAllocations() {
+    AllocCounter counter;
+    TrackThreadAllocations(&counter);
+    std::vector<int>* v = new std::vector<int>(100);
+    delete v;
+    TrackThreadAllocations(nullptr);
+    CHECK(counter.count.load() > 0); // the compiler may fold the two allocations into one
+    CHECK(TotalAllocations() >= counter.count.load());
+}
+
+struct Capture {
+    SpscRing<KeyEvent, 1024> ring;
+    KeyStateBitset pressed;
+    FilterStats filterStats;
+    std::atomic<bool> done{ false };
+    AllocCounter allocations;
+};
+
+// The input thread: synthetic input through the remapper and the auto-repeat filter into the ring
+static void Produce(Capture* capture, const KeyRemapTable* table) {
+    KeyRemapper remapper;
+    RemapStats remapStats;
+    KeyEvent out[KeyRemapper::MAX_OUTPUT];
+    int64_t start = MonotonicNs();
+    SyntheticKeySource keys(10000000, start);
+    SyntheticMouseSource mouse(10000000, start);
+
+    TrackThreadAllocations(&capture->allocations);
+    while (keys.Emitted() < KEY_EVENTS || mouse.Emitted() < MOTION_EVENTS) {
+        int64_t now = MonotonicNs();
+        for (uint64_t due = keys.Due(now); due > 0 && keys.Emitted() < KEY_EVENTS; --due) {
+            size_t n = remapper.Process(*table, keys.Next(now), true, out, &remapStats);
+            for (size_t i = 0; i < n; ++i) {
+                if (IsAutoRepeat(capture->pressed, out[i])) continue;
+                while (!capture->ring.TryPush(out[i])) std::this_thread::yield();
+                capture->pressed.Apply(out[i]);
+            }
+        }
+        for (uint64_t due = mouse.Due(now); due > 0 && mouse.Emitted() < MOTION_EVENTS; --due) {
+            KeyEvent ev = mouse.Next(now);
+            while (!capture->ring.TryPush(ev)) std::this_thread::yield();
+        }
+    }
+    TrackThreadAllocations(nullptr);
+    capture->done.store(true);
+}
+
+static void SteadyStateDoesNotAllocate() {
+    KeyRemapTable table;
+    CHECK(table.AddRule(L"Q -> W", nullptr));
+    CHECK(table.AddRule(L"Z -> H E L L O", nullptr));
+
+    Capture capture;
+    PipelineLatency latency;
+    SendStats stats;
+    SendPipeline pipeline(&latency, &stats, &capture.filterStats);
+    MemoryTransport transport;
+    transport.KeepFrames(false);
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 64;
+    options.coalesceTaps = true;
+    options.stale.keyMaxAgeMs = 1000;
+    const WireEncoding encodings[] = { WireEncoding::Text, WireEncoding::Binary, WireEncoding::Compact };
+
+    AllocCounter allocations;
+    std::thread producer(Produce, &capture, &table);
+    TrackThreadAllocations(&allocations);
+    KeyEvent batch[64];
+    for (uint64_t pass = 0;; ++pass) {
+        bool finished = capture.done.load();
+        size_t n = capture.ring.PopBatch(batch, 64);
+        if (n == 0 && finished) break;
+        pipeline.Enqueue(batch, n, options);
+        if (pipeline.ExpireStale(options.stale, MonotonicNs())) pipeline.Resync(capture.pressed.Load(), 0);
+        if (pass % 1000 == 999) { // a reconnect now and then
+            pipeline.OnTransportLost();
+            pipeline.OnConnected(capture.pressed.Load(), 0);
+        }
+        while (pipeline.SendNext(transport, encodings[pass % 3], options)) pipeline.PollCompletions(transport);
+        if (n == 0) std::this_thread::yield();
+    }
+    TrackThreadAllocations(nullptr);
+    producer.join();
+
+    CHECK(stats.events.load() > 0);
+    CHECK_EQ(capture.allocations.count.load(), 0);
+    CHECK_EQ(allocations.count.load(), 0);
+}
+
+int main() {
+    CountersSeeAllocations();
+    SteadyStateDoesNotAllocate();
+    return TestExitCode();
+}
@@ -0,0 +1,95 @@
+// Ping/ack channel: message formatting and parsing, and the RTT / offset estimator against a
+// simulated server whose clock runs ahead of ours, over a path with queuing delay.
+
+#include "ClockSync.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "Check.h"
+
+// What a server does with a ping: echo t1 and add its own receive and send times
+static std::string Answer(const char* ping, size_t len, int64_t t2, int64_t t3) {
+    const char* p = ping + 1;
+    const char* end = ping + len;
+    int64_t seq = 0, t1 = 0;
+    CHECK(ParseInt64(p, end, &seq));
+    p++;
+    CHECK(ParseInt64(p, end, &t1));
+    return "a" + std::to_string(seq) + " " + std::to_string(t1) + " " + std::to_string(t2) + " " + std::to_string(t3);
+}
+
+static void PingAndAckRoundTrip() {
+    char buf[64];
+    size_t len = FormatPing(buf, sizeof(buf), 7, -12345);
+    CHECK(std::string(buf, len) == "p7 -12345");
+    std::string ack = Answer(buf, len, 1000, 1010);
+
+    volatile size_t small = 5; // not a constant, which the compiler would warn about
+    char tiny[8];
+    CHECK_EQ(FormatPing(tiny, small, 7, 12345), 0);
+
+    PingAck parsed;
+    CHECK(ParseAck(ack.data(), ack.size(), &parsed));
+    CHECK_EQ(parsed.seq, 7);
+    CHECK_EQ(parsed.t1, -12345);
+    CHECK_EQ(parsed.t2, 1000);
+    CHECK_EQ(parsed.t3, 1010);
+}
+
+static void MalformedAcksAreRejected() {
+    const char* bad[] = { "", "a", "p1 2 3 4", "a1 2 3", "a1 2 3 4 ", "a1  2 3 4", "a-1 2 3 4", "a4294967296 1 2 3", "a1 2 x 4" };
+    PingAck ack;
+    for (const char* msg : bad) CHECK(!ParseAck(msg, std::strlen(msg), &ack));
+    CHECK(ParseAck("a4294967295 1 2 3", 17, &ack));
+}
+
+static void EstimatesRttAndOffsetThroughQueuing() {
+    // the server clock is 5 s ahead; each direction takes 2 ms plus up to 8 ms of queuing,
+    // and one exchange in eight sees none
+    const int64_t OFFSET = 5000000;
+    std::mt19937 rng(3);
+    ClockSyncEstimator clock;
+    int64_t now = 0;
+    for (uint32_t seq = 1; seq <= 200; ++seq) {
+        now += 100000;
+        bool quiet = seq % 8 == 0;
+        int64_t up = 2000 + (quiet ? 0 : (int64_t)(rng() % 8000));
+        int64_t down = 2000 + (quiet ? 0 : (int64_t)(rng() % 8000));
+        char ping[64];
+        size_t len = FormatPing(ping, sizeof(ping), seq, now);
+        int64_t t2 = now + up + OFFSET;
+        std::string ackText = Answer(ping, len, t2, t2 + 50);
+        PingAck ack;
+        CHECK(ParseAck(ackText.data(), ackText.size(), &ack));
+        clock.AddSample(ack, now + up + 50 + down);
+    }
+    CHECK_EQ(clock.Samples(), 200);
+    // the offset comes from a queuing-free exchange: exact up to the path's asymmetry (none)
+    CHECK_EQ(clock.OffsetUs(), OFFSET);
+    CHECK(clock.SmoothedRttUs() > 4000 && clock.SmoothedRttUs() < 20000);
+    CHECK(clock.JitterUs() > 0);
+
+    clock.Reset();
+    CHECK_EQ(clock.Samples(), 0);
+    CHECK_EQ(clock.OffsetUs(), 0);
+}
+
+static void NegativeRttIsClamped() {
+    ClockSyncEstimator clock;
+    PingAck ack;
+    ack.t1 = 100;
+    ack.t2 = 200;
+    ack.t3 = 400; // the server claims to have held the ping longer than the whole exchange
+    clock.AddSample(ack, 150);
+    CHECK_EQ(clock.LastRttUs(), 0);
+}
+
+int main() {
+    PingAndAckRoundTrip();
+    MalformedAcksAreRejected();
+    EstimatesRttAndOffsetThroughQueuing();
+    NegativeRttIsClamped();
+    return TestExitCode();
+}
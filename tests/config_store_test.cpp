@@ -0,0 +1,139 @@
+// ConfigStore: readers on several threads while reloads are published, replaced snapshots freed
+// once no reader holds them, endpoint comparison used to decide which connections a reload restarts.
+
+#include "ClientConfig.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+
+static std::atomic<uint64_t> destroyed{ 0 };
+
+// Counts its destructions, to tell which snapshots the store has freed
+struct TrackedConfig : ClientConfig {
+    ~TrackedConfig() { destroyed.fetch_add(1); }
+};
+
+// A snapshot whose every field is derived from its version, so a reader can tell a torn one
+template <typename T = ClientConfig>
+static std::unique_ptr<T> Snapshot(uint64_t version) {
+    std::unique_ptr<T> cfg(new T());
+    cfg->version = version;
+    cfg->primary.host = L"host" + std::to_wstring(version);
+    cfg->primary.port = (uint16_t)(1000 + version % 1000);
+    cfg->batchMaxEvents = (int)(version % 64) + 1;
+    cfg->mirrors.resize(version % 4);
+    for (EndpointConfig& m : cfg->mirrors) m.host = cfg->primary.host;
+    cfg->remapProfile = std::to_wstring(version);
+    return cfg;
+}
+
+static bool Consistent(const ClientConfig& cfg) {
+    if (cfg.primary.host != L"host" + std::to_wstring(cfg.version)) return false;
+    if (cfg.primary.port != 1000 + cfg.version % 1000 || cfg.batchMaxEvents != (int)(cfg.version % 64) + 1) return false;
+    if (cfg.mirrors.size() != cfg.version % 4 || cfg.remapProfile != std::to_wstring(cfg.version)) return false;
+    for (const EndpointConfig& m : cfg.mirrors) {
+        if (m.host != cfg.primary.host) return false;
+    }
+    return true;
+}
+
+static void EmptyUntilFirstPublish() {
+    ConfigStore<ClientConfig> store;
+    CHECK(store.Acquire(0) == nullptr);
+    store.Publish(Snapshot(1));
+    const ClientConfig* first = store.Acquire(0);
+    CHECK_EQ(first->version, 1);
+    store.Publish(Snapshot(2));
+    CHECK_EQ(store.Current()->version, 2);
+    CHECK(Consistent(*first)); // an old snapshot stays valid for whoever still holds it...
+    CHECK_EQ(store.Retired(), 1);
+    CHECK_EQ(store.Acquire(0)->version, 2);
+    store.Publish(Snapshot(3));
+    CHECK_EQ(store.Retired(), 1); // ...version 2 now
+    store.Release(0);
+    store.Publish(Snapshot(4));
+    CHECK_EQ(store.Retired(), 0); // ...and is freed once nobody does
+}
+
+static void ReadersSeeWholeSnapshotsDuringReloads() {
+    const int READERS = 3;
+    const uint64_t RELOADS = 5000;
+    ConfigStore<TrackedConfig> store;
+    store.Publish(Snapshot<TrackedConfig>(1));
+    destroyed.store(0);
+
+    std::atomic<bool> done{ false };
+    std::atomic<int> started{ 0 };
+    std::atomic<uint64_t> reads{ 0 };
+    std::atomic<uint64_t> torn{ 0 };
+    std::atomic<uint64_t> backwards{ 0 };
+    std::vector<std::thread> readers;
+    for (int r = 0; r < READERS; ++r) {
+        readers.emplace_back([&, r] {
+            uint64_t last = 0, n = 0;
+            started.fetch_add(1);
+            do {
+                // what the hook and the worker do: acquire once per pass, then any number of fields
+                const TrackedConfig* cfg = store.Acquire(r);
+                if (!Consistent(*cfg)) torn.fetch_add(1);
+                if (cfg->version < last) backwards.fetch_add(1);
+                last = cfg->version;
+                n++;
+            } while (!done.load());
+            reads.fetch_add(n);
+        });
+    }
+
+    // the config watcher: build and validate off the hot path, then publish
+    while (started.load() < READERS) std::this_thread::yield();
+    size_t mostRetired = 0;
+    for (uint64_t version = 2; version <= RELOADS; ++version) {
+        store.Publish(Snapshot<TrackedConfig>(version));
+        size_t retired = store.Retired();
+        if (retired > mostRetired) mostRetired = retired;
+    }
+    done.store(true);
+    for (std::thread& t : readers) t.join();
+
+    CHECK(reads.load() > 0);
+    CHECK_EQ(torn.load(), 0);
+    CHECK_EQ(backwards.load(), 0);
+    CHECK_EQ(store.Current()->version, RELOADS);
+
+    // every replaced snapshot was freed except the ones a reader still held, one per reader at most
+    CHECK(mostRetired <= READERS);
+    CHECK_EQ(destroyed.load() + store.Retired(), RELOADS - 1);
+    for (int r = 0; r < READERS; ++r) store.Release(r);
+    store.Publish(Snapshot<TrackedConfig>(RELOADS + 1));
+    CHECK_EQ(store.Retired(), 0);
+    CHECK_EQ(destroyed.load(), RELOADS);
+}
+
+static void OnlyChangedEndpointsDiffer() {
+    std::unique_ptr<ClientConfig> before = Snapshot(1);
+    std::unique_ptr<ClientConfig> after = Snapshot(1);
+    after->batch = true; // settings that don't touch the endpoints
+    after->maxKeyAgeMs = 100;
+    CHECK(before->primary == after->primary);
+
+    EndpointConfig changed = before->primary;
+    changed.path = L"/other";
+    CHECK(changed != before->primary);
+    changed = before->primary;
+    changed.transport = EndpointTransport::Udp;
+    CHECK(changed != before->primary);
+    changed = before->primary;
+    changed.name = L"mirror";
+    CHECK(changed != before->primary);
+}
+
+int main() {
+    EmptyUntilFirstPublish();
+    ReadersSeeWholeSnapshotsDuringReloads();
+    OnlyChangedEndpointsDiffer();
+    return TestExitCode();
+}
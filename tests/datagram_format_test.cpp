@@ -0,0 +1,214 @@
+// UDP datagram protocol: headers, the repeated window and acks, key state datagrams, and a lossy
+// link (the server is simulated following the rules in DatagramFormat.h).
+
+#include "DatagramFormat.h"
+
+#include <random>
+#include <vector>
+
+#include "Check.h"
+
+static KeyEvent Key(uint8_t vk, KeyEventType type) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    return ev;
+}
+
+static std::vector<KeyEvent> DecodeEvents(const uint8_t* data, size_t len, uint32_t* firstSeq) {
+    KeyEvent events[BINARY_MAX_EVENTS];
+    size_t count = 0;
+    *firstSeq = GetU32(data + DATAGRAM_HEADER_LEN);
+    bool ok = DecodeBinaryBatch(data + DATAGRAM_HEADER_LEN + 4, len - DATAGRAM_HEADER_LEN - 4, events, BINARY_MAX_EVENTS, &count);
+    CHECK(ok);
+    return std::vector<KeyEvent>(events, events + count);
+}
+
+static void HeaderRoundTrip() {
+    uint8_t buf[DATAGRAM_HEADER_LEN];
+    EncodeDatagramHeader(DatagramType::Keys, 0xA1B2C3D4u, buf);
+    DatagramType type;
+    uint32_t seq = 0;
+    CHECK(DecodeDatagramHeader(buf, sizeof(buf), &type, &seq));
+    CHECK(type == DatagramType::Keys);
+    CHECK_EQ(seq, 0xA1B2C3D4u);
+
+    CHECK(!DecodeDatagramHeader(buf, sizeof(buf) - 1, &type, &seq));
+    buf[0] = 2;
+    CHECK(!DecodeDatagramHeader(buf, sizeof(buf), &type, &seq));
+    buf[0] = DATAGRAM_VERSION;
+    buf[1] = 4;
+    CHECK(!DecodeDatagramHeader(buf, sizeof(buf), &type, &seq));
+}
+
+static void UnackedEventsAreRepeatedUntilAcked() {
+    DatagramSender sender;
+    sender.Reset(4);
+    uint8_t buf[DATAGRAM_TARGET_SIZE * 2];
+    uint32_t first = 0;
+
+    KeyEvent a = Key('A', KeyEventType::Down);
+    size_t len = sender.EncodeEvents(&a, 1, buf, sizeof(buf));
+    std::vector<KeyEvent> events = DecodeEvents(buf, len, &first);
+    CHECK_EQ(first, 0);
+    CHECK_EQ(events.size(), 1);
+
+    // the second datagram repeats A before B
+    KeyEvent b = Key('B', KeyEventType::Down);
+    len = sender.EncodeEvents(&b, 1, buf, sizeof(buf));
+    events = DecodeEvents(buf, len, &first);
+    CHECK_EQ(first, 0);
+    CHECK_EQ(events.size(), 2);
+    CHECK_EQ(events[0].vkCode, 'A');
+    CHECK_EQ(events[1].vkCode, 'B');
+    CHECK_EQ(sender.Unacked(), 2);
+
+    // once A is acknowledged only B is repeated; stale and bogus acks change nothing
+    sender.OnAck(1);
+    sender.OnAck(0);
+    sender.OnAck(100);
+    CHECK_EQ(sender.Unacked(), 1);
+    len = sender.EncodeEvents(nullptr, 0, buf, sizeof(buf));
+    events = DecodeEvents(buf, len, &first);
+    CHECK_EQ(first, 1);
+    CHECK_EQ(events.size(), 1);
+    CHECK_EQ(events[0].vkCode, 'B');
+
+    sender.OnAck(2);
+    CHECK_EQ(sender.Unacked(), 0);
+    CHECK_EQ(sender.EncodeEvents(nullptr, 0, buf, sizeof(buf)), 0); // nothing to repeat
+}
+
+static void RepeatsAreBoundedByTheRedundancy() {
+    DatagramSender sender;
+    sender.Reset(3);
+    uint8_t buf[DATAGRAM_TARGET_SIZE * 2];
+    for (int i = 0; i < 10; ++i) {
+        KeyEvent ev = Key((uint8_t)('A' + i), KeyEventType::Down);
+        sender.EncodeEvents(&ev, 1, buf, sizeof(buf));
+    }
+    KeyEvent ev = Key('Z', KeyEventType::Down);
+    uint32_t first = 0;
+    size_t len = sender.EncodeEvents(&ev, 1, buf, sizeof(buf));
+    std::vector<KeyEvent> events = DecodeEvents(buf, len, &first);
+    CHECK_EQ(events.size(), 4);
+    CHECK_EQ(first, 7);
+    CHECK_EQ(events[0].vkCode, 'H');
+    CHECK_EQ(events[3].vkCode, 'Z');
+
+    // a buffer too small for the datagram encodes nothing
+    CHECK_EQ(sender.EncodeEvents(&ev, 1, buf, DATAGRAM_HEADER_LEN + 4), 0);
+}
+
+static void KeysDatagramCarriesTheHeldKeys() {
+    DatagramSender sender;
+    sender.Reset(16);
+    uint8_t buf[DATAGRAM_TARGET_SIZE];
+    KeyEvent events[] = { Key(0x10, KeyEventType::Down), Key('A', KeyEventType::Down), Key(0xA5, KeyEventType::Down), Key('A', KeyEventType::Up) };
+    sender.EncodeEvents(events, 4, buf, sizeof(buf));
+
+    size_t len = sender.EncodeKeys(buf, sizeof(buf));
+    CHECK_EQ(len, DATAGRAM_KEYS_LEN);
+    DatagramType type;
+    uint32_t seq = 0;
+    CHECK(DecodeDatagramHeader(buf, len, &type, &seq));
+    CHECK(type == DatagramType::Keys);
+    CHECK_EQ(seq, 1);
+    CHECK_EQ(GetU32(buf + DATAGRAM_HEADER_LEN), 4);
+    const uint8_t* bitmap = buf + DATAGRAM_HEADER_LEN + 4;
+    CHECK_EQ(bitmap[0x10 / 8], 1 << (0x10 % 8));
+    CHECK_EQ(bitmap['A' / 8], 0);
+    CHECK_EQ(bitmap[0xA5 / 8], 1 << (0xA5 % 8));
+    CHECK_EQ(sender.EncodeKeys(buf, DATAGRAM_KEYS_LEN - 1), 0);
+}
+
+static void ReleaseAllSendsAnEmptyKeyState() {
+    DatagramSender sender;
+    sender.Reset(16);
+    uint8_t buf[DATAGRAM_TARGET_SIZE];
+    KeyEvent down = Key('A', KeyEventType::Down);
+    sender.EncodeEvents(&down, 1, buf, sizeof(buf));
+
+    size_t len = sender.EncodeReleaseAll(buf, sizeof(buf));
+    CHECK_EQ(len, DATAGRAM_KEYS_LEN);
+    for (size_t i = 0; i < 32; ++i) CHECK_EQ(buf[DATAGRAM_HEADER_LEN + 4 + i], 0);
+    CHECK(!sender.Keys().Test('A'));
+}
+
+// A server following the protocol: events in sequence order, a resync from the key state after a gap
+struct SimulatedServer {
+    uint32_t nextExpected = 0;
+    bool held[256] = {};
+
+    void Receive(const uint8_t* data, size_t len) {
+        DatagramType type;
+        uint32_t seq;
+        if (!DecodeDatagramHeader(data, len, &type, &seq)) return;
+        if (type == DatagramType::Events) {
+            uint32_t first = 0;
+            std::vector<KeyEvent> events = DecodeEvents(data, len, &first);
+            for (size_t i = 0; i < events.size(); ++i) {
+                uint32_t s = first + (uint32_t)i;
+                if ((int32_t)(s - nextExpected) < 0) continue;
+                if (IsKeyTransition(events[i])) held[events[i].vkCode] = events[i].type == KeyEventType::Down;
+                nextExpected = s + 1;
+            }
+        } else if (type == DatagramType::Keys) {
+            if (GetU32(data + DATAGRAM_HEADER_LEN) != nextExpected) return; // events still missing
+            for (int vk = 0; vk < 256; ++vk) held[vk] = (data[DATAGRAM_HEADER_LEN + 4 + vk / 8] >> (vk % 8)) & 1;
+        }
+    }
+};
+
+static void LossyLinkEndsInTheSenderKeyState() {
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> percent(0, 99);
+    DatagramSender sender;
+    sender.Reset(16);
+    SimulatedServer server;
+    uint8_t buf[DATAGRAM_TARGET_SIZE * 2];
+    bool down[256] = {};
+
+    // 20% of the datagrams are lost; acks always arrive
+    size_t lost = 0;
+    for (int i = 0; i < 5000; ++i) {
+        uint8_t vk = (uint8_t)('A' + rng() % 8);
+        KeyEvent ev = Key(vk, down[vk] ? KeyEventType::Up : KeyEventType::Down);
+        down[vk] = !down[vk];
+        size_t len = sender.EncodeEvents(&ev, 1, buf, sizeof(buf));
+        CHECK(len > 0);
+        if (percent(rng) < 20) { lost++; continue; }
+        server.Receive(buf, len);
+        sender.OnAck(server.nextExpected);
+    }
+    CHECK(lost > 0);
+
+    // the engine repeats the window while the link is quiet, then the periodic key state
+    // repairs whatever the window couldn't
+    size_t len = 0;
+    while (sender.Unacked() > 0) {
+        len = sender.EncodeEvents(nullptr, 0, buf, sizeof(buf));
+        server.Receive(buf, len);
+        sender.OnAck(server.nextExpected);
+    }
+    len = sender.EncodeKeys(buf, sizeof(buf));
+    server.Receive(buf, len);
+    for (int vk = 0; vk < 256; ++vk) CHECK_EQ(server.held[vk], down[vk]);
+
+    // closing: even with most copies lost, one empty key state releases everything
+    for (size_t i = 0; i < sender.Redundancy(); ++i) {
+        len = sender.EncodeReleaseAll(buf, sizeof(buf));
+        if (i % 4 == 3) server.Receive(buf, len);
+    }
+    for (int vk = 0; vk < 256; ++vk) CHECK(!server.held[vk]);
+}
+
+int main() {
+    HeaderRoundTrip();
+    UnackedEventsAreRepeatedUntilAcked();
+    RepeatsAreBoundedByTheRedundancy();
+    KeysDatagramCarriesTheHeldKeys();
+    ReleaseAllSendsAnEmptyKeyState();
+    LossyLinkEndsInTheSenderKeyState();
+    return TestExitCode();
+}
@@ -0,0 +1,178 @@
+// Capture-side filters: auto-repeat detection, motion accumulation and tap coalescing with
+// interleaved keys, repeated key-downs and motion in between, and a recorded trace replayed
+// through the whole filter chain.
+
+#include "EventFilter.h"
+#include "SendPipeline.h"
+#include "TraceFormat.h"
+
+#include <vector>
+
+#include "Check.h"
+#include "MemoryTransport.h"
+
+static KeyEvent Key(uint8_t vk, KeyEventType type) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    return ev;
+}
+
+static KeyEvent Move(int16_t dx, int16_t dy) {
+    KeyEvent ev;
+    ev.type = KeyEventType::MouseMove;
+    ev.dx = dx;
+    ev.dy = dy;
+    return ev;
+}
+
+static std::vector<KeyEvent> Coalesce(std::vector<KeyEvent> events, FilterStats* stats = nullptr) {
+    events.resize(CoalesceTaps(events.data(), events.size(), stats));
+    return events;
+}
+
+static void AutoRepeatIsAKeyDownForAHeldKey() {
+    KeyStateBitset pressed;
+    CHECK(!IsAutoRepeat(pressed, Key('A', KeyEventType::Down)));
+    pressed.Set('A');
+    CHECK(IsAutoRepeat(pressed, Key('A', KeyEventType::Down)));
+    CHECK(!IsAutoRepeat(pressed, Key('A', KeyEventType::Up)));
+    CHECK(!IsAutoRepeat(pressed, Key('B', KeyEventType::Down)));
+}
+
+static void MotionAccumulatesUntilItWouldOverflow() {
+    KeyEvent queued = Move(10, -5);
+    queued.hookNs = 100;
+    KeyEvent next = Move(3, 4);
+    next.hookNs = 200;
+    CHECK(AccumulateMotion(queued, next));
+    CHECK_EQ(queued.dx, 13);
+    CHECK_EQ(queued.dy, -1);
+    CHECK_EQ(queued.hookNs, 100); // latency counts from the oldest motion
+
+    KeyEvent big = Move(32760, 0);
+    CHECK(!AccumulateMotion(queued, big));
+    CHECK_EQ(queued.dx, 13);
+
+    KeyEvent wheel;
+    wheel.type = KeyEventType::MouseWheel;
+    wheel.dx = 120;
+    CHECK(!AccumulateMotion(queued, wheel));
+    KeyEvent key = Key('A', KeyEventType::Down);
+    CHECK(!AccumulateMotion(queued, key));
+}
+
+static void InterleavedTapsCancel() {
+    // A down, B down, A up, B up: both taps go, whatever is between them stays
+    FilterStats stats;
+    std::vector<KeyEvent> out = Coalesce({ Key('A', KeyEventType::Down), Key('B', KeyEventType::Down), Move(1, 1),
+        Key('A', KeyEventType::Up), Key('C', KeyEventType::Up), Key('B', KeyEventType::Up) }, &stats);
+    CHECK_EQ(out.size(), 2);
+    CHECK(out[0].type == KeyEventType::MouseMove);
+    CHECK_EQ(out[1].vkCode, 'C');
+    CHECK_EQ(stats.tapsCoalesced.load(), 2);
+}
+
+static void KeysHeldAcrossTheBatchStay() {
+    // an up without its down, a down without its up: nothing to cancel
+    std::vector<KeyEvent> out = Coalesce({ Key('A', KeyEventType::Up), Key('B', KeyEventType::Down), Key('A', KeyEventType::Down) });
+    CHECK_EQ(out.size(), 3);
+}
+
+static void RepeatedDownsAreLeftAlone() {
+    // two downs before the up: removing one pair would leave the key held, so none is removed;
+    // the next tap of the same key coalesces again
+    std::vector<KeyEvent> out = Coalesce({ Key('A', KeyEventType::Down), Key('A', KeyEventType::Down), Key('A', KeyEventType::Up),
+        Key('A', KeyEventType::Down), Key('A', KeyEventType::Up) });
+    CHECK_EQ(out.size(), 3);
+    CHECK(out[0].type == KeyEventType::Down);
+    CHECK(out[1].type == KeyEventType::Down);
+    CHECK(out[2].type == KeyEventType::Up);
+}
+
+static void RemainingOrderIsKept() {
+    std::vector<KeyEvent> out = Coalesce({ Key('X', KeyEventType::Down), Key('A', KeyEventType::Down), Key('A', KeyEventType::Up),
+        Key('Y', KeyEventType::Down), Key('B', KeyEventType::Down), Key('B', KeyEventType::Up), Key('X', KeyEventType::Up) });
+    // X's down and up pair up around the other taps as well
+    CHECK_EQ(out.size(), 1);
+    CHECK_EQ(out[0].vkCode, 'Y');
+
+    FilterStats stats;
+    out = Coalesce({ Key('A', KeyEventType::Down) }, &stats);
+    CHECK_EQ(out.size(), 1);
+    CHECK_EQ(stats.tapsCoalesced.load(), 0);
+}
+
+// A trace as the capture writes it: W held with auto-repeat while the mouse moves, a quick tap
+// of E, then W released
+static std::vector<uint8_t> RecordedTrace() {
+    std::vector<KeyEvent> events;
+    events.push_back(Key('W', KeyEventType::Down));
+    for (int i = 0; i < 5; ++i) {
+        events.push_back(Key('W', KeyEventType::Down));
+        events.push_back(Move(2, -1));
+    }
+    events.push_back(Key('E', KeyEventType::Down));
+    events.push_back(Key('E', KeyEventType::Up));
+    events.push_back(Key('W', KeyEventType::Up));
+
+    std::vector<uint8_t> trace(TRACE_HEADER_LEN + events.size() * TRACE_RECORD_LEN);
+    EncodeTraceHeader(trace.data());
+    for (size_t i = 0; i < events.size(); ++i) {
+        events[i].time = (uint32_t)(i * 8);
+        EncodeTraceRecord(trace.data() + TRACE_HEADER_LEN + i * TRACE_RECORD_LEN, events[i], 8000);
+    }
+    return trace;
+}
+
+static void ReplayedTraceThroughTheFilters() {
+    std::vector<uint8_t> trace = RecordedTrace();
+    size_t recordLen = DecodeTraceHeader(trace.data(), trace.size());
+    CHECK_EQ(recordLen, TRACE_RECORD_LEN);
+
+    // capture side: repeats are dropped against the pressed-key state (as CaptureKeyEvent does)
+    KeyStateBitset pressed;
+    PipelineLatency latency;
+    SendStats sendStats;
+    FilterStats stats;
+    SendPipeline pipeline(&latency, &sendStats, &stats);
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 64;
+    options.coalesceTaps = true;
+    for (size_t i = 0; i < TraceRecordCount(trace.size(), recordLen); ++i) {
+        KeyEvent ev;
+        uint32_t deltaUs = 0;
+        CHECK(DecodeTraceRecord(trace.data() + TRACE_HEADER_LEN + i * recordLen, recordLen, &ev, &deltaUs));
+        if (IsAutoRepeat(pressed, ev)) {
+            stats.repeatsDropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        ev.hookNs = ev.stageNs = 1;
+        pipeline.Enqueue(&ev, 1, options);
+        pressed.Apply(ev);
+    }
+
+    // send side: the motion is one event, the E tap and then the W press cancel out
+    MemoryTransport transport;
+    while (pipeline.SendNext(transport, WireEncoding::Binary, options)) pipeline.PollCompletions(transport);
+    std::vector<KeyEvent> sent = transport.SentEvents();
+    CHECK_EQ(sent.size(), 1);
+    CHECK(sent[0].type == KeyEventType::MouseMove);
+    CHECK_EQ(sent[0].dx, 10);
+    CHECK_EQ(sent[0].dy, -5);
+    CHECK_EQ(stats.repeatsDropped.load(), 5);
+    CHECK_EQ(stats.motionMerged.load(), 4);
+    CHECK_EQ(stats.tapsCoalesced.load(), 2);
+}
+
+int main() {
+    AutoRepeatIsAKeyDownForAHeldKey();
+    MotionAccumulatesUntilItWouldOverflow();
+    InterleavedTapsCancel();
+    KeysHeldAcrossTheBatchStay();
+    RepeatedDownsAreLeftAlone();
+    RemainingOrderIsKept();
+    ReplayedTraceThroughTheFilters();
+    return TestExitCode();
+}
@@ -0,0 +1,148 @@
+// Event log: per-code rate limits (also across threads), truncated text, a full ring dropping
+// instead of blocking, and several producers posting while the consumer is stalled or slow.
+
+#include "EventLog.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+
+static const int64_t MS = 1000000;
+
+static void RateLimitIsPerCode() {
+    EventLog<8> log;
+    log.SetRateLimit(LogCode::NoConnection, 1000 * MS);
+    CHECK(log.Post(0, LogLevel::Alert, LogCode::NoConnection, "no connection"));
+    CHECK(!log.Post(500 * MS, LogLevel::Alert, LogCode::NoConnection, "no connection"));
+    CHECK(log.Post(500 * MS, LogLevel::Info, LogCode::Connected, "connected")); // not limited
+    CHECK(log.Post(1000 * MS, LogLevel::Alert, LogCode::NoConnection, "no connection"));
+    CHECK_EQ(log.Suppressed(), 1);
+
+    LogEntry e;
+    CHECK(log.Take(&e));
+    CHECK(e.code == LogCode::NoConnection);
+    CHECK(e.level == LogLevel::Alert);
+    CHECK(std::strcmp(e.text, "no connection") == 0);
+    CHECK(log.Take(&e));
+    CHECK(e.code == LogCode::Connected);
+    CHECK_EQ(e.timeNs, 500 * MS);
+    CHECK(log.Take(&e));
+    CHECK(!log.Take(&e));
+}
+
+static void LongTextIsTruncated() {
+    EventLog<2> log;
+    std::vector<char> text(LOG_TEXT_LEN * 2, 'x');
+    text.back() = '\0';
+    CHECK(log.Post(0, LogLevel::Warning, LogCode::ConfigWarning, text.data()));
+    LogEntry e;
+    CHECK(log.Take(&e));
+    CHECK_EQ(std::strlen(e.text), LOG_TEXT_LEN - 1);
+}
+
+static void FullRingDropsNewest() {
+    EventLog<4> log;
+    for (int i = 0; i < 6; ++i) log.Post(i, LogLevel::Info, LogCode::QueueOverflow, i < 4 ? "kept" : "dropped");
+    CHECK_EQ(log.Dropped(), 2);
+    LogEntry e;
+    int taken = 0;
+    while (log.Take(&e)) {
+        CHECK(std::strcmp(e.text, "kept") == 0);
+        CHECK_EQ(e.timeNs, taken++);
+    }
+    CHECK_EQ(taken, 4);
+    CHECK(log.Post(10, LogLevel::Info, LogCode::QueueOverflow, "room again"));
+}
+
+static const int PRODUCERS = 4;
+static const int POSTS = 50000;
+
+// Each producer posts its own numbered entries, without rate limits, as fast as it can
+static void Produce(EventLog<64>* log, int id, std::atomic<int>* accepted) {
+    char text[32];
+    for (int i = 0; i < POSTS; ++i) {
+        std::snprintf(text, sizeof(text), "%d %d", id, i);
+        if (log->Post(i, LogLevel::Alert, LogCode::ConnectFailed, text)) accepted->fetch_add(1);
+    }
+}
+
+static void ProducersNeverWaitForTheConsumer() {
+    // nobody drains the log: every producer still finishes, the overflow is only counted
+    EventLog<64> log;
+    std::atomic<int> accepted{ 0 };
+    std::vector<std::thread> producers;
+    for (int id = 0; id < PRODUCERS; ++id) producers.emplace_back(Produce, &log, id, &accepted);
+    for (std::thread& t : producers) t.join();
+    CHECK_EQ(accepted.load(), 64);
+    CHECK_EQ(log.Dropped(), PRODUCERS * POSTS - 64);
+    CHECK_EQ(log.Suppressed(), 0); // no rate limit: timestamps from different threads interleave freely
+}
+
+static void RateLimitHoldsAcrossThreads() {
+    // a condition hit on every key press by several threads at once still logs once per interval
+    EventLog<64> log;
+    log.SetRateLimit(LogCode::NoConnection, 1000 * MS);
+    std::atomic<int> accepted{ 0 };
+    std::vector<std::thread> producers;
+    for (int id = 0; id < PRODUCERS; ++id) {
+        producers.emplace_back([&] {
+            for (int i = 0; i < POSTS; ++i) {
+                if (log.Post(i, LogLevel::Alert, LogCode::NoConnection, "no connection")) accepted.fetch_add(1);
+            }
+        });
+    }
+    for (std::thread& t : producers) t.join();
+    CHECK_EQ(accepted.load(), 1);
+    CHECK_EQ(log.Suppressed(), PRODUCERS * POSTS - 1);
+}
+
+static void EntriesStayIntactUnderContention() {
+    // a consumer that can't keep up: entries are whole and in order per producer
+    EventLog<64> log;
+    std::atomic<int> accepted{ 0 };
+    std::atomic<bool> done{ false };
+    int taken = 0;
+    int last[PRODUCERS];
+    for (int& l : last) l = -1;
+    std::thread consumer([&] {
+        LogEntry e;
+        for (;;) {
+            bool finished = done.load();
+            if (!log.Take(&e)) {
+                if (finished) break;
+                std::this_thread::yield();
+                continue;
+            }
+            int id = -1, i = -1;
+            CHECK(std::sscanf(e.text, "%d %d", &id, &i) == 2);
+            CHECK(id >= 0 && id < PRODUCERS);
+            CHECK_EQ(e.timeNs, i);
+            if (id >= 0 && id < PRODUCERS) {
+                CHECK(i > last[id]);
+                last[id] = i;
+            }
+            taken++;
+        }
+    });
+    std::vector<std::thread> producers;
+    for (int id = 0; id < PRODUCERS; ++id) producers.emplace_back(Produce, &log, id, &accepted);
+    for (std::thread& t : producers) t.join();
+    done.store(true);
+    consumer.join();
+    CHECK_EQ(taken, accepted.load());
+    CHECK_EQ((uint64_t)accepted.load() + log.Dropped(), PRODUCERS * POSTS);
+}
+
+int main() {
+    RateLimitIsPerCode();
+    LongTextIsTruncated();
+    FullRingDropsNewest();
+    ProducersNeverWaitForTheConsumer();
+    RateLimitHoldsAcrossThreads();
+    EntriesStayIntactUnderContention();
+    return TestExitCode();
+}
@@ -0,0 +1,170 @@
+// Flush scheduling: an idle transport gets queued events immediately, events queued behind an
+// in-flight frame go out together and are held for at most the budget, the budget adapts to the
+// smoothed send latency.
+
+#include "FlushScheduler.h"
+#include "SendPipeline.h"
+
+#include <chrono>
+#include <thread>
+
+#include "Check.h"
+#include "MemoryTransport.h"
+
+static KeyEvent Key(uint8_t vk, KeyEventType type) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    ev.hookNs = ev.stageNs = MonotonicNs();
+    return ev;
+}
+
+static const int64_t US = 1000;
+
+static void HoldsOnlyWhatQueuedBehindASend() {
+    FlushScheduler scheduler;
+    FlushPolicy policy;
+    policy.budgetUs = 500;
+    policy.adaptive = false;
+    const int64_t completed = 10000 * US;
+    int64_t flushAt = 0;
+
+    // arrived while nothing was in flight: right away, even just after a completion
+    CHECK(scheduler.ShouldFlush(policy, completed + 1 * US, completed, 1, 64, completed, &flushAt));
+    CHECK(scheduler.ShouldFlush(policy, completed + 1 * US, completed + 1 * US, 1, 64, completed, &flushAt));
+    CHECK(scheduler.ShouldFlush(policy, 1 * US, 1 * US, 1, 64, 0, &flushAt)); // nothing ever sent
+    CHECK_EQ(flushAt, 0);
+
+    // queued behind the frame that just completed: held until the oldest has waited the budget
+    int64_t oldest = completed - 100 * US;
+    CHECK(!scheduler.ShouldFlush(policy, completed, oldest, 3, 64, completed, &flushAt));
+    CHECK_EQ(flushAt, oldest + 500 * US);
+    CHECK(scheduler.ShouldFlush(policy, oldest + 500 * US, oldest, 3, 64, completed, &flushAt));
+    // a send that took longer than the budget: nothing more to wait for
+    CHECK(scheduler.ShouldFlush(policy, completed, completed - 600 * US, 3, 64, completed, &flushAt));
+    // full frames and synthesized events never wait
+    CHECK(scheduler.ShouldFlush(policy, completed, oldest, 64, 64, completed, &flushAt));
+    CHECK(scheduler.ShouldFlush(policy, completed, 0, 3, 64, completed, &flushAt));
+    // no budget: the old behaviour, flush whenever the transport can take a frame
+    policy.budgetUs = 0;
+    CHECK(scheduler.ShouldFlush(policy, completed, oldest, 3, 64, completed, &flushAt));
+}
+
+static void BudgetAdaptsToSendLatency() {
+    FlushScheduler scheduler;
+    FlushPolicy policy;
+    policy.budgetUs = 500;
+    CHECK_EQ(scheduler.BudgetUs(policy), 500); // nothing measured yet
+    for (int i = 0; i < 50; ++i) scheduler.OnSendComplete(400 * US);
+    CHECK_EQ(scheduler.BudgetUs(policy), 200); // half the smoothed send time...
+    for (int i = 0; i < 50; ++i) scheduler.OnSendComplete(5000 * US);
+    CHECK_EQ(scheduler.BudgetUs(policy), 500); // ...capped by the configured budget
+    policy.adaptive = false;
+    for (int i = 0; i < 50; ++i) scheduler.OnSendComplete(100 * US);
+    CHECK_EQ(scheduler.BudgetUs(policy), 500);
+}
+
+static void SmoothsSendLatency() {
+    FlushScheduler scheduler;
+    scheduler.OnSendComplete(800000);
+    CHECK_EQ(scheduler.SmoothedSendUs(), 800);
+    for (int i = 0; i < 100; ++i) scheduler.OnSendComplete(100000);
+    CHECK(scheduler.SmoothedSendUs() >= 100 && scheduler.SmoothedSendUs() < 110);
+    scheduler.OnSendComplete(-5);
+    CHECK(scheduler.SmoothedSendUs() < 100);
+}
+
+static void IdleTransportIsNeverHeldBack() {
+    PipelineLatency latency;
+    SendStats stats;
+    SendPipeline pipeline(&latency, &stats, nullptr);
+    MemoryTransport transport;
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 64;
+    options.flush.budgetUs = 50000;
+    options.flush.adaptive = false;
+
+    // a frame completed a moment ago: the next event still goes out right away
+    for (int i = 0; i < 10; ++i) {
+        KeyEvent ev = Key('A', i % 2 ? KeyEventType::Up : KeyEventType::Down);
+        pipeline.Enqueue(&ev, 1, options);
+        CHECK(pipeline.SendNext(transport, WireEncoding::Binary, options));
+        pipeline.PollCompletions(transport);
+    }
+    CHECK_EQ(stats.frames.load(), 10);
+}
+
+static void EventsBehindAnInflightFrameGoTogether() {
+    for (uint32_t budgetUs : { 0u, 100000u }) {
+        PipelineLatency latency;
+        SendStats stats;
+        SendPipeline pipeline(&latency, &stats, nullptr);
+        MemoryTransport transport(false);
+        SendOptions options;
+        options.batch = true;
+        options.maxEvents = 64;
+        options.flush.budgetUs = budgetUs;
+        options.flush.adaptive = false;
+
+        KeyEvent first = Key('A', KeyEventType::Down);
+        pipeline.Enqueue(&first, 1, options);
+        CHECK(pipeline.SendNext(transport, WireEncoding::Binary, options));
+
+        int64_t flushAt = 0;
+        for (uint8_t vk = 'B'; vk <= 'K'; ++vk) {
+            KeyEvent ev = Key(vk, KeyEventType::Down);
+            pipeline.Enqueue(&ev, 1, options);
+            CHECK(!pipeline.SendNext(transport, WireEncoding::Binary, options, &flushAt));
+            CHECK_EQ(flushAt, 0); // waiting for the completion, not for the budget
+        }
+        transport.CompleteSend();
+        pipeline.PollCompletions(transport);
+        if (budgetUs > 0) {
+            // held for more company, until the oldest queued event has waited the budget
+            CHECK(!pipeline.SendNext(transport, WireEncoding::Binary, options, &flushAt));
+            CHECK(flushAt > MonotonicNs());
+            KeyEvent late = Key('L', KeyEventType::Down);
+            pipeline.Enqueue(&late, 1, options);
+            std::this_thread::sleep_for(std::chrono::nanoseconds(flushAt - MonotonicNs()));
+        }
+        CHECK(pipeline.SendNext(transport, WireEncoding::Binary, options));
+        CHECK_EQ(transport.Frames().size(), 2);
+        CHECK_EQ(stats.events.load(), budgetUs > 0 ? 12 : 11);
+        CHECK(!pipeline.HasPending());
+    }
+}
+
+static void FullFrameIsNotHeld() {
+    PipelineLatency latency;
+    SendStats stats;
+    SendPipeline pipeline(&latency, &stats, nullptr);
+    MemoryTransport transport(false);
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 8;
+    options.flush.budgetUs = 100000;
+    options.flush.adaptive = false;
+
+    KeyEvent first = Key('A', KeyEventType::Down);
+    pipeline.Enqueue(&first, 1, options);
+    CHECK(pipeline.SendNext(transport, WireEncoding::Binary, options));
+    for (uint8_t vk = 'B'; vk < 'B' + 8; ++vk) {
+        KeyEvent ev = Key(vk, KeyEventType::Down);
+        pipeline.Enqueue(&ev, 1, options);
+    }
+    transport.CompleteSend();
+    pipeline.PollCompletions(transport);
+    CHECK(pipeline.SendNext(transport, WireEncoding::Binary, options));
+    CHECK_EQ(stats.events.load(), 9);
+}
+
+int main() {
+    HoldsOnlyWhatQueuedBehindASend();
+    BudgetAdaptsToSendLatency();
+    SmoothsSendLatency();
+    IdleTransportIsNeverHeldBack();
+    EventsBehindAnInflightFrameGoTogether();
+    FullFrameIsNotHeld();
+    return TestExitCode();
+}
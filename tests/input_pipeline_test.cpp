@@ -0,0 +1,105 @@
+// Capture -> queue -> send on two threads, the way the input thread and the worker share
+// eventRing: synthetic keys and 1 kHz-style mouse motion pushed from a producer thread, drained in
+// batches into a SendPipeline. Every key event must arrive in order, no motion may be lost and the
+// server must end up holding what the capture side holds.
+
+#include "InputSource.h"
+#include "KeyState.h"
+#include "SendPipeline.h"
+#include "SpscRing.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "MemoryTransport.h"
+
+static const uint64_t KEY_EVENTS = 100000;
+static const uint64_t MOTION_EVENTS = 100000;
+
+struct Capture {
+    SpscRing<KeyEvent, 256> ring; // small, so the producer regularly waits for the consumer
+    KeyStateBitset pressed;
+    std::atomic<bool> done{ false };
+    int64_t motionSum = 0;
+};
+
+// The input thread: the sources run much faster than real input; a full ring is waited out rather
+// than dropping, so every event can be checked on the other side
+static void Produce(Capture* capture) {
+    int64_t start = MonotonicNs();
+    SyntheticKeySource keys(10000000, start);
+    SyntheticMouseSource mouse(10000000, start);
+    while (keys.Emitted() < KEY_EVENTS || mouse.Emitted() < MOTION_EVENTS) {
+        int64_t now = MonotonicNs();
+        for (uint64_t due = keys.Due(now); due > 0 && keys.Emitted() < KEY_EVENTS; --due) {
+            KeyEvent ev = keys.Next(now);
+            while (!capture->ring.TryPush(ev)) std::this_thread::yield();
+            capture->pressed.Apply(ev);
+        }
+        for (uint64_t due = mouse.Due(now); due > 0 && mouse.Emitted() < MOTION_EVENTS; --due) {
+            KeyEvent ev = mouse.Next(now);
+            while (!capture->ring.TryPush(ev)) std::this_thread::yield();
+            capture->motionSum += ev.dx;
+        }
+    }
+    capture->done.store(true);
+}
+
+static void EveryEventArrivesInOrder() {
+    Capture capture;
+    PipelineLatency latency;
+    SendStats stats;
+    FilterStats filterStats;
+    SendPipeline pipeline(&latency, &stats, &filterStats);
+    MemoryTransport transport;
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 64;
+
+    // the worker: CollectBatch / Enqueue / SendNext until the producer is done and the ring is empty
+    std::thread producer(Produce, &capture);
+    KeyEvent batch[64];
+    size_t maxBacklog = 0;
+    for (;;) {
+        bool finished = capture.done.load();
+        size_t n = capture.ring.PopBatch(batch, 64);
+        if (n == 0 && finished) break;
+        pipeline.Enqueue(batch, n, options);
+        if (pipeline.Backlog() > maxBacklog) maxBacklog = pipeline.Backlog();
+        while (pipeline.SendNext(transport, WireEncoding::Binary, options)) pipeline.PollCompletions(transport);
+        if (n == 0) std::this_thread::yield();
+    }
+    producer.join();
+    CHECK(!pipeline.HasPending());
+    CHECK_EQ(capture.ring.Pushed(), KEY_EVENTS + MOTION_EVENTS); // Dropped() also counts the retried pushes
+    CHECK(maxBacklog <= 64); // drained every pass: the outbox never grows past one ring batch
+
+    std::vector<KeyEvent> sent = transport.SentEvents();
+    uint64_t keys = 0;
+    int64_t motionSum = 0;
+    for (const KeyEvent& ev : sent) {
+        if (IsKeyTransition(ev)) {
+            // the sequence SyntheticKeySource produces: A down, A up, B down, ...
+            CHECK_EQ(ev.vkCode, 'A' + (keys / 2) % 26);
+            CHECK(ev.type == ((keys % 2) ? KeyEventType::Up : KeyEventType::Down));
+            keys++;
+        } else if (ev.type == KeyEventType::MouseMove) {
+            motionSum += ev.dx;
+        }
+    }
+    CHECK_EQ(keys, KEY_EVENTS);
+    CHECK_EQ(motionSum, capture.motionSum);
+    CHECK_EQ(stats.events.load() + filterStats.motionMerged.load(), KEY_EVENTS + MOTION_EVENTS);
+
+    // the server holds what the capture side holds: a resync has nothing to send
+    pipeline.Resync(capture.pressed.Load(), 0);
+    CHECK(!pipeline.HasPending());
+    CHECK_EQ(capture.pressed.Load().Count(), 0);
+}
+
+int main() {
+    EveryEventArrivesInOrder();
+    return TestExitCode();
+}
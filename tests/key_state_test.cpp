@@ -0,0 +1,106 @@
+// Pressed-key state: snapshots, ToEvents, and TakeAll racing the input thread's Set/Clear.
+
+#include "KeyState.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+
+static void SnapshotBasics() {
+    KeyStateBitset keys;
+    KeyEvent down;
+    down.vkCode = 0xA5;
+    down.type = KeyEventType::Down;
+    keys.Apply(down);
+    keys.Set(1);
+    keys.Set(64);
+    keys.Set(254);
+    KeyEvent motion;
+    motion.type = KeyEventType::MouseMove;
+    keys.Apply(motion); // not a key transition: ignored
+    CHECK(keys.Test(0xA5));
+    CHECK(!keys.Test(0xA4));
+
+    KeySnapshot s = keys.Load();
+    CHECK(s.Any());
+    CHECK_EQ(s.Count(), 4);
+    CHECK(s.Test(64));
+    CHECK(!s.Test(63));
+
+    // ascending key order, and cap is respected
+    KeyEvent out[8];
+    size_t n = s.ToEvents(KeyEventType::Up, 77, out, 8);
+    CHECK_EQ(n, 4);
+    CHECK_EQ(out[0].vkCode, 1);
+    CHECK_EQ(out[1].vkCode, 64);
+    CHECK_EQ(out[2].vkCode, 0xA5);
+    CHECK_EQ(out[3].vkCode, 254);
+    CHECK(out[3].type == KeyEventType::Up);
+    CHECK_EQ(out[3].time, 77);
+    CHECK_EQ(s.ToEvents(KeyEventType::Up, 0, out, 2), 2);
+
+    KeyEvent up = down;
+    up.type = KeyEventType::Up;
+    keys.Apply(up);
+    CHECK(!keys.Test(0xA5));
+}
+
+static void TakeAllHandsOutEveryBitOnce() {
+    // the producer presses every key once and never releases; whatever TakeAll returns while
+    // it runs plus what is left at the end must be every key, each exactly once
+    for (int round = 0; round < 200; ++round) {
+        KeyStateBitset keys;
+        int taken[256] = {};
+        std::thread producer([&keys] {
+            for (int vk = 1; vk < 256; ++vk) keys.Set((uint8_t)vk);
+        });
+        for (int i = 0; i < 50; ++i) {
+            KeySnapshot s = keys.TakeAll();
+            for (int vk = 0; vk < 256; ++vk) taken[vk] += s.Test((uint8_t)vk);
+        }
+        producer.join();
+        KeySnapshot rest = keys.TakeAll();
+        for (int vk = 0; vk < 256; ++vk) taken[vk] += rest.Test((uint8_t)vk);
+        for (int vk = 1; vk < 256; ++vk) CHECK_EQ(taken[vk], 1);
+        CHECK_EQ(taken[0], 0);
+        CHECK(!keys.Load().Any());
+    }
+}
+
+static void TakeAllAgainstApply() {
+    // presses and releases interleave with TakeAll: a taken key stays clear until it is pressed
+    // again, so afterwards only keys whose last event was a press can still be set
+    KeyStateBitset keys;
+    std::vector<KeyEvent> events;
+    bool lastDown[256] = {};
+    uint32_t x = 12345;
+    for (int i = 0; i < 200000; ++i) {
+        x = x * 1103515245u + 12345u;
+        KeyEvent ev;
+        ev.vkCode = (uint8_t)(1 + (x >> 8) % 64);
+        ev.type = (x >> 20) & 1 ? KeyEventType::Up : KeyEventType::Down;
+        lastDown[ev.vkCode] = ev.type == KeyEventType::Down;
+        events.push_back(ev);
+    }
+    std::atomic<bool> done{ false };
+    std::thread producer([&keys, &events, &done] {
+        for (const KeyEvent& ev : events) keys.Apply(ev);
+        done = true;
+    });
+    while (!done) keys.TakeAll();
+    producer.join();
+
+    KeySnapshot rest = keys.Load();
+    for (int vk = 0; vk < 256; ++vk) {
+        if (rest.Test((uint8_t)vk)) CHECK(lastDown[vk]);
+    }
+}
+
+int main() {
+    SnapshotBasics();
+    TakeAllHandsOutEveryBitOnce();
+    TakeAllAgainstApply();
+    return TestExitCode();
+}
@@ -0,0 +1,201 @@
+// Key remapping: rule parsing, remapped and dropped keys, chord macros, keys remapped onto one,
+// events that aren't emitted, flags of remapped keys, and macros surviving tap coalescing.
+
+#include "KeyRemap.h"
+#include "EventFilter.h"
+
+#include <string>
+#include <vector>
+
+#include "Check.h"
+
+static KeyEvent Key(uint8_t vk, KeyEventType type, uint8_t flags = 0) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    ev.flags = (uint8_t)(flags | (type == KeyEventType::Up ? KEY_FLAG_UP : 0));
+    ev.hookNs = 1;
+    return ev;
+}
+
+static KeyRemapTable Table(const std::vector<std::wstring>& rules) {
+    KeyRemapTable table;
+    for (const std::wstring& rule : rules) {
+        std::wstring error;
+        bool ok = table.AddRule(rule, &error);
+        CHECK(ok);
+    }
+    return table;
+}
+
+struct Remapper {
+    explicit Remapper(const KeyRemapTable& table) : table(table) {}
+
+    const KeyRemapTable& table;
+    KeyRemapper remapper;
+    RemapStats stats;
+
+    std::vector<KeyEvent> Press(uint8_t vk, KeyEventType type, bool emit = true) {
+        KeyEvent out[KeyRemapper::MAX_OUTPUT];
+        size_t n = remapper.Process(table, Key(vk, type), emit, out, &stats);
+        return std::vector<KeyEvent>(out, out + n);
+    }
+};
+
+static void ParsesNamesAndRejectsInvalidRules() {
+    CHECK_EQ(KeyNameToVk(L"a"), 'A');
+    CHECK_EQ(KeyNameToVk(L"F13"), 0x7C);
+    CHECK_EQ(KeyNameToVk(L"F25"), 0);
+    CHECK_EQ(KeyNameToVk(L"RAlt"), 0xA5);
+    CHECK_EQ(KeyNameToVk(L"0x5b"), 0x5B);
+    CHECK_EQ(KeyNameToVk(L"0x100"), 0);
+    CHECK_EQ(KeyNameToVk(L"nope"), 0);
+
+    KeyRemapTable table;
+    std::wstring error;
+    CHECK(!table.AddRule(L"CapsLock LCtrl", &error));
+    CHECK(!error.empty());
+    CHECK(!table.AddRule(L"CapsLock -> Nope", &error));
+    CHECK(!table.AddRule(L"A+B+C+D+E -> X", &error));
+    CHECK(table.AddRule(L"CapsLock -> LCtrl", &error));
+    CHECK_EQ(table.RuleCount(), 1);
+}
+
+static void RemapsAndDropsKeys() {
+    KeyRemapTable table = Table({ L"CapsLock -> LCtrl", L"ScrollLock -> None" });
+    Remapper r(table);
+    std::vector<KeyEvent> out = r.Press(0x14, KeyEventType::Down);
+    CHECK_EQ(out.size(), 1);
+    CHECK_EQ(out[0].vkCode, 0xA2);
+    CHECK_EQ(out[0].flags, 0);
+    out = r.Press(0x14, KeyEventType::Up);
+    CHECK_EQ(out.size(), 1);
+    CHECK_EQ(out[0].vkCode, 0xA2);
+    CHECK_EQ(out[0].flags, KEY_FLAG_UP);
+
+    CHECK(r.Press(0x91, KeyEventType::Down).empty());
+    CHECK(r.Press(0x91, KeyEventType::Up).empty());
+    CHECK_EQ(r.stats.remapped.load(), 4);
+
+    // unmapped keys pass through unchanged, flags included
+    KeyEvent out1[KeyRemapper::MAX_OUTPUT];
+    CHECK_EQ(r.remapper.Process(table, Key(0x26, KeyEventType::Down, KEY_FLAG_EXTENDED), true, out1, nullptr), 1);
+    CHECK_EQ(out1[0].vkCode, 0x26);
+    CHECK_EQ(out1[0].flags, KEY_FLAG_EXTENDED);
+}
+
+static void RemappedKeysCarryTheExtendedFlag() {
+    KeyRemapTable table = Table({ L"CapsLock -> RCtrl", L"Up -> W", L"F13 -> Delete" });
+    Remapper r(table);
+    std::vector<KeyEvent> out = r.Press(0x14, KeyEventType::Down);
+    CHECK_EQ(out[0].flags, KEY_FLAG_EXTENDED);
+    out = r.Press(0x14, KeyEventType::Up);
+    CHECK_EQ(out[0].flags, KEY_FLAG_UP | KEY_FLAG_EXTENDED);
+
+    // an extended key sent as a plain one loses the flag
+    out = r.Press(0x26, KeyEventType::Down);
+    CHECK_EQ(out[0].vkCode, 'W');
+    CHECK_EQ(out[0].flags, 0);
+    out = r.Press(0x7C, KeyEventType::Down);
+    CHECK_EQ(out[0].vkCode, 0x2E);
+    CHECK_EQ(out[0].flags, KEY_FLAG_EXTENDED);
+
+    CHECK(IsExtendedKey(0xA5));
+    CHECK(IsExtendedKey(0x6F));
+    CHECK(!IsExtendedKey(0xA2));
+    CHECK(!IsExtendedKey('A'));
+}
+
+static void TwoKeysOntoOneReleaseWithTheLast() {
+    KeyRemapTable table = Table({ L"CapsLock -> LCtrl" });
+    Remapper r(table);
+    CHECK_EQ(r.Press(0x14, KeyEventType::Down).size(), 1);
+    CHECK(r.Press(0xA2, KeyEventType::Down).empty()); // LCtrl already held by CapsLock
+    CHECK(r.Press(0x14, KeyEventType::Up).empty());
+    std::vector<KeyEvent> out = r.Press(0xA2, KeyEventType::Up);
+    CHECK_EQ(out.size(), 1);
+    CHECK_EQ(out[0].vkCode, 0xA2);
+    CHECK(out[0].type == KeyEventType::Up);
+}
+
+static void KeyDownsThatArentEmittedHoldNothing() {
+    KeyRemapTable table = Table({ L"CapsLock -> LCtrl" });
+    Remapper r(table);
+
+    // CapsLock pressed while unfocused, LCtrl pressed after focus came back: LCtrl is sent
+    CHECK(r.Press(0x14, KeyEventType::Down, false).empty());
+    std::vector<KeyEvent> out = r.Press(0xA2, KeyEventType::Down);
+    CHECK_EQ(out.size(), 1);
+
+    // releasing CapsLock doesn't release LCtrl, which is still physically held
+    CHECK(r.Press(0x14, KeyEventType::Up).empty());
+    out = r.Press(0xA2, KeyEventType::Up);
+    CHECK_EQ(out.size(), 1);
+    CHECK(out[0].type == KeyEventType::Up);
+
+    // the same press without anything else held releases what it may have left pressed
+    CHECK(r.Press(0x14, KeyEventType::Down, false).empty());
+    out = r.Press(0x14, KeyEventType::Up);
+    CHECK_EQ(out.size(), 1);
+    CHECK_EQ(out[0].vkCode, 0xA2);
+}
+
+static void ChordPlaysItsMacroWithoutTheHeldKeys() {
+    KeyRemapTable table = Table({ L"LCtrl+Q -> LAlt+F4", L"LCtrl+LShift+Q -> X" });
+    Remapper r(table);
+    CHECK_EQ(r.Press(0xA2, KeyEventType::Down).size(), 1);
+    std::vector<KeyEvent> out = r.Press('Q', KeyEventType::Down);
+    // LCtrl up, LAlt down, F4 down, F4 up, LAlt up, LCtrl down
+    CHECK_EQ(out.size(), 6);
+    CHECK(out[0].vkCode == 0xA2 && out[0].type == KeyEventType::Up);
+    CHECK(out[1].vkCode == 0xA4 && out[1].type == KeyEventType::Down);
+    CHECK(out[2].vkCode == 0x73 && out[2].type == KeyEventType::Down);
+    CHECK(out[3].vkCode == 0x73 && out[3].type == KeyEventType::Up);
+    CHECK(out[4].vkCode == 0xA4 && out[4].type == KeyEventType::Up);
+    CHECK(out[5].vkCode == 0xA2 && out[5].type == KeyEventType::Down);
+    for (const KeyEvent& ev : out) CHECK(ev.macro);
+    CHECK(r.Press('Q', KeyEventType::Up).empty()); // the trigger's key-up is swallowed
+    CHECK_EQ(r.stats.macrosPlayed.load(), 1);
+
+    // the more specific chord wins
+    CHECK_EQ(r.Press(0xA0, KeyEventType::Down).size(), 1);
+    out = r.Press('Q', KeyEventType::Down);
+    CHECK_EQ(out.size(), 6); // both modifiers up, X down and up, both down again
+    CHECK_EQ(out[2].vkCode, 'X');
+}
+
+static void MacroSurvivesTapCoalescing() {
+    KeyRemapTable table = Table({ L"F13 -> H E L L O" });
+    Remapper r(table);
+    std::vector<KeyEvent> events;
+    KeyEvent before[] = { Key('L', KeyEventType::Down) };
+    events.insert(events.end(), before, before + 1);
+    std::vector<KeyEvent> macro = r.Press(0x7C, KeyEventType::Down);
+    CHECK_EQ(macro.size(), 10);
+    events.insert(events.end(), macro.begin(), macro.end());
+    events.push_back(Key('L', KeyEventType::Up));
+    events.push_back(Key('A', KeyEventType::Down));
+    events.push_back(Key('A', KeyEventType::Up));
+
+    // the plain tap of A goes; the macro and the L press around it stay
+    size_t n = CoalesceTaps(events.data(), events.size(), nullptr);
+    CHECK_EQ(n, 12);
+    std::string typed;
+    for (size_t i = 0; i < n; ++i) {
+        if (events[i].macro && events[i].type == KeyEventType::Down) typed.push_back((char)events[i].vkCode);
+    }
+    CHECK(typed == "HELLO");
+    CHECK_EQ(events[0].vkCode, 'L');
+    CHECK_EQ(events[11].vkCode, 'L');
+}
+
+int main() {
+    ParsesNamesAndRejectsInvalidRules();
+    RemapsAndDropsKeys();
+    RemappedKeysCarryTheExtendedFlag();
+    TwoKeysOntoOneReleaseWithTheLast();
+    KeyDownsThatArentEmittedHoldNothing();
+    ChordPlaysItsMacroWithoutTheHeldKeys();
+    MacroSurvivesTapCoalescing();
+    return TestExitCode();
+}
@@ -0,0 +1,75 @@
+// Latency histograms: bucket boundaries and precision, percentiles, concurrent recording and the
+// per-stage table.
+
+#include "LatencyStats.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+
+static void BucketsAreExactBelow32AndWithinSixPercentAbove() {
+    for (uint64_t v = 0; v < 32; ++v) CHECK_EQ(LatencyHistogram::BucketUpperBound(LatencyHistogram::BucketIndex(v)), v);
+    for (uint64_t v = 32; v < (1ull << 32); v = v * 3 / 2 + 7) {
+        size_t i = LatencyHistogram::BucketIndex(v);
+        uint64_t upper = LatencyHistogram::BucketUpperBound(i);
+        CHECK(upper >= v);
+        CHECK(upper - v <= v / 16);
+        if (i > 0) CHECK(LatencyHistogram::BucketUpperBound(i - 1) < v);
+    }
+    // beyond the range everything lands in the last bucket
+    CHECK_EQ(LatencyHistogram::BucketIndex(1ull << 40), LatencyHistogram::BUCKET_COUNT - 1);
+}
+
+static void PercentilesOfAKnownDistribution() {
+    LatencyHistogram h;
+    CHECK_EQ(h.Percentile(50), 0);
+    for (uint64_t v = 1; v <= 1000; ++v) h.Record(v);
+    CHECK_EQ(h.Count(), 1000);
+    CHECK_EQ(h.Max(), 1000);
+    uint64_t p50 = h.Percentile(50), p99 = h.Percentile(99);
+    CHECK(p50 >= 500 && p50 <= 500 + 500 / 16);
+    CHECK(p99 >= 990 && p99 <= 1000); // capped at the maximum seen
+    CHECK_EQ(h.Percentile(100), 1000);
+
+    h.RecordNs(-5); // clock went backwards: counted as 0
+    h.RecordNs(2500);
+    CHECK_EQ(h.Count(), 1002);
+    h.Reset();
+    CHECK_EQ(h.Count(), 0);
+    CHECK_EQ(h.Max(), 0);
+}
+
+static void ConcurrentRecordsAreAllCounted() {
+    LatencyHistogram h;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&h, t] {
+            for (uint64_t i = 0; i < 100000; ++i) h.Record((i * 37 + (uint64_t)t) % 5000);
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    CHECK_EQ(h.Count(), 400000);
+    CHECK_EQ(h.Max(), 4999);
+}
+
+static void StageTableFormatting() {
+    PipelineLatency latency;
+    latency.total.Record(120);
+    char buf[1024];
+    size_t len = latency.Format(buf, sizeof(buf));
+    CHECK(len > 0);
+    CHECK_EQ(std::strlen(buf), len);
+    CHECK(std::strstr(buf, "total") != nullptr);
+    CHECK(std::strstr(buf, "120") != nullptr);
+    CHECK_EQ(latency.Format(buf, 10), 0); // not even the header fits
+}
+
+int main() {
+    BucketsAreExactBelow32AndWithinSixPercentAbove();
+    PercentilesOfAKnownDistribution();
+    ConcurrentRecordsAreAllCounted();
+    StageTableFormatting();
+    return TestExitCode();
+}
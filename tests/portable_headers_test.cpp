@@ -0,0 +1,30 @@
+// Every header of the portable core must build without windows.h; this includes them all.
+
+#include "ClientConfig.h"
+#include "ClockSync.h"
+#include "DatagramFormat.h"
+#include "EventFilter.h"
+#include "EventLog.h"
+#include "FlushScheduler.h"
+#include "FocusTracker.h"
+#include "InputSource.h"
+#include "KeyEvent.h"
+#include "KeyRemap.h"
+#include "KeyState.h"
+#include "LatencyStats.h"
+#include "Reconnect.h"
+#include "SendPipeline.h"
+#include "SpscRing.h"
+#include "TitleIndicator.h"
+#include "TraceFormat.h"
+#include "Transport.h"
+#include "UdpSession.h"
+#include "WindowMatcher.h"
+#include "WireFormat.h"
+
+#include "Check.h"
+
+int main() {
+    CHECK(sizeof(KeyEvent) <= 32);
+    return TestExitCode();
+}
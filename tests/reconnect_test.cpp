@@ -0,0 +1,157 @@
+// Reconnect support: backoff schedule, replay buffer, and the key state resync after a server
+// restart under load (the server is simulated by applying the frames of each connection to a
+// fresh key state).
+
+#include "Reconnect.h"
+#include "SendPipeline.h"
+
+#include "Check.h"
+#include "MemoryTransport.h"
+
+static void BackoffGrowsWithJitterAndResets() {
+    ReconnectBackoff backoff(100, 1000, 42);
+    uint32_t ceiling = 100;
+    for (int i = 0; i < 8; ++i) {
+        uint32_t d = backoff.NextDelayMs();
+        CHECK(d >= ceiling / 2 && d <= ceiling);
+        ceiling = ceiling * 2 > 1000 ? 1000 : ceiling * 2;
+    }
+    CHECK_EQ(backoff.Attempts(), 8);
+    backoff.Reset();
+    CHECK(backoff.NextDelayMs() <= 100);
+
+    // differently seeded clients don't retry in lock-step
+    ReconnectBackoff a(250, 10000, 1), b(250, 10000, 2);
+    bool differ = false;
+    for (int i = 0; i < 6; ++i) differ = differ || a.NextDelayMs() != b.NextDelayMs();
+    CHECK(differ);
+}
+
+static KeyEvent Key(uint8_t vk, KeyEventType type) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    ev.hookNs = ev.stageNs = MonotonicNs();
+    return ev;
+}
+
+static void ReplayBufferKeepsOrderAndCountsDrops() {
+    ReplayBuffer<4> buffer;
+    for (uint8_t vk = 1; vk <= 3; ++vk) buffer.PushBack(Key(vk, KeyEventType::Down));
+    KeyEvent front[] = { Key(10, KeyEventType::Down), Key(11, KeyEventType::Down) };
+    buffer.PushFront(front, 2); // only the newer of the two fits
+    CHECK_EQ(buffer.Size(), 4);
+    CHECK_EQ(buffer.Dropped(), 1);
+    KeyEvent out[4];
+    CHECK_EQ(buffer.Peek(out, 4), 4);
+    CHECK_EQ(out[0].vkCode, 11);
+    CHECK_EQ(out[3].vkCode, 3);
+
+    buffer.PushBack(Key(4, KeyEventType::Down)); // full: the oldest goes
+    CHECK_EQ(buffer.Dropped(), 2);
+    buffer.Peek(out, 4);
+    CHECK_EQ(out[0].vkCode, 1);
+    CHECK_EQ(out[3].vkCode, 4);
+}
+
+// key state a server ends up with after applying what a connection sent
+static RemoteKeyModel ServerState(const MemoryTransport& transport) {
+    RemoteKeyModel server;
+    std::vector<KeyEvent> events = transport.SentEvents();
+    server.Apply(events.data(), events.size());
+    return server;
+}
+
+static void Drain(SendPipeline& pipeline, MemoryTransport& transport, const SendOptions& options) {
+    while (pipeline.SendNext(transport, WireEncoding::Binary, options)) pipeline.PollCompletions(transport);
+}
+
+static void RestartedServerGetsHeldKeysAgain() {
+    PipelineLatency latency;
+    SendStats stats;
+    SendPipeline pipeline(&latency, &stats, nullptr);
+    SendOptions options;
+    KeySnapshot local;
+
+    MemoryTransport first;
+    pipeline.OnConnected(local, 0);
+    KeyEvent held[] = { Key('W', KeyEventType::Down), Key(0xA0, KeyEventType::Down) };
+    pipeline.Enqueue(held, 2, options);
+    local.words['W' >> 6] |= 1ull << ('W' & 63);
+    local.words[0xA0 >> 6] |= 1ull << (0xA0 & 63);
+    Drain(pipeline, first, options);
+    CHECK(ServerState(first).down['W']);
+
+    // the server restarts: its state is gone, the user still holds both keys
+    first.SetState(TransportState::Failed);
+    pipeline.OnTransportLost();
+    MemoryTransport second;
+    pipeline.OnConnected(local, 0);
+    Drain(pipeline, second, options);
+    RemoteKeyModel server = ServerState(second);
+    CHECK(server.down['W']);
+    CHECK(server.down[0xA0]);
+
+    // Shift is released while disconnected: the next server gets a release for it
+    pipeline.OnTransportLost();
+    local.words[0xA0 >> 6] &= ~(1ull << (0xA0 & 63));
+    MemoryTransport third;
+    pipeline.OnConnected(local, 0);
+    Drain(pipeline, third, options);
+    std::vector<KeyEvent> sent = third.SentEvents();
+    bool shiftUp = false;
+    for (const KeyEvent& ev : sent) shiftUp = shiftUp || (ev.vkCode == 0xA0 && ev.type == KeyEventType::Up);
+    CHECK(shiftUp);
+    CHECK(ServerState(third).down['W']);
+    CHECK(!ServerState(third).down[0xA0]);
+}
+
+static void RestartsUnderLoadLeaveNoKeyStuck() {
+    PipelineLatency latency;
+    SendStats stats;
+    SendPipeline pipeline(&latency, &stats, nullptr);
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 16;
+    KeyStateBitset local;
+    uint32_t rng = 12345;
+
+    MemoryTransport* server = new MemoryTransport(false);
+    pipeline.OnConnected(local.Load(), 0);
+    for (int step = 0; step < 20000; ++step) {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        KeyEvent ev = Key((uint8_t)('A' + rng % 8), (rng >> 8) % 2 ? KeyEventType::Down : KeyEventType::Up);
+        local.Apply(ev);
+        pipeline.Enqueue(&ev, 1, options);
+
+        if ((rng >> 12) % 3 == 0) server->CompleteSend();
+        pipeline.PollCompletions(*server);
+        pipeline.SendNext(*server, WireEncoding::Binary, options);
+
+        if ((rng >> 16) % 500 == 0) {
+            // kill the server (possibly mid-send) and bring up a fresh one
+            server->SetState(TransportState::Failed);
+            pipeline.OnTransportLost();
+            delete server;
+            server = new MemoryTransport(false);
+            pipeline.OnConnected(local.Load(), 0);
+        }
+    }
+    for (int i = 0; i < 1000 && (pipeline.HasPending() || pipeline.HasInflight()); ++i) {
+        server->CompleteSend();
+        pipeline.PollCompletions(*server);
+        pipeline.SendNext(*server, WireEncoding::Binary, options);
+    }
+    RemoteKeyModel state = ServerState(*server);
+    KeySnapshot expected = local.Load();
+    for (int vk = 1; vk < 256; ++vk) CHECK_EQ(state.down[vk], expected.Test((uint8_t)vk));
+    delete server;
+}
+
+int main() {
+    BackoffGrowsWithJitterAndResets();
+    ReplayBufferKeepsOrderAndCountsDrops();
+    RestartedServerGetsHeldKeysAgain();
+    RestartsUnderLoadLeaveNoKeyStuck();
+    return TestExitCode();
+}
@@ -0,0 +1,232 @@
+// SendPipeline against an in-memory transport: framing, batching, compact frame sizes, completions,
+// replay and a stalled mirror endpoint next to the primary.
+
+#include "SendPipeline.h"
+
+#include "Check.h"
+#include "MemoryTransport.h"
+
+static KeyEvent Key(uint8_t vk, KeyEventType type, uint32_t time = 0) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    ev.time = time;
+    ev.hookNs = MonotonicNs();
+    ev.stageNs = ev.hookNs;
+    return ev;
+}
+
+struct Fixture {
+    PipelineLatency latency;
+    SendStats stats;
+    FilterStats filterStats;
+    SendPipeline pipeline{ &latency, &stats, &filterStats };
+};
+
+static void OneEventPerFrameWithoutBatching() {
+    Fixture f;
+    MemoryTransport transport;
+    SendOptions options;
+    KeyEvent events[] = { Key('A', KeyEventType::Down, 10), Key('A', KeyEventType::Up, 20) };
+    f.pipeline.Enqueue(events, 2, options);
+
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Binary, options));
+    f.pipeline.PollCompletions(transport);
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Binary, options));
+    f.pipeline.PollCompletions(transport);
+    CHECK(!f.pipeline.SendNext(transport, WireEncoding::Binary, options));
+
+    CHECK_EQ(transport.Frames().size(), 2);
+    std::vector<KeyEvent> sent = transport.SentEvents();
+    CHECK_EQ(sent.size(), 2);
+    CHECK_EQ(sent[0].vkCode, 'A');
+    CHECK(sent[0].type == KeyEventType::Down);
+    CHECK(sent[1].type == KeyEventType::Up);
+    CHECK_EQ(sent[1].time, 20);
+    CHECK_EQ(f.stats.frames.load(), 2);
+    CHECK_EQ(f.stats.events.load(), 2);
+    CHECK_EQ(f.latency.total.Count(), 2);
+}
+
+static void BatchesQueuedEventsIntoOneFrame() {
+    Fixture f;
+    MemoryTransport transport;
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 3;
+    KeyEvent events[5];
+    for (int i = 0; i < 5; ++i) events[i] = Key((uint8_t)('A' + i), KeyEventType::Down);
+    f.pipeline.Enqueue(events, 5, options);
+
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Binary, options));
+    f.pipeline.PollCompletions(transport);
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Binary, options));
+    CHECK_EQ(transport.Frames().size(), 2);
+    CHECK_EQ(transport.SentEvents().size(), 5);
+    CHECK_EQ(f.stats.frames.load(), 2);
+}
+
+static void CompactFramesReportBothSizes() {
+    Fixture f;
+    MemoryTransport transport;
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 64;
+    KeyEvent events[40];
+    for (int i = 0; i < 40; ++i) events[i] = Key('W', (i % 2) ? KeyEventType::Up : KeyEventType::Down, (uint32_t)(i * 3));
+    f.pipeline.Enqueue(events, 40, options);
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Compact, options));
+
+    // what went out, and what the same frame would have cost in binary v1
+    const SentFrame& frame = transport.Frames()[0];
+    CHECK(frame.binary);
+    CHECK_EQ(f.stats.compactBytes.load(), frame.data.size());
+    CHECK_EQ(f.stats.compactBytes.load(), f.stats.bytes.load());
+    CHECK_EQ(f.stats.compactBinaryBytes.load(), BinaryFrameSize(40));
+    CHECK(f.stats.compactBytes.load() * 2 < f.stats.compactBinaryBytes.load());
+
+    KeyEvent decoded[40];
+    size_t count = 0;
+    CHECK(DecodeCompactBatch(frame.data.data(), frame.data.size(), decoded, 40, &count));
+    CHECK_EQ(count, 40);
+    CHECK_EQ(decoded[39].time, 39 * 3);
+
+    // binary frames don't count towards the compact sizes
+    f.pipeline.PollCompletions(transport);
+    f.pipeline.Enqueue(events, 2, options);
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Binary, options));
+    CHECK_EQ(f.stats.compactBinaryBytes.load(), BinaryFrameSize(40));
+}
+
+static void TextFramesAreCommaSeparated() {
+    Fixture f;
+    MemoryTransport transport;
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 8;
+    KeyEvent events[] = { Key(65, KeyEventType::Down), Key(65, KeyEventType::Up) };
+    f.pipeline.Enqueue(events, 2, options);
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Text, options));
+    CHECK_EQ(transport.Frames().size(), 1);
+    const SentFrame& frame = transport.Frames()[0];
+    CHECK(!frame.binary);
+    CHECK(std::string(frame.data.begin(), frame.data.end()) == "d65,u65");
+}
+
+static void NothingIsSentWhileASendIsInFlight() {
+    Fixture f;
+    MemoryTransport transport(false);
+    SendOptions options;
+    KeyEvent events[] = { Key('A', KeyEventType::Down), Key('B', KeyEventType::Down) };
+    f.pipeline.Enqueue(events, 2, options);
+
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Binary, options));
+    CHECK(f.pipeline.HasInflight());
+    CHECK(!f.pipeline.SendNext(transport, WireEncoding::Binary, options));
+    transport.CompleteSend();
+    f.pipeline.PollCompletions(transport);
+    CHECK(!f.pipeline.HasInflight());
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Binary, options));
+}
+
+static void UnfinishedFrameIsReplayedAfterTransportLoss() {
+    Fixture f;
+    MemoryTransport first(false);
+    SendOptions options;
+    KeyEvent events[] = { Key('A', KeyEventType::Down), Key('B', KeyEventType::Down) };
+    f.pipeline.Enqueue(events, 2, options);
+
+    CHECK(f.pipeline.SendNext(first, WireEncoding::Binary, options));
+    f.pipeline.OnTransportLost();
+    CHECK_EQ(f.pipeline.Backlog(), 2);
+
+    MemoryTransport second;
+    while (f.pipeline.SendNext(second, WireEncoding::Binary, options)) f.pipeline.PollCompletions(second);
+    std::vector<KeyEvent> sent = second.SentEvents();
+    CHECK_EQ(sent.size(), 2);
+    CHECK_EQ(sent[0].vkCode, 'A');
+    CHECK_EQ(sent[1].vkCode, 'B');
+}
+
+static void OutboxOverflowDropsOldest() {
+    Fixture f;
+    SendOptions options;
+    for (size_t i = 0; i < SendPipeline::OUTBOX_CAPACITY + 10; ++i) {
+        KeyEvent ev = Key((uint8_t)(1 + i % 200), (i % 2) ? KeyEventType::Up : KeyEventType::Down);
+        f.pipeline.Enqueue(&ev, 1, options);
+    }
+    CHECK_EQ(f.pipeline.Backlog(), SendPipeline::OUTBOX_CAPACITY);
+    CHECK_EQ(f.pipeline.Dropped(), 10);
+}
+
+static void StalledMirrorDoesNotHoldBackThePrimary() {
+    // one pipeline and transport per endpoint, fed the same batches (as WSWorker does); the
+    // mirror's sends never complete
+    Fixture primary, mirror;
+    MemoryTransport primaryTransport;
+    MemoryTransport mirrorTransport(false);
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 16;
+    const size_t TOTAL = 2000;
+    for (size_t sent = 0; sent < TOTAL; sent += 16) {
+        KeyEvent events[16];
+        for (size_t i = 0; i < 16; ++i) events[i] = Key((uint8_t)('A' + (sent + i) / 2 % 26), ((sent + i) % 2) ? KeyEventType::Up : KeyEventType::Down);
+        primary.pipeline.Enqueue(events, 16, options);
+        mirror.pipeline.Enqueue(events, 16, options);
+        while (primary.pipeline.SendNext(primaryTransport, WireEncoding::Binary, options)) primary.pipeline.PollCompletions(primaryTransport);
+        mirror.pipeline.PollCompletions(mirrorTransport);
+        mirror.pipeline.SendNext(mirrorTransport, WireEncoding::Compact, options);
+    }
+
+    CHECK_EQ(primaryTransport.SentEvents().size(), TOTAL);
+    CHECK(!primary.pipeline.HasPending());
+    CHECK_EQ(primary.stats.events.load(), TOTAL);
+    CHECK_EQ(primary.pipeline.Dropped(), 0);
+
+    // the mirror's backlog is bounded and its health is its own
+    CHECK_EQ(mirrorTransport.FrameCount(), 1);
+    CHECK(mirror.pipeline.HasInflight());
+    CHECK_EQ(mirror.pipeline.Backlog(), SendPipeline::OUTBOX_CAPACITY);
+    CHECK_EQ(mirror.pipeline.Dropped(), TOTAL - 16 - SendPipeline::OUTBOX_CAPACITY);
+    CHECK_EQ(mirror.stats.events.load(), 16); // counted when committed
+    CHECK_EQ(mirror.latency.total.Count(), 0); // never completed
+}
+
+static void RetiringReleasesOnlyWhatTheServerHolds() {
+    Fixture f;
+    MemoryTransport transport(false);
+    SendOptions options;
+    KeyEvent sent[] = { Key('A', KeyEventType::Down), Key('B', KeyEventType::Down) };
+    f.pipeline.Enqueue(sent, 2, options);
+    CHECK(f.pipeline.SendNext(transport, WireEncoding::Binary, options)); // A, in flight
+    KeyEvent queued[] = { Key('C', KeyEventType::Down) };
+    f.pipeline.Enqueue(queued, 1, options);
+
+    // B and C never reached the server: only A needs a key-up
+    f.pipeline.ReleaseRemoteKeys(5);
+    transport.CompleteSend();
+    f.pipeline.PollCompletions(transport);
+    while (f.pipeline.SendNext(transport, WireEncoding::Binary, options)) {
+        transport.CompleteSend();
+        f.pipeline.PollCompletions(transport);
+    }
+    std::vector<KeyEvent> events = transport.SentEvents();
+    CHECK_EQ(events.size(), 2);
+    CHECK_EQ(events[1].vkCode, 'A');
+    CHECK(events[1].type == KeyEventType::Up);
+    CHECK(!f.pipeline.HasPending());
+}
+
+int main() {
+    OneEventPerFrameWithoutBatching();
+    BatchesQueuedEventsIntoOneFrame();
+    CompactFramesReportBothSizes();
+    TextFramesAreCommaSeparated();
+    NothingIsSentWhileASendIsInFlight();
+    UnfinishedFrameIsReplayedAfterTransportLoss();
+    OutboxOverflowDropsOldest();
+    StalledMirrorDoesNotHoldBackThePrimary();
+    RetiringReleasesOnlyWhatTheServerHolds();
+    return TestExitCode();
+}
@@ -0,0 +1,109 @@
+// SpscRing: wraparound, overflow policy and counters, and a producer/consumer stress run.
+
+#include <cstdint>
+#include <thread>
+
+#include "SpscRing.h"
+
+#include "Check.h"
+
+static void WrapsAroundInOrder() {
+    SpscRing<uint32_t, 8> ring;
+    uint32_t next = 0, expected = 0, out = 0;
+    // indices run far past the capacity; the ring is never more than 5 deep
+    for (int round = 0; round < 1000; ++round) {
+        for (int i = 0; i < 5; ++i) CHECK(ring.TryPush(next++));
+        CHECK_EQ(ring.Size(), 5);
+        for (int i = 0; i < 5; ++i) {
+            CHECK(ring.TryPop(out));
+            CHECK_EQ(out, expected++);
+        }
+        CHECK(ring.Empty());
+    }
+    CHECK(!ring.TryPop(out));
+    CHECK_EQ(ring.Pushed(), 5000);
+    CHECK_EQ(ring.Popped(), 5000);
+    CHECK_EQ(ring.Dropped(), 0);
+    // measured against the producer's cached head, so it may overstate the depth, never understate it
+    CHECK(ring.HighWater() >= 5 && ring.HighWater() <= 8);
+}
+
+static void FullRingDropsNewest() {
+    SpscRing<uint32_t, 4> ring;
+    for (uint32_t i = 0; i < 4; ++i) CHECK(ring.TryPush(i));
+    CHECK(!ring.TryPush(100));
+    CHECK(!ring.TryPush(101));
+    CHECK_EQ(ring.Dropped(), 2);
+    CHECK_EQ(ring.Size(), 4);
+    CHECK_EQ(ring.HighWater(), 4);
+
+    // the rejected elements never show up; the ring accepts again once there is room
+    uint32_t out = 0;
+    CHECK(ring.TryPop(out));
+    CHECK_EQ(out, 0);
+    CHECK(ring.TryPush(4));
+    uint32_t batch[8];
+    CHECK_EQ(ring.PopBatch(batch, 8), 4);
+    CHECK_EQ(batch[0], 1);
+    CHECK_EQ(batch[3], 4);
+    CHECK_EQ(ring.Dropped(), 2);
+}
+
+static void PopBatchRespectsMaxCountAcrossTheWrap() {
+    SpscRing<uint32_t, 8> ring;
+    uint32_t batch[8];
+    for (uint32_t i = 0; i < 6; ++i) ring.TryPush(i);
+    CHECK_EQ(ring.PopBatch(batch, 6), 6);
+    for (uint32_t i = 6; i < 13; ++i) ring.TryPush(i); // slots 6, 7, then 0..4
+    CHECK_EQ(ring.PopBatch(batch, 3), 3);
+    CHECK_EQ(batch[0], 6);
+    CHECK_EQ(batch[2], 8);
+    CHECK_EQ(ring.PopBatch(batch, 8), 4);
+    CHECK_EQ(batch[0], 9);
+    CHECK_EQ(batch[3], 12);
+    CHECK_EQ(ring.PopBatch(batch, 8), 0);
+}
+
+// One producer pushes a counter as fast as it can, the consumer checks that what arrives is
+// strictly increasing (drops only leave gaps) and that pushed = popped + dropped at the end.
+static void ProducerConsumerStress() {
+    const uint64_t COUNT = 2000000;
+    static SpscRing<uint64_t, 1024> ring;
+    std::thread producer([] {
+        for (uint64_t i = 1; i <= COUNT; ++i) {
+            if (!ring.TryPush(i) && (i & 7) == 0) std::this_thread::yield();
+        }
+    });
+
+    uint64_t last = 0, received = 0;
+    bool ordered = true;
+    uint64_t batch[64];
+    for (;;) {
+        size_t n = ring.PopBatch(batch, 64);
+        for (size_t i = 0; i < n; ++i) {
+            if (batch[i] <= last) ordered = false;
+            last = batch[i];
+        }
+        received += n;
+        if (n == 0) {
+            if (last == COUNT || (ring.Pushed() + ring.Dropped() == COUNT && ring.Empty())) break;
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    received += ring.PopBatch(batch, 64);
+
+    CHECK(ordered);
+    CHECK_EQ(received, ring.Popped());
+    CHECK_EQ(ring.Pushed(), ring.Popped());
+    CHECK_EQ(ring.Pushed() + ring.Dropped(), COUNT);
+    CHECK(ring.HighWater() <= 1024);
+}
+
+int main() {
+    WrapsAroundInOrder();
+    FullRingDropsNewest();
+    PopBatchRespectsMaxCountAcrossTheWrap();
+    ProducerConsumerStress();
+    return TestExitCode();
+}
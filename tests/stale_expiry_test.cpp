@@ -0,0 +1,179 @@
+// Stale-event expiry and backpressure: expired key-downs are dropped and re-pressed by a resync,
+// key-ups and synthesized events always go out, a deep outbox becomes one resync, and injected
+// send stalls never leave a key held on the (simulated) server.
+
+#include "SendPipeline.h"
+
+#include <random>
+
+#include "Check.h"
+#include "MemoryTransport.h"
+
+const int64_t MS = 1000000;
+
+// hookNs must not be 0, which marks synthesized events
+static KeyEvent Key(uint8_t vk, KeyEventType type, int64_t hookNs) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    ev.hookNs = ev.stageNs = hookNs;
+    return ev;
+}
+
+struct Fixture {
+    PipelineLatency latency;
+    SendStats stats;
+    SendPipeline pipeline{ &latency, &stats, nullptr };
+    KeyStateBitset local; // what the hook has captured
+    SendOptions options;
+
+    Fixture() {
+        options.batch = true;
+        options.maxEvents = 64;
+        options.stale.keyMaxAgeMs = 100;
+        options.stale.motionMaxAgeMs = 20;
+    }
+
+    void Capture(const KeyEvent& ev) {
+        pipeline.Enqueue(&ev, 1, options);
+        local.Apply(ev);
+    }
+
+    // one worker pass, as in WSWorker: expiry (and resync) before sending
+    void Pass(MemoryTransport& transport, int64_t nowNs) {
+        if (pipeline.ExpireStale(options.stale, nowNs)) pipeline.Resync(local.Load(), 0);
+        pipeline.PollCompletions(transport);
+        while (pipeline.SendNext(transport, WireEncoding::Binary, options)) pipeline.PollCompletions(transport);
+    }
+};
+
+// The server's key state after everything sent
+static RemoteKeyModel ServerState(const MemoryTransport& transport) {
+    RemoteKeyModel server;
+    std::vector<KeyEvent> sent = transport.SentEvents();
+    server.Apply(sent.data(), sent.size());
+    return server;
+}
+
+static void ExpiredDownIsReplacedByResync() {
+    Fixture f;
+    MemoryTransport transport;
+    f.Capture(Key('A', KeyEventType::Down, 1 * MS));  // still held after the stall
+    f.Capture(Key('B', KeyEventType::Down, 2 * MS));  // released during the stall
+    f.Capture(Key('B', KeyEventType::Up, 3 * MS));
+    KeyEvent move;
+    move.type = KeyEventType::MouseMove;
+    move.dx = 5;
+    move.hookNs = move.stageNs = 4 * MS;
+    f.Capture(move);
+
+    // the stall ends after 500 ms: A and B downs and the motion are late, B's key-up still goes
+    f.Pass(transport, 500 * MS);
+    std::vector<KeyEvent> sent = transport.SentEvents();
+    CHECK_EQ(sent.size(), 2);
+    CHECK(sent[0].vkCode == 'B' && sent[0].type == KeyEventType::Up);
+    CHECK(sent[1].vkCode == 'A' && sent[1].type == KeyEventType::Down);
+    CHECK_EQ(sent[1].hookNs, 0); // the resync's, not the expired capture
+    CHECK_EQ(f.stats.expired.load(), 3);
+    CHECK_EQ(f.stats.resyncs.load(), 1);
+}
+
+static void FreshEventsAreKept() {
+    Fixture f;
+    MemoryTransport transport;
+    f.Capture(Key('A', KeyEventType::Down, 450 * MS));
+    f.Pass(transport, 500 * MS);
+    CHECK_EQ(transport.SentEvents().size(), 1);
+    CHECK_EQ(f.stats.expired.load(), 0);
+    CHECK_EQ(f.stats.resyncs.load(), 0);
+}
+
+static void SynthesizedEventsNeverExpire() {
+    Fixture f;
+    MemoryTransport transport;
+    KeyEvent release = Key('A', KeyEventType::Down, 0);
+    release.hookNs = 0;
+    f.pipeline.EnqueueSynthesized(&release, 1);
+    f.Pass(transport, 10000 * MS);
+    CHECK_EQ(transport.SentEvents().size(), 1);
+    CHECK_EQ(f.stats.expired.load(), 0);
+}
+
+static void DeepOutboxBecomesOneResync() {
+    Fixture f;
+    f.options.stale.keyMaxAgeMs = 0;
+    f.options.stale.maxQueued = 32;
+    MemoryTransport transport(false); // stalled: the first frame never completes
+    f.Capture(Key('Z', KeyEventType::Down, 1 * MS));
+    f.Pass(transport, 1 * MS);
+    for (int i = 0; i < 100; ++i) {
+        uint8_t vk = (uint8_t)('A' + i % 20);
+        f.Capture(Key(vk, (i / 20) % 2 ? KeyEventType::Up : KeyEventType::Down, (2 + i) * MS));
+    }
+    f.Capture(Key('Z', KeyEventType::Up, 200 * MS));
+    f.Pass(transport, 200 * MS);
+    CHECK_EQ(f.stats.shed.load(), 101);
+    CHECK_EQ(f.stats.resyncs.load(), 1);
+
+    transport.CompleteSend();
+    f.Pass(transport, 201 * MS);
+    transport.CompleteSend();
+    f.Pass(transport, 202 * MS);
+    RemoteKeyModel server = ServerState(transport);
+    KeySnapshot local = f.local.Load();
+    for (int vk = 1; vk < 256; ++vk) CHECK_EQ(server.down[vk], local.Test((uint8_t)vk));
+    CHECK(!server.down['Z']);
+}
+
+static void InjectedStallsLeaveNoKeyHeld() {
+    std::mt19937 rng(11);
+    Fixture f;
+    f.options.stale.maxQueued = 128;
+    MemoryTransport transport(false);
+    int64_t now = 1 * MS; // hookNs 0 would mean synthesized
+    int64_t stallUntil = 0;
+    for (int step = 0; step < 20000; ++step) {
+        now += (int64_t)(rng() % 4) * MS;
+        uint8_t vk = (uint8_t)('A' + rng() % 12);
+        f.Capture(Key(vk, f.local.Test(vk) ? KeyEventType::Up : KeyEventType::Down, now));
+
+        // one pass in five starts a stall of up to 400 ms; otherwise a send completes after a pass
+        if (now >= stallUntil && rng() % 5 == 0) stallUntil = now + (int64_t)(rng() % 400) * MS;
+        if (now >= stallUntil && transport.Inflight()) transport.CompleteSend();
+        f.Pass(transport, now);
+    }
+
+    // the link recovers: everything drains and the server holds what the user holds
+    for (int i = 0; i < 100 && (f.pipeline.HasPending() || f.pipeline.HasInflight()); ++i) {
+        now += MS;
+        if (transport.Inflight()) transport.CompleteSend();
+        f.Pass(transport, now);
+    }
+    CHECK(!f.pipeline.HasPending());
+    RemoteKeyModel server = ServerState(transport);
+    KeySnapshot local = f.local.Load();
+    for (int vk = 1; vk < 256; ++vk) CHECK_EQ(server.down[vk], local.Test((uint8_t)vk));
+    CHECK(f.stats.expired.load() > 0);
+    CHECK(f.stats.resyncs.load() > 0);
+
+    // and releasing everything leaves nothing held
+    for (int vk = 'A'; vk < 'A' + 12; ++vk) {
+        if (f.local.Test((uint8_t)vk)) f.Capture(Key((uint8_t)vk, KeyEventType::Up, now));
+    }
+    for (int i = 0; i < 100 && (f.pipeline.HasPending() || f.pipeline.HasInflight()); ++i) {
+        now += MS;
+        if (transport.Inflight()) transport.CompleteSend();
+        f.Pass(transport, now);
+    }
+    server = ServerState(transport);
+    for (int vk = 1; vk < 256; ++vk) CHECK(!server.down[vk]);
+}
+
+int main() {
+    ExpiredDownIsReplacedByResync();
+    FreshEventsAreKept();
+    SynthesizedEventsNeverExpire();
+    DeepOutboxBecomesOneResync();
+    InjectedStallsLeaveNoKeyHeld();
+    return TestExitCode();
+}
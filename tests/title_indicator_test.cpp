@@ -0,0 +1,119 @@
+// Title indicator and focus tracking: titles are only written when the text changes, the timer
+// is only needed while a target is focused, and targets get their title back when they lose it.
+
+#include "FocusTracker.h"
+#include "TitleIndicator.h"
+
+#include <vector>
+
+#include "Check.h"
+
+static WindowHandle Window(uintptr_t id) {
+    return (WindowHandle)id;
+}
+
+static IndicatorInput Input(bool connected, uint64_t activity, bool paused = false) {
+    IndicatorInput input;
+    input.connected = connected;
+    input.activity = activity;
+    input.paused = paused;
+    return input;
+}
+
+static void WritesOnlyWhenTheTextChanges() {
+    TitleIndicator indicator;
+    std::vector<TitleWrite> writes;
+    CHECK(!indicator.TimerNeeded());
+    indicator.OnTick(Input(true, 0), &writes); // no target: nothing to do
+    CHECK(writes.empty());
+
+    indicator.OnTarget(Window(1), L"Parsec", Input(true, 5), &writes);
+    CHECK(indicator.TimerNeeded());
+    CHECK_EQ(writes.size(), 1);
+    CHECK(writes[0].hwnd == Window(1));
+    CHECK(writes[0].text == L"Parsec [-]");
+
+    // idle: ten seconds of 200 ms ticks without a single write
+    writes.clear();
+    for (int i = 0; i < 50; ++i) indicator.OnTick(Input(true, 5), &writes);
+    CHECK(writes.empty());
+
+    // events sent: the spinner advances once per tick, however many were sent
+    indicator.OnTick(Input(true, 9), &writes);
+    indicator.OnTick(Input(true, 10), &writes);
+    CHECK_EQ(writes.size(), 2);
+    CHECK(writes[0].text == L"Parsec [\\]");
+    CHECK(writes[1].text == L"Parsec [|]");
+
+    // state changes take priority over the spinner; returning to it writes again
+    writes.clear();
+    indicator.OnTick(Input(false, 10), &writes);
+    indicator.OnTick(Input(false, 10), &writes);
+    indicator.OnTick(Input(true, 10, true), &writes);
+    indicator.OnTick(Input(true, 10), &writes);
+    CHECK_EQ(writes.size(), 3);
+    CHECK(writes[0].text == L"Parsec [x]");
+    CHECK(writes[1].text == L"Parsec [=]");
+    CHECK(writes[2].text == L"Parsec [|]");
+}
+
+static void LosingTheTargetRestoresItsTitle() {
+    TitleIndicator indicator;
+    std::vector<TitleWrite> writes;
+    indicator.OnTarget(Window(1), L"Parsec", Input(true, 0), &writes);
+    indicator.OnTarget(Window(1), L"Parsec [-]", Input(true, 0), &writes); // same target again: ignored
+    CHECK_EQ(writes.size(), 1);
+
+    // switching targets: the old one is restored before the new one is decorated
+    writes.clear();
+    indicator.OnTarget(Window(2), L"Parsec 2", Input(true, 0), &writes);
+    CHECK_EQ(writes.size(), 2);
+    CHECK(writes[0].hwnd == Window(1));
+    CHECK(writes[0].text == L"Parsec");
+    CHECK(writes[1].hwnd == Window(2));
+
+    writes.clear();
+    indicator.OnTarget(nullptr, L"", Input(true, 0), &writes);
+    CHECK_EQ(writes.size(), 1);
+    CHECK(writes[0].text == L"Parsec 2");
+    CHECK(!indicator.TimerNeeded());
+
+    writes.clear();
+    indicator.Restore(&writes); // nothing left to restore
+    CHECK(writes.empty());
+}
+
+static void FocusChangesDriveTheIndicator() {
+    TitlePrefixMatcher matcher(L"Parsec");
+    FocusTracker focus(&matcher);
+    TitleIndicator indicator;
+    std::vector<TitleWrite> writes;
+
+    struct Change {
+        Change(uintptr_t id, const wchar_t* title) : hwnd(Window(id)) { info.title = title; }
+        WindowHandle hwnd;
+        WindowInfo info;
+    };
+    const Change changes[] = { Change(7, L"Editor"), Change(1, L"Parsec"), Change(8, L"Browser"), Change(1, L"Parsec"),
+        Change(0, L""), Change(9, L"Parsec 2") };
+    const bool expectedActive[] = { false, true, false, true, false, true };
+    const size_t expectedWrites[] = { 0, 1, 1, 1, 1, 1 };
+    for (size_t i = 0; i < sizeof(changes) / sizeof(changes[0]); ++i) {
+        // what the foreground event handler does
+        focus.OnForegroundChanged(changes[i].hwnd, changes[i].info);
+        writes.clear();
+        indicator.OnTarget(focus.TargetWindow(), changes[i].info.title, Input(true, 0), &writes);
+        CHECK_EQ(focus.TargetActive(), expectedActive[i]);
+        CHECK_EQ(indicator.TimerNeeded(), expectedActive[i]);
+        CHECK_EQ(writes.size(), expectedWrites[i]);
+    }
+    CHECK_EQ(focus.Transitions(), 5);
+    CHECK(indicator.Target() == Window(9));
+}
+
+int main() {
+    WritesOnlyWhenTheTextChanges();
+    LosingTheTargetRestoresItsTitle();
+    FocusChangesDriveTheIndicator();
+    return TestExitCode();
+}
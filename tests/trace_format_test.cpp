@@ -0,0 +1,128 @@
+// Trace files: record round trips for keys and motion, version 1 traces, partially written last
+// records, and headers and records that aren't a trace.
+
+#include "TraceFormat.h"
+
+#include <vector>
+
+#include "Check.h"
+
+static KeyEvent Key(uint8_t vk, KeyEventType type, uint32_t time) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    ev.time = time;
+    ev.scanCode = (uint16_t)(0x100 + vk);
+    ev.flags = (uint8_t)(type == KeyEventType::Up ? KEY_FLAG_UP : 0);
+    return ev;
+}
+
+static KeyEvent Motion(KeyEventType type, int16_t dx, int16_t dy, uint32_t time) {
+    KeyEvent ev;
+    ev.type = type;
+    ev.dx = dx;
+    ev.dy = dy;
+    ev.time = time;
+    return ev;
+}
+
+static std::vector<uint8_t> Trace(const std::vector<KeyEvent>& events) {
+    std::vector<uint8_t> trace(TRACE_HEADER_LEN + events.size() * TRACE_RECORD_LEN);
+    EncodeTraceHeader(trace.data());
+    for (size_t i = 0; i < events.size(); ++i) {
+        EncodeTraceRecord(trace.data() + TRACE_HEADER_LEN + i * TRACE_RECORD_LEN, events[i], (uint32_t)(i * 1000));
+    }
+    return trace;
+}
+
+static void RecordsRoundTrip() {
+    std::vector<KeyEvent> events = { Key(0xA5, KeyEventType::Down, 0xFFFFFFF0u), Motion(KeyEventType::MouseMove, -32768, 32767, 1),
+        Motion(KeyEventType::MouseWheel, -120, 0, 2), Motion(KeyEventType::MouseHWheel, 240, 0, 3), Key(0xA5, KeyEventType::Up, 4) };
+    std::vector<uint8_t> trace = Trace(events);
+    size_t recordLen = DecodeTraceHeader(trace.data(), trace.size());
+    CHECK_EQ(recordLen, TRACE_RECORD_LEN);
+    CHECK_EQ(TraceRecordCount(trace.size(), recordLen), events.size());
+
+    for (size_t i = 0; i < events.size(); ++i) {
+        KeyEvent ev;
+        uint32_t deltaUs = 0;
+        CHECK(DecodeTraceRecord(trace.data() + TRACE_HEADER_LEN + i * recordLen, recordLen, &ev, &deltaUs));
+        CHECK_EQ(deltaUs, i * 1000);
+        CHECK_EQ(ev.time, events[i].time);
+        CHECK(ev.type == events[i].type);
+        CHECK_EQ(ev.vkCode, events[i].vkCode);
+        CHECK_EQ(ev.scanCode, events[i].scanCode);
+        CHECK_EQ(ev.flags, events[i].flags);
+        CHECK_EQ(ev.dx, events[i].dx);
+        CHECK_EQ(ev.dy, events[i].dy);
+        CHECK_EQ(ev.hookNs, 0); // the replay stamps its own clock
+    }
+}
+
+static void ReadsVersion1Traces() {
+    // 13-byte records: the version 2 record without dx / dy
+    uint8_t v2[TRACE_RECORD_LEN];
+    EncodeTraceRecord(v2, Key('Q', KeyEventType::Down, 77), 500);
+    std::vector<uint8_t> trace(TRACE_HEADER_LEN);
+    EncodeTraceHeader(trace.data());
+    PutU16(trace.data() + 4, 1);
+    PutU16(trace.data() + 6, (uint16_t)TRACE_RECORD_LEN_V1);
+    trace.insert(trace.end(), v2, v2 + TRACE_RECORD_LEN_V1);
+    trace.insert(trace.end(), v2, v2 + TRACE_RECORD_LEN_V1);
+
+    size_t recordLen = DecodeTraceHeader(trace.data(), trace.size());
+    CHECK_EQ(recordLen, TRACE_RECORD_LEN_V1);
+    CHECK_EQ(TraceRecordCount(trace.size(), recordLen), 2);
+    KeyEvent ev;
+    uint32_t deltaUs = 0;
+    CHECK(DecodeTraceRecord(trace.data() + TRACE_HEADER_LEN + recordLen, recordLen, &ev, &deltaUs));
+    CHECK_EQ(deltaUs, 500);
+    CHECK_EQ(ev.vkCode, 'Q');
+    CHECK_EQ(ev.time, 77);
+    CHECK_EQ(ev.dx, 0);
+
+    // a version 1 record can't hold motion
+    uint8_t motion[TRACE_RECORD_LEN];
+    EncodeTraceRecord(motion, Motion(KeyEventType::MouseMove, 1, 1, 0), 0);
+    CHECK(!DecodeTraceRecord(motion, TRACE_RECORD_LEN_V1, &ev, &deltaUs));
+}
+
+static void PartialLastRecordIsIgnored() {
+    std::vector<uint8_t> trace = Trace({ Key('A', KeyEventType::Down, 0), Key('A', KeyEventType::Up, 1) });
+    trace.resize(trace.size() - 1); // writer stopped in the middle of the last record
+    CHECK_EQ(TraceRecordCount(trace.size(), TRACE_RECORD_LEN), 1);
+    CHECK_EQ(TraceRecordCount(TRACE_HEADER_LEN, TRACE_RECORD_LEN), 0);
+    CHECK_EQ(TraceRecordCount(TRACE_HEADER_LEN - 1, TRACE_RECORD_LEN), 0);
+}
+
+static void RejectsForeignHeadersAndRecords() {
+    std::vector<uint8_t> trace = Trace({ Key('A', KeyEventType::Down, 0) });
+    CHECK_EQ(DecodeTraceHeader(trace.data(), TRACE_HEADER_LEN - 1), 0);
+
+    std::vector<uint8_t> copy = trace;
+    copy[0] = 'X';
+    CHECK_EQ(DecodeTraceHeader(copy.data(), copy.size()), 0);
+    copy = trace;
+    PutU16(copy.data() + 4, 3);
+    CHECK_EQ(DecodeTraceHeader(copy.data(), copy.size()), 0);
+    copy = trace;
+    PutU16(copy.data() + 6, (uint16_t)TRACE_RECORD_LEN_V1); // version 2 with version 1 records
+    CHECK_EQ(DecodeTraceHeader(copy.data(), copy.size()), 0);
+
+    KeyEvent ev;
+    uint32_t deltaUs = 0;
+    uint8_t* record = trace.data() + TRACE_HEADER_LEN;
+    record[11] = (uint8_t)KeyEventType::MouseHWheel + 1; // unknown type
+    CHECK(!DecodeTraceRecord(record, TRACE_RECORD_LEN, &ev, &deltaUs));
+    record[11] = (uint8_t)KeyEventType::Down;
+    record[10] = 0; // a key without a virtual-key code
+    CHECK(!DecodeTraceRecord(record, TRACE_RECORD_LEN, &ev, &deltaUs));
+}
+
+int main() {
+    RecordsRoundTrip();
+    ReadsVersion1Traces();
+    PartialLastRecordIsIgnored();
+    RejectsForeignHeadersAndRecords();
+    return TestExitCode();
+}
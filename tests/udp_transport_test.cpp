@@ -0,0 +1,252 @@
+// PosixUdpEngine against a loopback server that follows the rules in DatagramFormat.h: events sent
+// through the pipeline arrive in order and are acknowledged, the key state and the release on
+// close reach the server, text messages round-trip, and invalid frames and an unreachable port
+// fail the engine.
+
+#include "PosixUdpEngine.h"
+#include "SendPipeline.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+
+static KeyEvent Key(uint8_t vk, KeyEventType type) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    ev.hookNs = MonotonicNs();
+    ev.stageNs = ev.hookNs;
+    return ev;
+}
+
+static bool WaitFor(const std::function<bool()>& done, int timeoutMs = 2000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// The server end on 127.0.0.1: applies events in sequence order, acknowledges them, takes the
+// key state when no events are missing and answers every text message with "re: <message>"
+struct LoopbackServer {
+    int fd = -1;
+    uint16_t port = 0;
+    sockaddr_in client = {};
+    uint32_t nextExpected = 0;
+    bool held[256] = {};
+    std::vector<KeyEvent> applied;
+    std::vector<std::string> messages;
+    size_t keyStates = 0;
+
+    LoopbackServer() {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        CHECK(bind(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+        CHECK(getsockname(fd, (sockaddr*)&addr, &len) == 0);
+        port = ntohs(addr.sin_port);
+    }
+    ~LoopbackServer() { close(fd); }
+
+    // Handles the datagrams that arrive within timeoutMs, until done() holds (without done, only
+    // what has already arrived)
+    bool Pump(const std::function<bool()>& done, int timeoutMs = 2000) {
+        return WaitFor([&] {
+            uint8_t data[4096];
+            pollfd readable = { fd, POLLIN, 0 };
+            while (poll(&readable, 1, 0) > 0) {
+                socklen_t len = sizeof(client);
+                ssize_t n = recvfrom(fd, data, sizeof(data), 0, (sockaddr*)&client, &len);
+                if (n > 0) Receive(data, (size_t)n);
+            }
+            return !done || done();
+        }, timeoutMs);
+    }
+
+    void Receive(const uint8_t* data, size_t len) {
+        DatagramType type;
+        uint32_t seq;
+        if (!DecodeDatagramHeader(data, len, &type, &seq)) return;
+        if (type == DatagramType::Events) {
+            KeyEvent events[BINARY_MAX_EVENTS];
+            size_t count = 0;
+            uint32_t first = GetU32(data + DATAGRAM_HEADER_LEN);
+            CHECK(DecodeBinaryBatch(data + DATAGRAM_HEADER_LEN + 4, len - DATAGRAM_HEADER_LEN - 4, events, BINARY_MAX_EVENTS, &count));
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t s = first + (uint32_t)i;
+                if ((int32_t)(s - nextExpected) < 0) continue;
+                if (IsKeyTransition(events[i])) held[events[i].vkCode] = events[i].type == KeyEventType::Down;
+                applied.push_back(events[i]);
+                nextExpected = s + 1;
+            }
+            uint8_t ack[DATAGRAM_HEADER_LEN + 4];
+            EncodeDatagramHeader(DatagramType::Ack, 0, ack);
+            PutU32(ack + DATAGRAM_HEADER_LEN, nextExpected);
+            Reply(ack, sizeof(ack));
+        } else if (type == DatagramType::Keys) {
+            if (GetU32(data + DATAGRAM_HEADER_LEN) != nextExpected) return; // events still missing
+            for (int vk = 0; vk < 256; ++vk) held[vk] = (data[DATAGRAM_HEADER_LEN + 4 + vk / 8] >> (vk % 8)) & 1;
+            keyStates++;
+        } else if (type == DatagramType::Text) {
+            messages.emplace_back((const char*)data + DATAGRAM_HEADER_LEN, len - DATAGRAM_HEADER_LEN);
+            std::string answer = "re: " + messages.back();
+            std::vector<uint8_t> reply(DATAGRAM_HEADER_LEN + answer.size());
+            EncodeDatagramHeader(DatagramType::Text, 0, reply.data());
+            std::copy(answer.begin(), answer.end(), reply.begin() + DATAGRAM_HEADER_LEN);
+            Reply(reply.data(), reply.size());
+        }
+    }
+
+    void Reply(const uint8_t* data, size_t len) {
+        sendto(fd, data, len, 0, (sockaddr*)&client, sizeof(client));
+    }
+};
+
+struct Fixture {
+    PipelineLatency latency;
+    SendStats stats;
+    FilterStats filterStats;
+    SendPipeline pipeline{ &latency, &stats, &filterStats };
+};
+
+static UdpOptions FastKeyState() {
+    UdpOptions options;
+    options.keyStateIntervalMs = 20;
+    return options;
+}
+
+static void EventsArriveInOrder() {
+    LoopbackServer server;
+    std::atomic<int> wakes{ 0 };
+    PosixUdpEngine engine([&] { wakes.fetch_add(1); }, FastKeyState());
+    CHECK(engine.Start("127.0.0.1", server.port));
+    CHECK(WaitFor([&] { return engine.State() == TransportState::Open; }));
+    CHECK(wakes.load() > 0);
+    CHECK(engine.Subprotocol() == DATAGRAM_PROTOCOL);
+    CHECK(server.Pump([&] { return server.keyStates > 0; })); // the first key state goes out right away
+
+    // what the worker does: batches through the pipeline, each datagram complete once committed
+    Fixture f;
+    SendOptions options;
+    options.batch = true;
+    options.maxEvents = 16;
+    std::vector<KeyEvent> expected;
+    for (int i = 0; i < 300; ++i) {
+        uint8_t vk = (uint8_t)('A' + i % 8);
+        expected.push_back(Key(vk, (i / 8) % 2 == 0 ? KeyEventType::Down : KeyEventType::Up));
+    }
+    expected.push_back(Key('Z', KeyEventType::Down)); // still held when the connection closes
+    for (size_t i = 0; i < expected.size(); i += 30) {
+        size_t n = expected.size() - i < 30 ? expected.size() - i : 30;
+        f.pipeline.Enqueue(&expected[i], n, options);
+        while (f.pipeline.SendNext(engine, WireEncoding::Binary, options)) f.pipeline.PollCompletions(engine);
+        server.Pump(nullptr, 0);
+    }
+    CHECK(!f.pipeline.HasInflight());
+    CHECK_EQ(f.stats.events.load(), expected.size());
+    CHECK_EQ(engine.CompletedSends(), f.stats.frames.load());
+
+    CHECK(server.Pump([&] { return server.applied.size() == expected.size(); }));
+    CHECK_EQ(server.applied.size(), expected.size());
+    for (size_t i = 0; i < server.applied.size() && i < expected.size(); ++i) {
+        CHECK_EQ(server.applied[i].vkCode, expected[i].vkCode);
+        CHECK(server.applied[i].type == expected[i].type);
+    }
+    size_t keyStates = server.keyStates;
+    CHECK(server.Pump([&] { return server.keyStates > keyStates; }));
+    CHECK(server.held['Z']);
+
+    // closing releases everything on the server
+    engine.Close();
+    CHECK(WaitFor([&] { return engine.Finished(); }));
+    CHECK(engine.State() == TransportState::Closed);
+    CHECK(server.Pump([&] { return !server.held['Z']; }));
+    for (int vk = 0; vk < 256; ++vk) CHECK(!server.held[vk]);
+}
+
+static void MessagesRoundTrip() {
+    LoopbackServer server;
+    PosixUdpEngine engine(nullptr, UdpOptions());
+    std::string answer;
+    size_t cap = 0;
+    CHECK(!engine.TakeMessage(&answer));
+    CHECK(engine.SendBuffer(&cap) == nullptr); // not open yet
+    CHECK(engine.Start("127.0.0.1", server.port));
+    CHECK(WaitFor([&] { return engine.State() == TransportState::Open; }));
+
+    const std::string ping = "ping 7";
+    uint8_t* buf = engine.SendBuffer(&cap);
+    CHECK(buf != nullptr && cap >= ping.size());
+    if (buf) std::copy(ping.begin(), ping.end(), buf);
+    CHECK(engine.CommitSend(ping.size(), false));
+    CHECK_EQ(engine.CompletedSends(), 1);
+
+    CHECK(server.Pump([&] { return !server.messages.empty(); }));
+    CHECK(!server.messages.empty() && server.messages[0] == ping);
+    CHECK(WaitFor([&] { return engine.TakeMessage(&answer); }));
+    CHECK(answer == "re: ping 7");
+    engine.Abort();
+    CHECK(WaitFor([&] { return engine.Finished(); }));
+}
+
+static void InvalidFramesFailTheEngine() {
+    // a compact (v2) frame, e.g. from an encoding mismatch, and a length past the send buffer
+    for (int oversized = 0; oversized < 2; ++oversized) {
+        LoopbackServer server;
+        PosixUdpEngine engine(nullptr, UdpOptions());
+        CHECK(engine.Start("127.0.0.1", server.port));
+        CHECK(WaitFor([&] { return engine.State() == TransportState::Open; }));
+        size_t cap = 0;
+        uint8_t* buf = engine.SendBuffer(&cap);
+        CHECK(buf != nullptr);
+        if (!buf) continue;
+        KeyEvent ev = Key('A', KeyEventType::Down);
+        size_t len = oversized ? cap + 1 : EncodeCompactBatch(&ev, 1, buf, cap);
+        CHECK(len > 0);
+        CHECK(!engine.CommitSend(len, true));
+        CHECK(engine.State() == TransportState::Failed);
+        CHECK_EQ(engine.CompletedSends(), 0);
+        engine.Abort();
+        CHECK(WaitFor([&] { return engine.Finished(); }));
+    }
+}
+
+static void UnreachablePortFails() {
+    uint16_t port;
+    {
+        LoopbackServer gone; // a port nobody listens on once it is closed
+        port = gone.port;
+    }
+    PosixUdpEngine engine(nullptr, UdpOptions());
+    CHECK(engine.Start("127.0.0.1", port));
+    // the first key state is refused (ICMP port unreachable), which the next receive reports
+    CHECK(WaitFor([&] { return engine.State() == TransportState::Failed; }));
+    CHECK(!engine.Finished()); // failed stays failed until the owner has seen it
+    engine.Abort();
+    CHECK(WaitFor([&] { return engine.Finished(); }));
+    CHECK(engine.State() == TransportState::Closed);
+}
+
+int main() {
+    EventsArriveInOrder();
+    MessagesRoundTrip();
+    InvalidFramesFailTheEngine();
+    UnreachablePortFails();
+    return TestExitCode();
+}
@@ -0,0 +1,142 @@
+// Target window rules: each rule kind, overlapping prefixes in the trie, invalid rules, the
+// per-window cache, and focus tracking driven by the matcher, also while the hook reads it.
+
+#include "WindowMatcher.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "Check.h"
+
+static WindowInfo Window(const std::wstring& title, const std::wstring& className = L"", const std::wstring& process = L"") {
+    WindowInfo info;
+    info.title = title;
+    info.className = className;
+    info.processName = process;
+    return info;
+}
+
+static void EachRuleKindMatches() {
+    WindowRuleMatcher m;
+    std::wstring error;
+    CHECK(m.AddRule(L"Parsec", &error));
+    CHECK(m.AddRule(L"regex:^Moonlight( - .*)?$", &error));
+    CHECK(m.AddRule(L"class:TscShellContainerClass", &error));
+    CHECK(m.AddRule(L"process:SteamLink.exe", &error));
+    CHECK_EQ(m.RuleCount(), 4);
+    CHECK(m.NeedsClassName());
+    CHECK(m.NeedsProcessName());
+
+    CHECK(m.Matches(Window(L"Parsec - Host")));
+    CHECK(!m.Matches(Window(L"parsec - host"))); // title prefixes are case-sensitive
+    CHECK(m.Matches(Window(L"Moonlight - Desktop")));
+    CHECK(!m.Matches(Window(L"Moonlighting")));
+    CHECK(m.Matches(Window(L"anything", L"tscshellcontainerclass")));
+    CHECK(m.Matches(Window(L"anything", L"", L"steamlink.EXE")));
+    CHECK(!m.Matches(Window(L"Notepad", L"Notepad", L"notepad.exe")));
+}
+
+static void OverlappingPrefixesShareTheTrie() {
+    WindowRuleMatcher m;
+    CHECK(m.AddRule(L"prefix:Steam Link", nullptr));
+    CHECK(m.AddRule(L"title:Steam", nullptr)); // shorter prefix of an existing one
+    CHECK(m.AddRule(L"prefix:Sunshine", nullptr));
+    CHECK(m.Matches(Window(L"Steam")));
+    CHECK(m.Matches(Window(L"Steam Link - PC")));
+    CHECK(m.Matches(Window(L"Sunshine")));
+    CHECK(!m.Matches(Window(L"Stea")));
+    CHECK(!m.Matches(Window(L"Sun")));
+    CHECK(!m.Matches(Window(L"")));
+    CHECK(!m.NeedsClassName());
+}
+
+static void InvalidRulesAreReported() {
+    WindowRuleMatcher m;
+    std::wstring error;
+    CHECK(!m.AddRule(L"regex:(unclosed", &error));
+    CHECK(error.find(L"invalid regex") != std::wstring::npos);
+    CHECK(!m.AddRule(L"window:Parsec", &error));
+    CHECK(error.find(L"unknown rule kind") != std::wstring::npos);
+    CHECK(!m.AddRule(L"prefix:", &error));
+    CHECK_EQ(m.RuleCount(), 0);
+    CHECK(!m.Matches(Window(L"Parsec")));
+}
+
+static void CacheIsKeyedByWindowAndTitle() {
+    WindowMatchCache cache;
+    WindowHandle a = (WindowHandle)0x1000;
+    WindowHandle b = (WindowHandle)0x2000;
+    bool matched = false;
+    CHECK(!cache.Lookup(a, L"Parsec", &matched));
+    cache.Store(a, L"Parsec", true);
+    CHECK(cache.Lookup(a, L"Parsec", &matched));
+    CHECK(matched);
+    CHECK(!cache.Lookup(a, L"Parsec - renamed", &matched)); // a title change is re-evaluated
+    CHECK(!cache.Lookup(b, L"Parsec", &matched));
+    cache.Clear();
+    CHECK(!cache.Lookup(a, L"Parsec", &matched));
+}
+
+static void FocusTrackerFollowsTheForeground() {
+    WindowRuleMatcher m;
+    CHECK(m.AddRule(L"Parsec", nullptr));
+    FocusTracker focus(&m);
+    WindowHandle parsec = (WindowHandle)0x10;
+    WindowHandle other = (WindowHandle)0x20;
+
+    CHECK(!focus.TargetActive());
+    CHECK(focus.OnForegroundChanged(parsec, Window(L"Parsec")));
+    CHECK(focus.TargetActive());
+    CHECK(focus.TargetWindow() == parsec);
+    CHECK(!focus.OnForegroundChanged(parsec, Window(L"Parsec - game"))); // no flip
+    CHECK(focus.OnForegroundChanged(other, Window(L"Notepad")));
+    CHECK(!focus.TargetActive());
+    CHECK(focus.TargetWindow() == nullptr);
+    CHECK(focus.ForegroundWindow() == other);
+    CHECK(!focus.OnForegroundChanged(nullptr, Window(L"Parsec"))); // no foreground window at all
+    CHECK_EQ(focus.Transitions(), 2);
+
+    TitlePrefixMatcher prefix(L"Parsec");
+    CHECK(prefix.Matches(Window(L"Parsec")));
+    CHECK(!prefix.Matches(Window(L"Pars")));
+}
+
+static void HookReadsWhileTheForegroundChanges() {
+    // the WinEvent thread flips the foreground while the hook thread keeps reading the flag
+    TitlePrefixMatcher m(L"Parsec");
+    FocusTracker focus(&m);
+    WindowHandle parsec = (WindowHandle)0x10;
+    WindowHandle other = (WindowHandle)0x20;
+    const int CHANGES = 20000;
+
+    std::atomic<bool> done{ false };
+    uint64_t active = 0, inactive = 0;
+    std::thread hook([&] {
+        do {
+            if (focus.TargetActive()) active++; else inactive++;
+        } while (!done.load());
+    });
+    for (int i = 0; i < CHANGES; ++i) {
+        if (i % 2) focus.OnForegroundChanged(other, Window(L"Notepad"));
+        else focus.OnForegroundChanged(parsec, Window(L"Parsec"));
+    }
+    focus.OnForegroundChanged(parsec, Window(L"Parsec"));
+    done.store(true);
+    hook.join();
+
+    CHECK(active + inactive > 0);
+    CHECK_EQ(focus.Transitions(), CHANGES + 1);
+    CHECK(focus.TargetActive());
+    CHECK(focus.TargetWindow() == parsec);
+}
+
+int main() {
+    EachRuleKindMatches();
+    OverlappingPrefixesShareTheTrie();
+    InvalidRulesAreReported();
+    CacheIsKeyedByWindowAndTitle();
+    FocusTrackerFollowsTheForeground();
+    HookReadsWhileTheForegroundChanges();
+    return TestExitCode();
+}
@@ -0,0 +1,194 @@
+// Wire encoders: text messages, binary v1 and compact v2 round trips, truncated and malformed
+// frames, and buffers that are too small.
+
+#include "WireFormat.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+
+static KeyEvent Key(uint8_t vk, KeyEventType type, uint32_t time, uint16_t scan = 0, uint8_t flags = 0) {
+    KeyEvent ev;
+    ev.vkCode = vk;
+    ev.type = type;
+    ev.time = time;
+    ev.scanCode = scan;
+    ev.flags = (uint8_t)(flags | (type == KeyEventType::Up ? KEY_FLAG_UP : 0));
+    return ev;
+}
+
+static KeyEvent Motion(KeyEventType type, int16_t dx, int16_t dy, uint32_t time) {
+    KeyEvent ev;
+    ev.type = type;
+    ev.dx = dx;
+    ev.dy = type == KeyEventType::MouseMove ? dy : 0;
+    ev.time = time;
+    return ev;
+}
+
+static bool SameEvent(const KeyEvent& a, const KeyEvent& b) {
+    return a.time == b.time && a.type == b.type && a.vkCode == b.vkCode && a.scanCode == b.scanCode &&
+        a.flags == b.flags && a.dx == b.dx && a.dy == b.dy;
+}
+
+// keys (dictionary and not), motion and wheel with small and large deltas
+static std::vector<KeyEvent> MixedEvents(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<KeyEvent> events;
+    uint32_t time = 0xFFFFFF00u; // wraps inside the frame
+    for (size_t i = 0; i < count; ++i) {
+        time += rng() % 40;
+        switch (rng() % 4) {
+        case 0: events.push_back(Key('W', (rng() % 2) ? KeyEventType::Up : KeyEventType::Down, time, 0x11)); break;
+        case 1: events.push_back(Key((uint8_t)(1 + rng() % 254), KeyEventType::Down, time, (uint16_t)(rng() % 0x200), (uint8_t)(rng() % 2))); break;
+        case 2: events.push_back(Motion(KeyEventType::MouseMove, (int16_t)(rng() % 65536), (int16_t)(rng() % 7 - 3), time)); break;
+        default: events.push_back(Motion((rng() % 2) ? KeyEventType::MouseWheel : KeyEventType::MouseHWheel, -120, 0, time)); break;
+        }
+    }
+    return events;
+}
+
+static void TextMessages() {
+    char buf[64];
+    KeyEvent events[] = { Key(65, KeyEventType::Down, 0), Key(65, KeyEventType::Up, 1),
+        Motion(KeyEventType::MouseMove, -32768, -32768, 2), Motion(KeyEventType::MouseWheel, -120, 0, 3),
+        Motion(KeyEventType::MouseHWheel, 120, 0, 4) };
+    size_t len = EncodeTextBatch(events, 1, buf, sizeof(buf));
+    CHECK(std::string(buf, len) == "d65");
+    len = EncodeTextBatch(events, 5, buf, sizeof(buf));
+    CHECK(std::string(buf, len) == "d65,u65,m-32768 -32768,w-120,h120");
+
+    // too small for the batch: nothing is written
+    CHECK_EQ(EncodeTextBatch(events, 5, buf, 10), 0);
+    CHECK(EncodeTextBatch(events, 5, buf, 5 * TEXT_EVENT_MAX_LEN) > 0);
+}
+
+static void BinaryRoundTrip() {
+    std::vector<KeyEvent> events = MixedEvents(BINARY_MAX_EVENTS, 1);
+    std::vector<uint8_t> buf(BinaryFrameSize(events.size()));
+    size_t len = EncodeBinaryBatch(events.data(), events.size(), buf.data(), buf.size());
+    CHECK_EQ(len, BinaryFrameSize(events.size()));
+
+    std::vector<KeyEvent> decoded(events.size());
+    size_t count = 0;
+    CHECK(DecodeBinaryBatch(buf.data(), len, decoded.data(), decoded.size(), &count));
+    CHECK_EQ(count, events.size());
+    for (size_t i = 0; i < count; ++i) CHECK(SameEvent(events[i], decoded[i]));
+
+    CHECK_EQ(EncodeBinaryBatch(events.data(), 0, buf.data(), buf.size()), 0);
+    CHECK_EQ(EncodeBinaryBatch(events.data(), events.size(), buf.data(), buf.size() - 1), 0);
+}
+
+static void BinaryDeltaSaturates() {
+    KeyEvent events[] = { Key('A', KeyEventType::Down, 1000), Key('A', KeyEventType::Up, 1000 + 70000) };
+    uint8_t buf[64];
+    size_t len = EncodeBinaryBatch(events, 2, buf, sizeof(buf));
+    KeyEvent decoded[2];
+    size_t count = 0;
+    CHECK(DecodeBinaryBatch(buf, len, decoded, 2, &count));
+    CHECK_EQ(decoded[1].time, 1000 + 65535);
+}
+
+static void BinaryRejectsTruncatedAndForeignFrames() {
+    std::vector<KeyEvent> events = MixedEvents(20, 2);
+    uint8_t buf[512];
+    size_t len = EncodeBinaryBatch(events.data(), events.size(), buf, sizeof(buf));
+    KeyEvent decoded[32];
+    size_t count = 0;
+    for (size_t cut = 0; cut < len; ++cut) CHECK(!DecodeBinaryBatch(buf, cut, decoded, 32, &count));
+    CHECK(!DecodeBinaryBatch(buf, len, decoded, 19, &count)); // cap below the count
+
+    uint8_t copy[512];
+    std::memcpy(copy, buf, len);
+    copy[0] = 2;
+    CHECK(!DecodeBinaryBatch(copy, len, decoded, 32, &count));
+
+    // unknown record types are skipped, their delta still counts
+    std::memcpy(copy, buf, len);
+    copy[BINARY_HEADER_LEN] = 9;
+    CHECK(DecodeBinaryBatch(copy, len, decoded, 32, &count));
+    CHECK_EQ(count, 19);
+    CHECK_EQ(decoded[0].time, events[1].time);
+}
+
+static void CompactRoundTrip() {
+    for (uint32_t seed = 1; seed <= 20; ++seed) {
+        std::vector<KeyEvent> events = MixedEvents(1 + seed * 12, seed);
+        std::vector<uint8_t> buf(CompactFrameMaxSize(events.size()));
+        size_t len = EncodeCompactBatch(events.data(), events.size(), buf.data(), buf.size());
+        CHECK(len > 0);
+        CHECK(len < BinaryFrameSize(events.size()));
+
+        std::vector<KeyEvent> decoded(events.size());
+        size_t count = 0;
+        CHECK(DecodeCompactBatch(buf.data(), len, decoded.data(), decoded.size(), &count));
+        CHECK_EQ(count, events.size());
+        for (size_t i = 0; i < count; ++i) CHECK(SameEvent(events[i], decoded[i]));
+    }
+}
+
+static void CompactPredictsScanCodeAndFlags() {
+    // the key-up repeats the key-down's scan code and flags (with the up bit): no explicit fields
+    KeyEvent events[] = { Key('W', KeyEventType::Down, 0, 0x11, KEY_FLAG_EXTENDED), Key('W', KeyEventType::Up, 5, 0x11, KEY_FLAG_EXTENDED) };
+    uint8_t buf[64];
+    size_t len = EncodeCompactBatch(events, 2, buf, sizeof(buf));
+    CHECK_EQ(len, 3 + 4 + 2); // header; tag, delta, scan code, flags; tag, delta
+    KeyEvent decoded[2];
+    size_t count = 0;
+    CHECK(DecodeCompactBatch(buf, len, decoded, 2, &count));
+    CHECK(SameEvent(events[1], decoded[1]));
+}
+
+static void CompactRejectsTruncatedAndMalformedFrames() {
+    std::vector<KeyEvent> events = MixedEvents(30, 3);
+    std::vector<uint8_t> buf(CompactFrameMaxSize(events.size()));
+    size_t len = EncodeCompactBatch(events.data(), events.size(), buf.data(), buf.size());
+    KeyEvent decoded[32];
+    size_t count = 0;
+    for (size_t cut = 0; cut < len; ++cut) CHECK(!DecodeCompactBatch(buf.data(), cut, decoded, 32, &count));
+
+    // trailing bytes, a wrong version and an unknown record type
+    std::vector<uint8_t> copy(buf.begin(), buf.begin() + len);
+    copy.push_back(0);
+    CHECK(!DecodeCompactBatch(copy.data(), copy.size(), decoded, 32, &count));
+    copy.assign(buf.begin(), buf.begin() + len);
+    copy[0] = BINARY_WIRE_VERSION;
+    CHECK(!DecodeCompactBatch(copy.data(), copy.size(), decoded, 32, &count));
+
+    KeyEvent one = Key('A', KeyEventType::Down, 0);
+    uint8_t small[16];
+    size_t smallLen = EncodeCompactBatch(&one, 1, small, sizeof(small));
+    small[3] = (uint8_t)((small[3] & 0xF8) | 7);
+    CHECK(!DecodeCompactBatch(small, smallLen, decoded, 32, &count));
+    CHECK_EQ(EncodeCompactBatch(&one, 1, small, CompactFrameMaxSize(1) - 1), 0);
+}
+
+static void Varints() {
+    uint8_t buf[8];
+    const uint32_t values[] = { 0, 1, 127, 128, 16383, 16384, 0xFFFFFFFFu };
+    for (uint32_t v : values) {
+        size_t len = PutVarint(buf, v);
+        uint32_t back = 0;
+        CHECK_EQ(GetVarint(buf, buf + len, &back), len);
+        CHECK_EQ(back, v);
+        CHECK_EQ(GetVarint(buf, buf + len - 1, &back), 0);
+    }
+    const int32_t signedValues[] = { 0, -1, 1, -32768, 32767 };
+    for (int32_t v : signedValues) CHECK_EQ(UnZigZag(ZigZag(v)), v);
+    CHECK_EQ(ZigZag(-1), 1);
+}
+
+int main() {
+    TextMessages();
+    BinaryRoundTrip();
+    BinaryDeltaSaturates();
+    BinaryRejectsTruncatedAndForeignFrames();
+    CompactRoundTrip();
+    CompactPredictsScanCodeAndFlags();
+    CompactRejectsTruncatedAndMalformedFrames();
+    Varints();
+    return TestExitCode();
+}